@@ -0,0 +1,104 @@
+#!/bin/bash
+#
+# Check YASP's alignments against the golden results in bench/golden,
+# and report the drift next to the speedup over the golden run.
+#
+# Every data/test_clip*.wav clip is run with and without its transcript,
+# on the default profile with the dither seed pinned so runs are
+# repeatable. Each word and
+# phoneme boundary may move by up to <tolerance> frames.
+#
+# usage: bench/bench_accuracy.sh [-t tolerance] [-o results.csv] [-u] [-c]
+#   -u: regenerate the golden results and timings instead of checking
+#   -c: run each clip as a manifest job under --timeout, so the decode
+#       goes through the chunked path that checks for cancellation
+#
+# Must be run from the YASP root directory after "make". Exits non-zero
+# if any clip is out of tolerance.
+
+root_dir=$PWD
+tolerance=2
+update=0
+chunked=0
+seed=1
+results=$root_dir/bench_accuracy.csv
+golden_dir=$root_dir/bench/golden
+yasp=$root_dir/src/yasp
+
+while getopts "t:o:uc" opt; do
+	case $opt in
+	t) tolerance=$OPTARG ;;
+	o) results=$OPTARG ;;
+	u) update=1 ;;
+	c) chunked=1 ;;
+	*) echo "usage: $0 [-t tolerance] [-o results.csv] [-u] [-c]"; exit 1 ;;
+	esac
+done
+
+[ ! -x $yasp ] && echo "$yasp not found, run make first" && exit 1
+
+. $root_dir/bench/bench_lib.sh
+
+export LD_LIBRARY_PATH=$root_dir/sphinxinstall/lib/
+
+work_dir=$(mktemp -d)
+trap "rm -Rf $work_dir" EXIT
+
+mkdir -p $golden_dir
+
+if [ $update == 0 ] && ! ls $golden_dir/*.json > /dev/null 2>&1; then
+	echo "no golden results in $golden_dir, run \"make golden\" first"
+	exit 1
+fi
+
+[ $update == 0 ] && echo "clip,mode,rc,words,phonemes,mismatches,max_drift,mean_drift,over_tolerance,wall_s,golden_wall_s,speedup" | tee $results
+
+failed=0
+for wav in $root_dir/data/test_clip*.wav; do
+	clip=$(basename $wav .wav)
+	txt=${wav%.wav}.txt
+
+	for mode in transcript hypothesis; do
+		golden=$golden_dir/$clip.$mode.json
+		args="-a $wav -o $work_dir/out.json -g $work_dir/hyp"
+		[ $mode == transcript ] && args="$args -t $txt"
+
+		if [ $chunked == 1 ]; then
+			transcript=-
+			[ $mode == transcript ] && transcript=$txt
+			printf "%s\t%s\t%s\t%s\n" $wav $transcript \
+				$work_dir/out.json $work_dir/hyp > $work_dir/jobs.tsv
+			args="--manifest $work_dir/jobs.tsv --timeout 3600"
+		fi
+
+		rm -f $work_dir/out.json
+		start=$(date +%s%N)
+		$yasp $args -l $work_dir/log --seed $seed --profile default \
+			> /dev/null
+		rc=$?
+		wall=$(elapsed $start)
+
+		if [ $update == 1 ]; then
+			[ $rc != 0 ] && echo "$clip $mode failed" && exit 1
+			cp $work_dir/out.json $golden
+			echo $wall > $golden_dir/$clip.$mode.time
+			echo "updated $golden"
+			continue
+		fi
+
+		if [ ! -f $golden ]; then
+			echo "$golden missing, run with -u first"
+			exit 1
+		fi
+
+		drift=$($root_dir/bench/compare_golden.py $golden \
+			$work_dir/out.json $tolerance) || failed=1
+		golden_wall=$(cat $golden_dir/$clip.$mode.time)
+		speedup=$(awk -v g=$golden_wall -v w=$wall \
+			'BEGIN { printf "%.2f", w > 0 ? g / w : 0 }')
+
+		echo "$clip,$mode,$rc,$drift,$wall,$golden_wall,$speedup" | tee -a $results
+	done
+done
+
+exit $failed
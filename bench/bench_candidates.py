@@ -0,0 +1,63 @@
+#!/usr/bin/env python3
+#
+# Check that align_candidates() ranks a clip's own transcript first.
+#
+# Each data/test_clip*.wav clip is aligned against its own transcript
+# and every other clip's. Prints a CSV row per clip:
+#   clip,candidates,best,own_score,runner_up_score,own_rank
+# and exits non-zero if any clip's own transcript isn't ranked first.
+#
+# usage: bench_candidates.py [workers]
+#
+# Must be run from the YASP root directory after "make", with
+# LD_LIBRARY_PATH set as the run_python script does.
+
+import glob
+import json
+import os
+import sys
+
+sys.path.append(os.path.join(os.getcwd(), "yaspbin"))
+
+import yasp
+
+def main():
+    workers = int(sys.argv[1]) if len(sys.argv) > 1 else 4
+
+    clips = sorted(glob.glob("data/test_clip*.wav"))
+    texts = []
+    for clip in clips:
+        with open(clip[:-len(".wav")] + ".txt") as t:
+            texts.append(" ".join(t.read().split()))
+
+    ctx = yasp.Context()
+    print("clip,candidates,best,own_score,runner_up_score,own_rank")
+    failed = 0
+    for i, clip in enumerate(clips):
+        # the clip's own transcript is candidate 0
+        cands = [texts[i]] + texts[:i] + texts[i + 1:]
+        res = ctx.align_candidates(clip, cands, workers)
+        if res is None:
+            print("%s,%d,,,,," % (os.path.basename(clip), len(cands)))
+            failed += 1
+            continue
+
+        res = json.loads(res)
+        scores = [c["score"] if c else None for c in res["candidates"]]
+        best = res["best"]
+        own = scores[0]
+        others = [s for s in scores[1:] if s is not None]
+        runner_up = max(others) if others else None
+        rank = 1 + sum(1 for s in others if own is None or s > own)
+        print("%s,%d,%d,%s,%s,%d" %
+              (os.path.basename(clip), len(cands), best,
+               "" if own is None else own,
+               "" if runner_up is None else runner_up, rank))
+        if best != 0:
+            failed += 1
+    ctx.close()
+
+    return 1 if failed else 0
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,61 @@
+#!/bin/bash
+#
+# Run YASP over the bundled data/test_clip*.wav clips, with and without
+# their transcripts, and print one CSV row per run.
+#
+# usage: bench/bench_clips.sh [-n iterations] [-o results.csv]
+#
+# Must be run from the YASP root directory after "make".
+
+root_dir=$PWD
+iterations=3
+results=$root_dir/bench_results.csv
+yasp=$root_dir/src/yasp
+
+while getopts "n:o:" opt; do
+	case $opt in
+	n) iterations=$OPTARG ;;
+	o) results=$OPTARG ;;
+	*) echo "usage: $0 [-n iterations] [-o results.csv]"; exit 1 ;;
+	esac
+done
+
+[ ! -x $yasp ] && echo "$yasp not found, run make first" && exit 1
+
+. $root_dir/bench/bench_lib.sh
+
+export LD_LIBRARY_PATH=$root_dir/sphinxinstall/lib/
+
+work_dir=$(mktemp -d)
+trap "rm -Rf $work_dir" EXIT
+
+echo "iteration,clip,mode,rc,wall_s,model_load_s,decode_s,align_s,rtf,peak_rss_kb,output_bytes" | tee $results
+
+for i in $(seq 1 $iterations); do
+	for wav in $root_dir/data/test_clip*.wav; do
+		clip=$(basename $wav .wav)
+		txt=${wav%.wav}.txt
+
+		for mode in transcript hypothesis; do
+			args="-a $wav -o $work_dir/out.json -g $work_dir/hyp"
+			[ $mode == transcript ] && args="$args -t $txt"
+
+			rm -f $work_dir/out.json $work_dir/stats.json
+			start=$(date +%s%N)
+			$yasp $args -l $work_dir/log \
+				--stats-json $work_dir/stats.json > /dev/null
+			rc=$?
+			wall=$(elapsed $start)
+			bytes=$(stat -c %s $work_dir/out.json 2>/dev/null || echo 0)
+
+			stats=$work_dir/stats.json
+			load=$(json_val $stats seconds model_load)
+			decode=$(json_val $stats seconds decode)
+			align=$(json_val $stats seconds align)
+			rtf=$(json_val $stats rtf)
+			rss=$(json_val $stats peak_rss_kb)
+
+			echo "$i,$clip,$mode,$rc,$wall,$load,$decode,$align,$rtf,$rss,$bytes" | tee -a $results
+		done
+	done
+done
@@ -0,0 +1,17 @@
+# Helpers shared by the bench scripts. Source, don't run.
+
+# pull a number out of the --stats-json output.
+#   json_val <file> <key> [stage]
+json_val() {
+	awk -v key="\"$2\":" -v stage="\"$3\":" '
+		$1 == stage { in_stage = 1 }
+		(stage == "\"\":" || in_stage) && $1 == key {
+			gsub(",", "", $2); print $2; exit
+		}' $1
+}
+
+# seconds elapsed since a `date +%s%N` timestamp
+#   elapsed <start>
+elapsed() {
+	awk -v s=$1 -v e=$(date +%s%N) 'BEGIN { printf "%.4f", (e - s) / 1e9 }'
+}
@@ -0,0 +1,101 @@
+#!/bin/bash
+#
+# Run every data/test_clip*.wav clip under each decoder profile and
+# report its speed next to its drift from the golden results in
+# bench/golden, which are made with the default profile.
+#
+# usage: bench/bench_profiles.sh [-p "profile ..."] [-t tolerance]
+#                                [-o results.csv]
+#
+# A profile may carry overrides, as --profile takes them, e.g.
+# -p "preview preview,topn=4 default precise". Must be run from the
+# YASP root directory after "make" and "make golden".
+#
+# Ends with a Markdown table of each profile's mean real-time factor
+# and its drift over all clips, in the form the README's table takes.
+
+root_dir=$PWD
+profiles="preview default precise"
+tolerance=2
+seed=1
+results=$root_dir/bench_profiles.csv
+golden_dir=$root_dir/bench/golden
+yasp=$root_dir/src/yasp
+
+while getopts "p:t:o:" opt; do
+	case $opt in
+	p) profiles=$OPTARG ;;
+	t) tolerance=$OPTARG ;;
+	o) results=$OPTARG ;;
+	*) echo "usage: $0 [-p \"profile ...\"] [-t tolerance] [-o results.csv]"; exit 1 ;;
+	esac
+done
+
+[ ! -x $yasp ] && echo "$yasp not found, run make first" && exit 1
+
+. $root_dir/bench/bench_lib.sh
+
+export LD_LIBRARY_PATH=$root_dir/sphinxinstall/lib/
+
+if ! ls $golden_dir/*.json > /dev/null 2>&1; then
+	echo "no golden results in $golden_dir, run \"make golden\" first"
+	exit 1
+fi
+
+work_dir=$(mktemp -d)
+trap "rm -Rf $work_dir" EXIT
+
+echo "profile,clip,mode,rc,wall_s,decode_s,align_s,rtf,words,phonemes,mismatches,max_drift,mean_drift,over_tolerance" | tee $results
+
+for profile in $profiles; do
+	rows=$work_dir/rows.$(echo $profile | tr ',=' '__')
+	for wav in $root_dir/data/test_clip*.wav; do
+		clip=$(basename $wav .wav)
+		txt=${wav%.wav}.txt
+
+		for mode in transcript hypothesis; do
+			golden=$golden_dir/$clip.$mode.json
+			args="-a $wav -o $work_dir/out.json -g $work_dir/hyp"
+			[ $mode == transcript ] && args="$args -t $txt"
+
+			rm -f $work_dir/out.json $work_dir/stats.json
+			start=$(date +%s%N)
+			$yasp $args -l $work_dir/log --seed $seed \
+				--profile $profile \
+				--stats-json $work_dir/stats.json > /dev/null
+			rc=$?
+			wall=$(elapsed $start)
+
+			stats=$work_dir/stats.json
+			decode=$(json_val $stats seconds decode)
+			align=$(json_val $stats seconds align)
+			rtf=$(json_val $stats rtf)
+
+			if [ -f $golden ]; then
+				drift=$($root_dir/bench/compare_golden.py \
+					$golden $work_dir/out.json $tolerance)
+			else
+				drift=",,,,,"
+			fi
+
+			echo "\"$profile\",$clip,$mode,$rc,$wall,$decode,$align,$rtf,$drift" | tee -a $results
+			echo "$rtf,$drift" >> $rows
+		done
+	done
+done
+
+echo
+echo "| profile | mean RTF | max drift | mean drift | mismatches |"
+echo "|---------|----------|-----------|------------|------------|"
+for profile in $profiles; do
+	rows=$work_dir/rows.$(echo $profile | tr ',=' '__')
+	awk -F, -v p="$profile" '
+		$1 != "" { rtf += $1; nrtf++ }
+		$6 != "" { if ($5 > max) max = $5; drift += $6; ndrift++; mis += $4 }
+		END {
+			printf "| %s | %s | %s | %s | %d |\n", p,
+			       nrtf ? sprintf("%.3f", rtf / nrtf) : "-",
+			       ndrift ? max : "-",
+			       ndrift ? sprintf("%.2f", drift / ndrift) : "-", mis
+		}' $rows
+done
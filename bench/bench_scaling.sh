@@ -0,0 +1,75 @@
+#!/bin/bash
+#
+# Measure how YASP scales with clip length. The bundled clips and their
+# transcripts are concatenated 1, 2, 4 ... max times over, and each size
+# is run in three modes:
+#   hypothesis: decode only (--hypothesis-only)
+#   align:      forced alignment against the transcript
+#   two-pass:   decode, then align against the generated hypothesis
+# One CSV row is printed per run.
+#
+# usage: bench/bench_scaling.sh [-m max factor] [-o results.csv]
+#
+# Must be run from the YASP root directory after "make".
+
+root_dir=$PWD
+max_factor=64
+results=$root_dir/bench_scaling.csv
+yasp=$root_dir/src/yasp
+
+while getopts "m:o:" opt; do
+	case $opt in
+	m) max_factor=$OPTARG ;;
+	o) results=$OPTARG ;;
+	*) echo "usage: $0 [-m max factor] [-o results.csv]"; exit 1 ;;
+	esac
+done
+
+[ ! -x $yasp ] && echo "$yasp not found, run make first" && exit 1
+
+. $root_dir/bench/bench_lib.sh
+
+export LD_LIBRARY_PATH=$root_dir/sphinxinstall/lib/
+
+work_dir=$(mktemp -d)
+trap "rm -Rf $work_dir" EXIT
+
+echo "factor,mode,rc,audio_s,words,wall_s,decode_s,align_s,rtf,peak_rss_kb" | tee $results
+
+factor=1
+while [ $factor -le $max_factor ]; do
+	wav=$work_dir/long.wav
+	txt=$work_dir/long.txt
+	$root_dir/bench/concat_clips.py $factor $wav $txt \
+		$root_dir/data/test_clip*.wav || exit 1
+	words=$(wc -w < $txt)
+
+	for mode in hypothesis align two-pass; do
+		args="-a $wav -o $work_dir/out.json -g $work_dir/hyp"
+		case $mode in
+		hypothesis) args="$args --hypothesis-only" ;;
+		align) args="$args -t $txt" ;;
+		esac
+
+		rm -f $work_dir/stats.json
+		start=$(date +%s%N)
+		$yasp $args -l $work_dir/log \
+			--stats-json $work_dir/stats.json > /dev/null
+		rc=$?
+		wall=$(elapsed $start)
+
+		stats=$work_dir/stats.json
+		decode=$(json_val $stats seconds decode)
+		align=$(json_val $stats seconds align)
+		rtf=$(json_val $stats rtf)
+		rss=$(json_val $stats peak_rss_kb)
+		# the stats sum the audio over every pass, report one pass
+		audio=$(json_val $stats audio_seconds)
+		[ $mode == two-pass ] && audio=$(awk -v a=$audio \
+			'BEGIN { printf "%.2f", a / 2 }')
+
+		echo "$factor,$mode,$rc,$audio,$words,$wall,$decode,$align,$rtf,$rss" | tee -a $results
+	done
+
+	factor=$((factor * 2))
+done
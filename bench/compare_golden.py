@@ -0,0 +1,73 @@
+#!/usr/bin/env python3
+#
+# Compare a YASP JSON result against a golden one.
+#
+# usage: compare_golden.py <golden.json> <result.json> <tolerance>
+#
+# Words and phonemes must match one for one. Every start and end
+# boundary may drift by up to <tolerance> frames. Prints a single CSV
+# row:
+#   words,phonemes,mismatches,max_drift,mean_drift,over_tolerance
+# and exits non-zero if the result is out of tolerance.
+
+import json
+import sys
+
+def boundaries(entries, key):
+    for e in entries:
+        yield e[key], e["start"], e["start"] + e["duration"]
+
+def compare(golden, result, tolerance):
+    drift = []
+    mismatches = 0
+    phonemes = 0
+
+    gwords = golden["words"]
+    rwords = result["words"]
+    mismatches += abs(len(gwords) - len(rwords))
+
+    for gw, rw in zip(gwords, rwords):
+        pairs = [(gw, rw, "word")]
+        pairs += [(gp, rp, "phoneme") for gp, rp in
+                  zip(gw["phonemes"], rw["phonemes"])]
+        mismatches += abs(len(gw["phonemes"]) - len(rw["phonemes"]))
+        phonemes += len(gw["phonemes"])
+
+        for g, r, key in pairs:
+            if g[key] != r[key]:
+                mismatches += 1
+                continue
+            drift.append(abs(g["start"] - r["start"]))
+            drift.append(abs((g["start"] + g["duration"]) -
+                             (r["start"] + r["duration"])))
+
+    over = len([d for d in drift if d > tolerance])
+    max_drift = max(drift) if drift else 0
+    mean_drift = sum(drift) / len(drift) if drift else 0
+
+    return len(gwords), phonemes, mismatches, max_drift, mean_drift, over
+
+def main():
+    if len(sys.argv) != 4:
+        print("usage: %s <golden.json> <result.json> <tolerance>" %
+              sys.argv[0])
+        return 2
+
+    with open(sys.argv[1]) as f:
+        golden = json.load(f)
+    try:
+        with open(sys.argv[2]) as f:
+            result = json.load(f)
+    except (OSError, ValueError):
+        result = {"words": []}
+
+    words, phonemes, mismatches, max_drift, mean_drift, over = \
+        compare(golden, result, int(sys.argv[3]))
+
+    print("%d,%d,%d,%d,%.3f,%d" % (words, phonemes, mismatches,
+                                   max_drift, mean_drift, over))
+
+    return 1 if mismatches or over else 0
+
+if __name__ == "__main__":
+    sys.exit(main())
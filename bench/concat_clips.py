@@ -0,0 +1,49 @@
+#!/usr/bin/env python3
+#
+# Build a long synthetic clip by concatenating the given .wav files, and
+# their .txt transcripts, <factor> times over.
+#
+# usage: concat_clips.py <factor> <out.wav> <out.txt> <clip.wav>...
+#
+# All clips must share the same sample rate, width and channel count.
+
+import sys
+import wave
+
+def main():
+    if len(sys.argv) < 5:
+        print("usage: %s <factor> <out.wav> <out.txt> <clip.wav>..." %
+              sys.argv[0])
+        return 1
+
+    factor = int(sys.argv[1])
+    out_wav = sys.argv[2]
+    out_txt = sys.argv[3]
+    clips = sys.argv[4:]
+
+    frames = []
+    words = []
+    params = None
+    for clip in clips:
+        with wave.open(clip, "rb") as w:
+            if params and w.getparams()[:3] != params[:3]:
+                print("%s: format doesn't match %s" % (clip, clips[0]))
+                return 1
+            params = w.getparams()
+            frames.append(w.readframes(w.getnframes()))
+        with open(clip[:-len(".wav")] + ".txt") as t:
+            words.append(" ".join(t.read().split()))
+
+    with wave.open(out_wav, "wb") as w:
+        w.setparams(params)
+        for i in range(factor):
+            for f in frames:
+                w.writeframes(f)
+
+    with open(out_txt, "w") as t:
+        t.write(" ".join(words * factor) + "\n")
+
+    return 0
+
+if __name__ == "__main__":
+    sys.exit(main())
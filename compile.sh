@@ -6,20 +6,24 @@ install_dir=$PWD/sphinxinstall
 #build YASP
 export PKG_CONFIG_PATH=$install_dir/lib/pkgconfig/
 swig -python src/yasp.i
-gcc -Wall -Werror -g -o src/yasp src/yasp.c src/cJSON.c -I $root_dir/pocketsphinx/src/libpocketsphinx/  \
+gcc -Wall -Werror -g -o src/yasp src/yasp_main.c src/yasp_serve.c src/yasp_index_cmd.c src/yasp_dict_cmd.c src/yasp.c src/yasp_index.c src/yasp_dict.c src/yasp_g2p.c src/yasp_text.c src/cJSON.c -I $root_dir/pocketsphinx/src/libpocketsphinx/  \
     -I $root_dir/include -I $root_dir/sphinxbase/include/sphinxbase/ \
     -DMODELDIR=\"`pkg-config --variable=modeldir pocketsphinx`\" \
-    `pkg-config --cflags --libs pocketsphinx sphinxbase`
+    `pkg-config --cflags --libs pocketsphinx sphinxbase` -lpthread
 
-gcc -Wall -Werror -g -c -fPIC src/yasp.c src/cJSON.c src/yasp_wrap.c \
+gcc -Wall -Werror -g -c -fPIC src/yasp.c src/yasp_index.c src/yasp_dict.c src/yasp_g2p.c src/yasp_text.c src/cJSON.c src/yasp_wrap.c \
     -I /usr/include/python3.7/ \
     -I $root_dir/pocketsphinx/src/libpocketsphinx/  \
     -I $root_dir/include -I $root_dir/sphinxbase/include/sphinxbase/ \
     -DMODELDIR=\"`pkg-config --variable=modeldir pocketsphinx`\" \
     `pkg-config --cflags pocketsphinx sphinxbase`
 
-ld -shared yasp.o cJSON.o yasp_wrap.o -o _yasp.so \
-   `pkg-config --libs pocketsphinx sphinxbase`
+gcc -shared yasp.o yasp_index.o yasp_dict.o yasp_g2p.o yasp_text.o cJSON.o yasp_wrap.o -o _yasp.so \
+   `pkg-config --libs pocketsphinx sphinxbase` -lpthread
+
+gcc -shared yasp.o yasp_index.o yasp_dict.o yasp_g2p.o yasp_text.o cJSON.o -o libyasp.so \
+   `pkg-config --libs pocketsphinx sphinxbase` -lpthread
+ar rcs libyasp.a yasp.o yasp_index.o yasp_dict.o yasp_g2p.o yasp_text.o cJSON.o
 
 mv *.o src/
-mv *.so src/
+mv *.so *.a src/
@@ -51,42 +51,42 @@ struct list_head {
  * This is only for internal list manipulation where we know
  * the prev/next entries already!
  */
-static inline void __list_add(struct list_head * new,
+static inline void __list_add(struct list_head *item,
 				  struct list_head * prev,
 				  struct list_head * next)
 {
-	next->prev = new;
-	new->next = next;
-	new->prev = prev;
-	prev->next = new;
+	next->prev = item;
+	item->next = next;
+	item->prev = prev;
+	prev->next = item;
 }
 
 /**
  * Insert an entry at the start of a list.
- * \param new  new entry to be inserted
+ * \param item new entry to be inserted
  * \param head list to add it to
  *
  * Insert a new entry after the specified head.
  * This is good for implementing stacks.
  */
-static inline void list_add(struct list_head *new,
+static inline void list_add(struct list_head *item,
 				struct list_head *head)
 {
-	__list_add(new, head, head->next);
+	__list_add(item, head, head->next);
 }
 
 /**
  * Insert an entry at the end of a list.
- * \param new  new entry to be inserted
+ * \param item new entry to be inserted
  * \param head list to add it to
  *
  * Insert a new entry before the specified head.
  * This is useful for implementing queues.
  */
-static inline void list_add_tail(struct list_head *new,
+static inline void list_add_tail(struct list_head *item,
 				     struct list_head *head)
 {
-	__list_add(new, head->prev, head);
+	__list_add(item, head->prev, head);
 }
 
 /*
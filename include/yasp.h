@@ -23,7 +23,15 @@
 #ifndef SPEECH_PARSER_H
 #define SPEECH_PARSER_H
 
+#include <stdio.h>
+#include <stddef.h>
+#include <prim_type.h>
 #include <err.h>
+#include "list.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
 
 struct yasp_word {
 	struct list_head ph_on_list;
@@ -42,6 +50,180 @@ struct yasp_logs {
 	FILE *lg_info;
 };
 
+/* see yasp_context_create() */
+struct yasp_context;
+
+/* see yasp_index_open() */
+struct yasp_index;
+
+/*
+ * A match found in an index.
+ *	ih_clip: the clip it's in. Points into the index and is valid
+ *	until the index is next changed or closed
+ *	ih_start, ih_duration: in frames, spanning the whole match
+ *	ih_conf: the lowest confidence of the words matched
+ */
+struct yasp_index_hit {
+	const char *ih_clip;
+	int ih_start;
+	int ih_duration;
+	double ih_conf;
+};
+
+/*
+ * A transcript word that isn't in the pronunciation dictionary.
+ *	ov_word: the word, normalized as alignment sees it
+ *	ov_index: its position among the transcript's words, from 0
+ *	ov_line, ov_column: where it starts in the text, from 1. The
+ *	column counts bytes.
+ */
+struct yasp_oov {
+	char *ov_word;
+	int ov_index;
+	int ov_line;
+	int ov_column;
+};
+
+/*
+ * yasp_progress_f
+ *	called between chunks of a decode with the frames searched so
+ *	far out of total. A non zero return cancels the decode.
+ */
+typedef int (*yasp_progress_f)(int32 frames, int32 total, void *user_data);
+
+/*
+ * Control over a long decode, checked between chunks of about a
+ * second of audio. The clip's features are normalized as a whole
+ * first, so the result doesn't depend on the chunking. A stopped
+ * decode fails with -ECANCELED, or -ETIMEDOUT once it runs past its
+ * timeout, and its decoder goes back to the context straight away.
+ *	ct_cancel: set from any thread to stop the decode
+ *	ct_timeout: seconds a decode may run for, 0 for no limit
+ *	ct_progress: optional, see yasp_progress_f
+ */
+struct yasp_control {
+	volatile int ct_cancel;
+	double ct_timeout;
+	yasp_progress_f ct_progress;
+	void *ct_user_data;
+};
+
+/*
+ * A single alignment job in a batch.
+ *	jb_output: if set the JSON is written to this file, otherwise
+ *	it's returned in jb_json, which the caller must free with
+ *	yasp_free_json_str()
+ *	jb_rc: 0 on success
+ *	jb_ctl: optional, may be shared by several jobs
+ */
+struct yasp_job {
+	const char *jb_audio;
+	const char *jb_transcript;
+	const char *jb_output;
+	const char *jb_genpath;
+	char *jb_json;
+	int jb_rc;
+	struct yasp_control *jb_ctl;
+};
+
+typedef void (*yasp_job_done_f)(struct yasp_job *job, void *user_data);
+
+/* see yasp_context_preview() */
+struct yasp_refine;
+
+/*
+ * yasp_refine_done_f
+ *	called from the refinement's thread with its JSON, or NULL and
+ *	the error in rc. json is freed once the callback returns.
+ */
+typedef void (*yasp_refine_done_f)(const char *json, int rc,
+				   void *user_data);
+
+/*
+ * Named decoder settings, from fastest to most accurate: preview
+ * narrows the beams, evaluates fewer Gaussians and every other frame,
+ * and skips the second search passes. precise widens the beams and
+ * lifts the per-frame HMM limit. default is pocketsphinx's own.
+ */
+enum yasp_profile {
+	YASP_PROFILE_DEFAULT,
+	YASP_PROFILE_PREVIEW,
+	YASP_PROFILE_PRECISE,
+	YASP_PROFILE_MAX,
+};
+
+/*
+ * Decoder settings. Any field left at 0 keeps the profile's value.
+ *	dp_beam, dp_wbeam, dp_pbeam: HMM, word and phone beam widths,
+ *	e.g. 1e-48. Larger values prune more and decode faster
+ *	dp_lw: language model weight
+ *	dp_frate: frames per second. Result times are in these frames
+ *	dp_ds: only score every dp_ds'th frame
+ *	dp_topn: Gaussians evaluated per mixture
+ *	dp_maxhmmpf: most HMMs searched per frame, -1 for no limit
+ */
+struct yasp_decoder_params {
+	enum yasp_profile dp_profile;
+	double dp_beam;
+	double dp_wbeam;
+	double dp_pbeam;
+	double dp_lw;
+	int dp_frate;
+	int dp_ds;
+	int dp_topn;
+	int dp_maxhmmpf;
+};
+
+/*
+ * One of several alternative transcripts of a clip.
+ *	cd_text: the transcript itself
+ *	cd_words, cd_phonemes: its alignment, free with
+ *	yasp_free_segment_list()
+ *	cd_ascr: the search's path score at the end of the alignment,
+ *	with every frame scored against the best of all senones.
+ *	Candidates of the same clip compare directly, higher matches
+ *	better
+ *	cd_rc: 0 on success
+ */
+struct yasp_candidate {
+	const char *cd_text;
+	struct list_head cd_words;
+	struct list_head cd_phonemes;
+	int32 cd_ascr;
+	int cd_rc;
+};
+
+enum yasp_stage {
+	YASP_STAGE_MODEL_LOAD,
+	YASP_STAGE_DECODE,
+	YASP_STAGE_ALIGN,
+	YASP_STAGE_PARSE,
+	YASP_STAGE_CONSOLIDATE,
+	YASP_STAGE_JSON,
+	YASP_STAGE_MAX
+};
+
+/*
+ * Counters collected across every call in the process.
+ *	st_time: wall time spent in each stage, in seconds
+ *	st_calls: number of times each stage ran
+ *	st_frames: feature frames decoded, summed over all passes
+ *	st_audio_secs: audio decoded, summed over all passes
+ *	st_allocs: allocations made building the segment lists
+ *	st_output_bytes: JSON bytes generated
+ *	st_peak_rss_kb: peak resident set size of the process, filled in
+ *	by yasp_get_stats()
+ */
+struct yasp_stats {
+	double st_time[YASP_STAGE_MAX];
+	unsigned long st_calls[YASP_STAGE_MAX];
+	unsigned long st_frames;
+	double st_audio_secs;
+	unsigned long st_allocs;
+	unsigned long st_output_bytes;
+	unsigned long st_peak_rss_kb;
+};
+
 /*
  * yasp_interpret_hypothesis
  *	interpret speech clip and return a list of words and times
@@ -50,6 +232,15 @@ int yasp_interpret_hypothesis(const char *faudio, const char *ftranscript,
 			      const char *genpath,
 			      struct list_head *word_list);
 
+/*
+ * yasp_decode_hypothesis
+ *	decode the speech clip only, without aligning it, and return the
+ *	recognized words and times. If genpath is given the hypothesis
+ *	is written to it as well.
+ */
+int yasp_decode_hypothesis(const char *faudio, const char *genpath,
+			   struct list_head *word_list);
+
 /*
  * yasp_interpret_phonemes
  *	interpret speech clip and return a list of phonemes and times
@@ -58,6 +249,16 @@ int yasp_interpret_phonemes(const char *faudio, const char *ftranscript,
 			    const char *genpath,
 			    struct list_head *phoneme_list);
 
+/*
+ * yasp_interpret_allphone
+ *	phoneme timing only, without recognizing any words. Runs the
+ *	phone loop search once over the clip instead of a decode and an
+ *	alignment. The phonemes come back in the same format as
+ *	yasp_interpret_phonemes(), SIL included.
+ */
+int yasp_interpret_allphone(const char *audioFile,
+			    struct list_head *phoneme_list);
+
 /*
  * yasp_interpret
  *	interpret speech and write json file
@@ -78,6 +279,20 @@ char *yasp_interpret_get_str(const char *audioFile, const char *transcript,
  */
 void yasp_free_json_str(char *json);
 
+/*
+ * yasp_spot_keywords
+ *	find when any of the keywords are spoken, without transcribing
+ *	the whole clip. Runs the keyword spotting search once over the
+ *	clip. A keyword may be a phrase and may carry its own
+ *	"/threshold/", otherwise threshold is used, or the decoder's
+ *	default when it's 0. Every word must be in the dictionary.
+ *	Each hit is added to hit_list with ph_word set to the keyword and
+ *	ph_prob to the confidence.
+ */
+int yasp_spot_keywords(const char *audioFile, const char **keywords,
+		       int nkeywords, double threshold,
+		       struct list_head *hit_list);
+
 /*
  * yasp_interpret_breadown
  *	interpret script and return the word and phoneme list
@@ -89,7 +304,8 @@ int yasp_interpret_breadown(const char *audioFile, const char *transcript,
 
 /*
  * yasp_parse_transcript
- *	parse a text file pointed at by fh into a list
+ *	parse a text file pointed at by fh into a list of its words, in
+ *	order and normalized the way alignment sees them
  */
 int yasp_parse_transcript(struct list_head *transcript, FILE *fh);
 
@@ -109,6 +325,22 @@ int yasp_create_json_file(struct list_head *word_list,
 			  struct list_head *phoneme_list,
 			  const char *output);
 
+/*
+ * yasp_parse_json
+ *	read a result written by yasp_create_json() back into word and
+ *	phoneme lists, times in frames as they were written. Returns
+ *	-EINVAL if json isn't a result, the lists are freed then.
+ */
+int yasp_parse_json(const char *json, struct list_head *word_list,
+		    struct list_head *phoneme_list);
+
+/*
+ * yasp_create_kws_json
+ *	returns a json string of the keyword hits found by
+ *	yasp_spot_keywords()
+ */
+char *yasp_create_kws_json(struct list_head *hit_list);
+
 /*
  * yasp_log
  *	logging function
@@ -143,6 +375,361 @@ void yasp_setup_logging(struct yasp_logs *logs, err_cb_f cb,
 			const char *logfile);
 void yasp_finish_logging(struct yasp_logs *logs);
 
+/*
+ * yasp_set_log_callback
+ *	route all logging through cb instead of the log files. user_data
+ *	is handed back to cb untouched. cb may be called from whichever
+ *	thread is decoding, so it must be thread safe.
+ */
+void yasp_set_log_callback(err_cb_f cb, void *user_data);
+
+/*
+ * yasp_get_stats
+ * yasp_reset_stats
+ *	snapshot or clear the process wide counters
+ * yasp_stats_rtf
+ *	decode and alignment time over the audio duration decoded
+ * yasp_stats_json
+ *	returns the stats as a JSON string, free with yasp_free_json_str()
+ * yasp_print_stats
+ *	print the stats as a table
+ */
+void yasp_get_stats(struct yasp_stats *stats);
+void yasp_reset_stats(void);
+double yasp_stats_rtf(const struct yasp_stats *stats);
+char *yasp_stats_json(const struct yasp_stats *stats);
+void yasp_print_stats(FILE *fh, const struct yasp_stats *stats);
+
 /* explicitly set the model directory */
 int yasp_set_modeldir(const char *modeldir);
+
+/*
+ * fix the seed used for dithering the audio, so repeated runs on the
+ * same clip give the same result. A negative seed (the default) picks
+ * a new one per decoder. Applies to decoders created afterwards.
+ */
+void yasp_set_seed(int seed);
+
+/*
+ * when enabled, one-shot alignments with a transcript build their
+ * decoder with only the transcript's words in its dictionary and no
+ * language model, which is much quicker to load than the full
+ * dictionary. Decoders held by a yasp_context aren't affected.
+ */
+void yasp_set_transcript_dict(int enable);
+
+/*
+ * yasp_set_pron_cache
+ *	use the pronunciations in the file at path, in the same format
+ *	as the dictionary, for words the dictionary doesn't have. With
+ *	yasp_set_g2p() on, the pronunciations it guesses are added to
+ *	the file, so later runs find them there. The file is created
+ *	when needed. NULL stops using it.
+ * yasp_set_g2p
+ *	when enabled, a transcript word missing from both the dictionary
+ *	and the cache gets a pronunciation guessed from its spelling
+ *	rather than failing the alignment.
+ */
+int yasp_set_pron_cache(const char *path);
+void yasp_set_g2p(int enable);
+
+/*
+ * yasp_parse_decoder_params
+ *	set params from spec, a comma separated list of a profile name
+ *	and key=value overrides, e.g. "preview,beam=1e-40,topn=4". The
+ *	keys are the yasp_decoder_params fields without dp_. Fields spec
+ *	doesn't name are left alone.
+ * yasp_set_decoder_params
+ *	settings for one-shot decoders and for contexts created with
+ *	yasp_context_create(). NULL goes back to the default profile.
+ *	Existing contexts aren't affected.
+ */
+int yasp_parse_decoder_params(const char *spec,
+			      struct yasp_decoder_params *params);
+int yasp_set_decoder_params(const struct yasp_decoder_params *params);
+
+/*
+ * yasp_compile_dict
+ *	compile the text pronunciation dictionary at dict (the model
+ *	directory's cmudict-en-us.dict if NULL) into a binary lexicon
+ *	that is mapped instead of parsed, with constant time lookups.
+ *	out defaults to dict with ".bin" appended, where it's picked up
+ *	automatically as long as it's no older than dict.
+ */
+int yasp_compile_dict(const char *dict, const char *out);
+
+/*
+ * yasp_check_transcript
+ * yasp_check_transcript_file
+ *	find every word of a transcript, given as text or as a path,
+ *	that alignment would reject as unknown. The words are split and
+ *	normalized the same way alignment does it, and looked up in the
+ *	model directory's dictionary and noise dictionary and in the
+ *	pronunciation cache if one is set. The acoustic model isn't
+ *	loaded. Returns the number of unknown words, with *oovs
+ *	set to an array of them to be freed with yasp_free_oovs(), or a
+ *	negative errno.
+ */
+int yasp_check_transcript(const char *text, struct yasp_oov **oovs);
+int yasp_check_transcript_file(const char *transcript,
+			       struct yasp_oov **oovs);
+void yasp_free_oovs(struct yasp_oov *oovs, int n);
+
+/*
+ * yasp_context_create
+ * yasp_context_destroy
+ *	A context loads the models once and keeps the decoders around
+ *	for every call made through it. modeldir may be NULL, in which
+ *	case the yasp_set_modeldir() one or the built in default is used.
+ *	A context can be used from several threads at once, each
+ *	concurrent call gets its own decoder.
+ */
+struct yasp_context *yasp_context_create(const char *modeldir);
+void yasp_context_destroy(struct yasp_context *ctx);
+
+/*
+ * yasp_context_create_params
+ * yasp_context_create_profile
+ *	Same as yasp_context_create() but every decoder of the context
+ *	uses params, or the settings spec describes as in
+ *	yasp_parse_decoder_params(). NULL is the default profile.
+ */
+struct yasp_context *
+yasp_context_create_params(const char *modeldir,
+			   const struct yasp_decoder_params *params);
+struct yasp_context *yasp_context_create_profile(const char *modeldir,
+						 const char *spec);
+
+/*
+ * yasp_context_warm
+ *	load decoders up front until the context holds at least
+ *	ndecoders, so the first ndecoders concurrent calls don't pay for
+ *	a model load.
+ */
+int yasp_context_warm(struct yasp_context *ctx, int ndecoders);
+
+/*
+ * yasp_context_interpret
+ * yasp_context_interpret_get_str
+ * yasp_context_interpret_breakdown
+ *	Same as yasp_interpret(), yasp_interpret_get_str() and
+ *	yasp_interpret_breadown() but reuse the context's decoders
+ */
+int yasp_context_interpret(struct yasp_context *ctx,
+			   const char *audioFile, const char *transcript,
+			   const char *output, const char *genpath);
+char *yasp_context_interpret_get_str(struct yasp_context *ctx,
+				     const char *audioFile,
+				     const char *transcript,
+				     const char *genpath);
+int yasp_context_interpret_breakdown(struct yasp_context *ctx,
+				     const char *audioFile,
+				     const char *transcript,
+				     const char *genpath,
+				     struct list_head *word_list,
+				     struct list_head *phoneme_list);
+
+/*
+ * yasp_context_interpret_text_get_str
+ *	Same as yasp_context_interpret_get_str() but takes the transcript
+ *	text itself rather than a path to it. text may be NULL.
+ */
+char *yasp_context_interpret_text_get_str(struct yasp_context *ctx,
+					  const char *audioFile,
+					  const char *text,
+					  const char *genpath);
+
+/*
+ * yasp_context_realign
+ * yasp_context_realign_get_str
+ *	bring a previous alignment of audioFile, in word_list and
+ *	phoneme_list or as json, up to date with the edited transcript
+ *	text. Only the audio between the unchanged words either side of
+ *	the edit is aligned again, the rest of the result is kept. If
+ *	that span can't be aligned the whole clip is. ctx may be NULL to
+ *	use a one-shot decoder.
+ */
+int yasp_context_realign(struct yasp_context *ctx, const char *audioFile,
+			 const char *text, struct list_head *word_list,
+			 struct list_head *phoneme_list);
+char *yasp_context_realign_get_str(struct yasp_context *ctx,
+				   const char *audioFile,
+				   const char *json, const char *text);
+
+/*
+ * yasp_context_interpret_pcm
+ * yasp_context_interpret_pcm_get_str
+ *	interpret nsamples of 16-bit mono PCM held in memory. The buffer
+ *	is decoded in place, it's not copied. samprate must match the
+ *	decoder's (16kHz by default). text is the transcript itself and
+ *	may be NULL, in which case a hypothesis is generated.
+ */
+int yasp_context_interpret_pcm(struct yasp_context *ctx,
+			       const int16 *pcm, size_t nsamples,
+			       int samprate, const char *text,
+			       const char *genpath,
+			       struct list_head *word_list,
+			       struct list_head *phoneme_list);
+char *yasp_context_interpret_pcm_get_str(struct yasp_context *ctx,
+					 const int16 *pcm, size_t nsamples,
+					 int samprate, const char *text,
+					 const char *genpath);
+
+/*
+ * yasp_context_interpret_allphone
+ * yasp_context_interpret_allphone_get_str
+ *	Same as yasp_interpret_allphone() but reuse the context's
+ *	decoders. The JSON has an empty "words" array and the phonemes in
+ *	a top level "phonemes" array.
+ */
+int yasp_context_interpret_allphone(struct yasp_context *ctx,
+				    const char *audioFile,
+				    struct list_head *phoneme_list);
+char *yasp_context_interpret_allphone_get_str(struct yasp_context *ctx,
+					      const char *audioFile);
+
+/*
+ * yasp_context_spot_keywords
+ * yasp_context_spot_keywords_get_str
+ *	Same as yasp_spot_keywords() but reuse the context's decoders.
+ *	The JSON is the one yasp_create_kws_json() gives.
+ */
+int yasp_context_spot_keywords(struct yasp_context *ctx,
+			       const char *audioFile, const char **keywords,
+			       int nkeywords, double threshold,
+			       struct list_head *hit_list);
+char *yasp_context_spot_keywords_get_str(struct yasp_context *ctx,
+					 const char *audioFile,
+					 const char **keywords,
+					 int nkeywords, double threshold);
+
+/*
+ * yasp_context_interpret_ctl
+ *	Same as yasp_context_interpret_get_str() with the decode under
+ *	ctl's control, which may be NULL. The transcript is either the
+ *	path transcript or the text itself. The JSON is returned in json.
+ *	Returns 0, -ECANCELED, -ETIMEDOUT or another negative error.
+ */
+int yasp_context_interpret_ctl(struct yasp_context *ctx,
+			       const char *audioFile, const char *transcript,
+			       const char *text, const char *genpath,
+			       struct yasp_control *ctl, char **json);
+
+/*
+ * yasp_context_batch
+ *	run njobs jobs on nworkers threads. cb, if provided, is called
+ *	from the worker thread as soon as each job finishes. Once a
+ *	job's jb_ctl is cancelled, it fails with -ECANCELED without
+ *	being decoded if it hasn't started yet.
+ *	Returns the number of failed jobs, or a negative errno.
+ */
+int yasp_context_batch(struct yasp_context *ctx, struct yasp_job *jobs,
+		       int njobs, int nworkers, yasp_job_done_f cb,
+		       void *user_data);
+
+/*
+ * yasp_context_batch_fork
+ *	Same as yasp_context_batch() but each job runs in one of nprocs
+ *	worker processes forked off the caller. The workers inherit the
+ *	context's loaded models copy-on-write, so they start without a
+ *	model load and memory stays close to one copy of the models. A
+ *	worker that crashes only fails the job it was running, with
+ *	-ECHILD, and is replaced. cb is called in the caller's process.
+ *	Only the timeout of a job's jb_ctl reaches the workers.
+ *	Don't call it while other threads are using ctx.
+ */
+int yasp_context_batch_fork(struct yasp_context *ctx, struct yasp_job *jobs,
+			    int njobs, int nprocs, yasp_job_done_f cb,
+			    void *user_data);
+
+/*
+ * yasp_context_align_candidates
+ *	align each of ncands alternative transcripts against the one
+ *	clip, to see which matches it best. The audio is read and its
+ *	features computed once, then the candidates are aligned on up to
+ *	nworkers threads. Returns the number of candidates that failed,
+ *	each has its own cd_rc, or a negative error.
+ * yasp_context_align_candidates_get_str
+ *	the same for ntexts transcripts, returned as JSON with each
+ *	candidate's result and score, and the index of the best one
+ */
+int yasp_context_align_candidates(struct yasp_context *ctx,
+				  const char *audioFile,
+				  struct yasp_candidate *cands, int ncands,
+				  int nworkers);
+char *yasp_context_align_candidates_get_str(struct yasp_context *ctx,
+					    const char *audioFile,
+					    const char **texts, int ntexts,
+					    int nworkers);
+
+/*
+ * yasp_context_preview
+ *	a rough alignment of audioFile to show right away. text is the
+ *	transcript itself and is aligned on decoders of the preview
+ *	profile. Without it only phonemes come back, from one phone loop
+ *	pass as in yasp_interpret_allphone(). The JSON is freed with
+ *	yasp_free_json_str().
+ *	If cb is set, the full quality alignment then runs in the
+ *	background on ctx's decoders, searching the features the preview
+ *	computed rather than reading the audio again, and cb gets its
+ *	JSON. *refine is set to the handle to wait on.
+ * yasp_refine_wait
+ *	wait for the refinement, after cb has returned, and free it.
+ *	Returns its result. Every refinement must be waited on before
+ *	ctx is destroyed.
+ */
+char *yasp_context_preview(struct yasp_context *ctx, const char *audioFile,
+			   const char *text, yasp_refine_done_f cb,
+			   void *user_data, struct yasp_refine **refine);
+int yasp_refine_wait(struct yasp_refine *refine);
+
+/*
+ * yasp_index_open
+ * yasp_index_save
+ * yasp_index_close
+ *	An on-disk inverted index of the words, and optionally phoneme
+ *	n-grams, across many clips. yasp_index_open() loads the index at
+ *	path, or starts an empty one if there's none. phone_n is the
+ *	phoneme n-gram length for a new index, 0 for words only. An
+ *	existing index keeps the length it was built with.
+ *	Changes are only written out by yasp_index_save().
+ *	An index isn't thread safe.
+ */
+struct yasp_index *yasp_index_open(const char *path, int phone_n);
+int yasp_index_save(struct yasp_index *idx);
+void yasp_index_close(struct yasp_index *idx);
+
+/*
+ * yasp_index_add
+ * yasp_index_add_json
+ * yasp_index_remove
+ *	add a clip's word and phoneme lists, or the JSON yasp produced
+ *	for it, to the index. clip names it in the results, the audio
+ *	path is a good choice. Adding a clip that's already there
+ *	replaces it. phoneme_list may be NULL.
+ */
+int yasp_index_add(struct yasp_index *idx, const char *clip,
+		   struct list_head *word_list,
+		   struct list_head *phoneme_list);
+int yasp_index_add_json(struct yasp_index *idx, const char *clip,
+			const char *json);
+int yasp_index_remove(struct yasp_index *idx, const char *clip);
+
+/*
+ * yasp_index_find
+ * yasp_index_find_phonemes
+ *	find every occurrence of a word or a phrase, or of a sequence of
+ *	at least phone_n phonemes, across the indexed clips.
+ *	Returns the number of hits and the hits themselves in *hits, to
+ *	be freed with yasp_index_free_hits(), or a negative errno.
+ */
+int yasp_index_find(struct yasp_index *idx, const char *phrase,
+		    struct yasp_index_hit **hits);
+int yasp_index_find_phonemes(struct yasp_index *idx, const char *phonemes,
+			     struct yasp_index_hit **hits);
+void yasp_index_free_hits(struct yasp_index_hit *hits);
+#ifdef __cplusplus
+}
+#endif
+
 #endif /* SPEECH_PARSER_H */
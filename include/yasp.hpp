@@ -0,0 +1,370 @@
+/*
+  Copyright (c) 2019 Amir Shehata
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in
+  all copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+  THE SOFTWARE.
+*/
+
+/*
+ * C++17 wrapper over yasp.h. Header only, link against libyasp.
+ *
+ * Context and Result own the underlying C objects and are move-only.
+ * The word and phoneme lists are exposed as ranges of Segment views
+ * which point straight into the C lists. Nothing is copied, so a view
+ * is only valid while the Result it came from is alive.
+ *
+ *	yasp::Context ctx;
+ *	yasp::Result r = ctx.align("clip.wav", "clip.txt");
+ *	for (const yasp::Segment &w : r.words())
+ *		for (const yasp::Segment &p : r.phonemes_of(w))
+ *			std::cout << w.text() << " " << p.text() << "\n";
+ */
+
+#ifndef SPEECH_PARSER_HPP
+#define SPEECH_PARSER_HPP
+
+#include <cstddef>
+#include <iterator>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <utility>
+
+#include "yasp.h"
+
+namespace yasp {
+
+class Error : public std::runtime_error {
+public:
+	Error(const std::string &what, int rc)
+		: std::runtime_error(what), m_rc(rc) {}
+
+	int rc() const noexcept { return m_rc; }
+
+private:
+	int m_rc;
+};
+
+/* a view over a single word or phoneme record */
+class Segment {
+public:
+	explicit Segment(const struct yasp_word *w) noexcept : m_w(w) {}
+
+	std::string_view text() const noexcept { return m_w->ph_word; }
+	int start() const noexcept { return m_w->ph_start; }
+	int duration() const noexcept { return m_w->ph_duration; }
+	int end() const noexcept { return m_w->ph_start + m_w->ph_duration; }
+	double prob() const noexcept { return m_w->ph_prob; }
+	int32 ascr() const noexcept { return m_w->ph_ascr; }
+	int32 lscr() const noexcept { return m_w->ph_lscr; }
+	int32 lback() const noexcept { return m_w->ph_lback; }
+
+	/* <s>, </s> and <sil> in word lists, SIL in phoneme lists */
+	bool is_silence() const noexcept
+	{
+		std::string_view t = text();
+		return t == "<s>" || t == "</s>" || t == "<sil>" || t == "SIL";
+	}
+
+	const struct yasp_word *raw() const noexcept { return m_w; }
+
+private:
+	const struct yasp_word *m_w;
+};
+
+/*
+ * A [first, last) range of list entries. Iterating walks the list
+ * links in place.
+ */
+class SegmentRange {
+public:
+	class iterator {
+	public:
+		using iterator_category = std::forward_iterator_tag;
+		using value_type = Segment;
+		using difference_type = std::ptrdiff_t;
+		using pointer = void;
+		using reference = Segment;
+
+		iterator() noexcept : m_pos(nullptr) {}
+		explicit iterator(const struct list_head *pos) noexcept
+			: m_pos(pos) {}
+
+		Segment operator*() const noexcept
+		{
+			return Segment(list_entry(m_pos, struct yasp_word,
+						  ph_on_list));
+		}
+
+		iterator &operator++() noexcept
+		{
+			m_pos = m_pos->next;
+			return *this;
+		}
+
+		iterator operator++(int) noexcept
+		{
+			iterator tmp = *this;
+			m_pos = m_pos->next;
+			return tmp;
+		}
+
+		bool operator==(const iterator &o) const noexcept
+		{
+			return m_pos == o.m_pos;
+		}
+
+		bool operator!=(const iterator &o) const noexcept
+		{
+			return m_pos != o.m_pos;
+		}
+
+		const struct list_head *pos() const noexcept { return m_pos; }
+
+	private:
+		const struct list_head *m_pos;
+	};
+
+	/* the whole list hanging off head */
+	explicit SegmentRange(const struct list_head *head) noexcept
+		: m_first(head->next), m_last(head) {}
+
+	SegmentRange(iterator first, iterator last) noexcept
+		: m_first(first), m_last(last) {}
+
+	iterator begin() const noexcept { return m_first; }
+	iterator end() const noexcept { return m_last; }
+	bool empty() const noexcept { return m_first == m_last; }
+
+	/* walks the range */
+	std::size_t size() const noexcept
+	{
+		return std::distance(m_first, m_last);
+	}
+
+private:
+	iterator m_first;
+	iterator m_last;
+};
+
+/* A JSON string owned by libyasp */
+class Json {
+public:
+	explicit Json(char *json) noexcept : m_json(json) {}
+
+	std::string_view str() const noexcept
+	{
+		return m_json ? std::string_view(m_json.get()) :
+				std::string_view();
+	}
+
+	const char *c_str() const noexcept { return m_json.get(); }
+
+private:
+	struct deleter {
+		void operator()(char *json) const noexcept
+		{
+			yasp_free_json_str(json);
+		}
+	};
+
+	std::unique_ptr<char, deleter> m_json;
+};
+
+/* The word and phoneme lists of a single alignment */
+class Result {
+public:
+	Result() : m_lists(new lists) {}
+
+	Result(Result &&) noexcept = default;
+	Result &operator=(Result &&) noexcept = default;
+	Result(const Result &) = delete;
+	Result &operator=(const Result &) = delete;
+
+	SegmentRange words() const noexcept
+	{
+		return SegmentRange(&m_lists->words);
+	}
+
+	SegmentRange phonemes() const noexcept
+	{
+		return SegmentRange(&m_lists->phonemes);
+	}
+
+	/*
+	 * The phonemes timed within word. Walks the phoneme list from
+	 * the start, so prefer iterating words() and phonemes() in step
+	 * when going over the whole result.
+	 */
+	SegmentRange phonemes_of(const Segment &word) const noexcept
+	{
+		SegmentRange all = phonemes();
+		SegmentRange::iterator first = all.begin();
+		SegmentRange::iterator last;
+
+		while (first != all.end() && (*first).end() <= word.start())
+			++first;
+		last = first;
+		while (last != all.end() && (*last).start() < word.end())
+			++last;
+
+		return SegmentRange(first, last);
+	}
+
+	Json json() const
+	{
+		char *json = yasp_create_json(&m_lists->words,
+					      &m_lists->phonemes);
+		if (!json)
+			throw Error("yasp_create_json failed", -1);
+		return Json(json);
+	}
+
+	/* for passing to the C API */
+	struct list_head *word_list() noexcept { return &m_lists->words; }
+	struct list_head *phoneme_list() noexcept
+	{
+		return &m_lists->phonemes;
+	}
+
+private:
+	/*
+	 * The list heads are self referencing, so they live on the heap
+	 * where moving the Result doesn't move them.
+	 */
+	struct lists {
+		struct list_head words;
+		struct list_head phonemes;
+
+		lists() noexcept
+		{
+			INIT_LIST_HEAD(&words);
+			INIT_LIST_HEAD(&phonemes);
+		}
+
+		~lists()
+		{
+			yasp_free_segment_list(&words);
+			yasp_free_segment_list(&phonemes);
+		}
+	};
+
+	std::unique_ptr<lists> m_lists;
+};
+
+/* A yasp_context. Safe to use from several threads at once. */
+class Context {
+public:
+	explicit Context(const char *modeldir = nullptr)
+		: m_ctx(yasp_context_create(modeldir))
+	{
+		if (!m_ctx)
+			throw Error("yasp_context_create failed", -1);
+	}
+
+	Context(const char *modeldir, const struct yasp_decoder_params &params)
+		: m_ctx(yasp_context_create_params(modeldir, &params))
+	{
+		if (!m_ctx)
+			throw Error("yasp_context_create_params failed", -1);
+	}
+
+	Context(Context &&) noexcept = default;
+	Context &operator=(Context &&) noexcept = default;
+	Context(const Context &) = delete;
+	Context &operator=(const Context &) = delete;
+
+	/* transcript is a path and may be null */
+	Result align(const char *audio, const char *transcript = nullptr,
+		     const char *genpath = nullptr)
+	{
+		Result r;
+		int rc;
+
+		rc = yasp_context_interpret_breakdown(m_ctx.get(), audio,
+						      transcript, genpath,
+						      r.word_list(),
+						      r.phoneme_list());
+		if (rc)
+			throw Error(std::string("failed to align ") + audio,
+				    rc);
+		return r;
+	}
+
+	/* text is the transcript itself and may be null */
+	Result align_pcm(const int16 *pcm, std::size_t nsamples,
+			 int samprate = 16000, const char *text = nullptr)
+	{
+		Result r;
+		int rc;
+
+		rc = yasp_context_interpret_pcm(m_ctx.get(), pcm, nsamples,
+						samprate, text, nullptr,
+						r.word_list(),
+						r.phoneme_list());
+		if (rc)
+			throw Error("failed to align PCM buffer", rc);
+		return r;
+	}
+
+	Json align_json(const char *audio, const char *transcript = nullptr,
+			const char *genpath = nullptr)
+	{
+		char *json;
+
+		json = yasp_context_interpret_get_str(m_ctx.get(), audio,
+						      transcript, genpath);
+		if (!json)
+			throw Error(std::string("failed to align ") + audio,
+				    -1);
+		return Json(json);
+	}
+
+	/* the decode can be stopped through ctl, which throws Error */
+	Json align_json(const char *audio, struct yasp_control &ctl,
+			const char *transcript = nullptr,
+			const char *genpath = nullptr)
+	{
+		char *json;
+		int rc;
+
+		rc = yasp_context_interpret_ctl(m_ctx.get(), audio, transcript,
+						nullptr, genpath, &ctl, &json);
+		if (rc)
+			throw Error(std::string("failed to align ") + audio,
+				    rc);
+		return Json(json);
+	}
+
+	struct yasp_context *get() const noexcept { return m_ctx.get(); }
+
+private:
+	struct deleter {
+		void operator()(struct yasp_context *ctx) const noexcept
+		{
+			yasp_context_destroy(ctx);
+		}
+	};
+
+	std::unique_ptr<struct yasp_context, deleter> m_ctx;
+};
+
+} /* namespace yasp */
+
+#endif /* SPEECH_PARSER_HPP */
@@ -20,9 +20,16 @@
   THE SOFTWARE.
 */
 
-#include <getopt.h>
 #include <errno.h>
+#include <limits.h>
 #include <stdbool.h>
+#include <pthread.h>
+#include <time.h>
+#include <unistd.h>
+#include <poll.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
 #include <pocketsphinx.h>
 #include <hash_table.h>
 #include "list.h"
@@ -32,9 +39,74 @@
 #include "strfuncs.h"
 #include "state_align_search.h"
 #include "yasp.h"
+#include "yasp_dict.h"
+#include "yasp_text.h"
 #include "cJSON.h"
 
-char *g_modeldir = NULL;
+static char *g_modeldir = NULL;
+/* dither seed, negative lets the front end pick its own */
+static int g_seed = -1;
+/* align one-shots against the transcript's words only */
+static int g_transcript_dict;
+/* guess the pronunciation of words missing from the dictionary */
+static int g_g2p;
+/* decoder settings of one-shots and of contexts created without any */
+static struct yasp_decoder_params g_params;
+
+/*
+ * Process wide instrumentation. Stages are timed with the monotonic
+ * clock and only a handful of events are recorded per utterance, so a
+ * single lock is cheap enough.
+ */
+static struct yasp_stats g_stats;
+static pthread_mutex_t g_stats_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static const char *stage_names[YASP_STAGE_MAX] = {
+	[YASP_STAGE_MODEL_LOAD] = "model_load",
+	[YASP_STAGE_DECODE] = "decode",
+	[YASP_STAGE_ALIGN] = "align",
+	[YASP_STAGE_PARSE] = "parse",
+	[YASP_STAGE_CONSOLIDATE] = "consolidate",
+	[YASP_STAGE_JSON] = "json",
+};
+
+static double stats_now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void stats_stage(enum yasp_stage stage, double start)
+{
+	double elapsed = stats_now() - start;
+
+	pthread_mutex_lock(&g_stats_lock);
+	g_stats.st_time[stage] += elapsed;
+	g_stats.st_calls[stage]++;
+	pthread_mutex_unlock(&g_stats_lock);
+}
+
+static void stats_frames(ps_decoder_t *ps)
+{
+	int frames = ps_get_n_frames(ps);
+	long frate = cmd_ln_int_r(ps_get_config(ps), "-frate");
+
+	pthread_mutex_lock(&g_stats_lock);
+	g_stats.st_frames += frames;
+	if (frate > 0)
+		g_stats.st_audio_secs += (double) frames / frate;
+	pthread_mutex_unlock(&g_stats_lock);
+}
+
+static void stats_count(unsigned long *counter, unsigned long n)
+{
+	pthread_mutex_lock(&g_stats_lock);
+	*counter += n;
+	pthread_mutex_unlock(&g_stats_lock);
+}
 
 static void redirect_ps_log(err_cb_f cb, struct yasp_logs *logs)
 {
@@ -47,24 +119,106 @@ static void redirect_ps_log(err_cb_f cb, struct yasp_logs *logs)
 	err_set_callback(cb, logs);
 }
 
-static ps_decoder_t *get_ps(void)
+/*
+ * Speed against accuracy. A profile only lists what it changes from
+ * the pocketsphinx defaults, fwdflat and bestpath are -1 to keep them.
+ */
+static const struct decoder_profile {
+	const char *pr_name;
+	struct yasp_decoder_params pr_params;
+	int pr_fwdflat;
+	int pr_bestpath;
+} profiles[YASP_PROFILE_MAX] = {
+	[YASP_PROFILE_DEFAULT] = {
+		.pr_name = "default",
+		.pr_fwdflat = -1,
+		.pr_bestpath = -1,
+	},
+	[YASP_PROFILE_PREVIEW] = {
+		.pr_name = "preview",
+		.pr_params = {
+			.dp_beam = 1e-30,
+			.dp_wbeam = 1e-20,
+			.dp_pbeam = 1e-30,
+			.dp_ds = 2,
+			.dp_topn = 2,
+			.dp_maxhmmpf = 3000,
+		},
+		.pr_fwdflat = 0,
+		.pr_bestpath = 0,
+	},
+	[YASP_PROFILE_PRECISE] = {
+		.pr_name = "precise",
+		.pr_params = {
+			.dp_beam = 1e-80,
+			.dp_wbeam = 1e-60,
+			.dp_pbeam = 1e-80,
+			.dp_topn = 8,
+			.dp_maxhmmpf = -1,
+		},
+		.pr_fwdflat = 1,
+		.pr_bestpath = 1,
+	},
+};
+
+/* only the fields that are set */
+static void set_params(cmd_ln_t *config,
+		       const struct yasp_decoder_params *params)
+{
+	if (params->dp_beam)
+		cmd_ln_set_float_r(config, "-beam", params->dp_beam);
+	if (params->dp_wbeam)
+		cmd_ln_set_float_r(config, "-wbeam", params->dp_wbeam);
+	if (params->dp_pbeam)
+		cmd_ln_set_float_r(config, "-pbeam", params->dp_pbeam);
+	if (params->dp_lw)
+		cmd_ln_set_float_r(config, "-lw", params->dp_lw);
+	if (params->dp_frate)
+		cmd_ln_set_int_r(config, "-frate", params->dp_frate);
+	if (params->dp_ds)
+		cmd_ln_set_int_r(config, "-ds", params->dp_ds);
+	if (params->dp_topn)
+		cmd_ln_set_int_r(config, "-topn", params->dp_topn);
+	if (params->dp_maxhmmpf)
+		cmd_ln_set_int_r(config, "-maxhmmpf", params->dp_maxhmmpf);
+}
+
+static void apply_params(cmd_ln_t *config,
+			 const struct yasp_decoder_params *params)
+{
+	const struct decoder_profile *pr = &profiles[params->dp_profile];
+
+	set_params(config, &pr->pr_params);
+	if (pr->pr_fwdflat >= 0)
+		cmd_ln_set_boolean_r(config, "-fwdflat", pr->pr_fwdflat);
+	if (pr->pr_bestpath >= 0)
+		cmd_ln_set_boolean_r(config, "-bestpath", pr->pr_bestpath);
+
+	/* the caller's overrides win over the profile */
+	set_params(config, params);
+}
+
+/*
+ * full decoders carry the n-gram LM and the whole dictionary. Without
+ * full, the decoder is only good for alignment and its dictionary holds
+ * nothing but the fillers until the caller adds words to it.
+ */
+static ps_decoder_t *init_ps(const char *modeldir,
+			     const struct yasp_decoder_params *params,
+			     bool full)
 {
 	cmd_ln_t *config = NULL;
 	ps_decoder_t *ps = NULL;
 	char *hmm, *lm, *dict;
+	double start;
+
+	if (!modeldir)
+		modeldir = yasp_get_modeldir();
 
 	/* NOTE: the '/' will need to change to support other OSs */
-	if (g_modeldir) {
-		hmm = string_join(g_modeldir, "/en-us/en-us", NULL);
-		lm = string_join(g_modeldir, "/en-us/en-us.lm.bin", NULL);
-		dict = string_join(g_modeldir, "/en-us/cmudict-en-us.dict",
-				   NULL);
-	} else {
-		hmm = string_join(MODELDIR, "/en-us/en-us", NULL);
-		lm = string_join(MODELDIR, "/en-us/en-us.lm.bin", NULL);
-		dict = string_join(MODELDIR, "/en-us/cmudict-en-us.dict",
-				   NULL);
-	}
+	hmm = string_join(modeldir, "/en-us/en-us", NULL);
+	lm = string_join(modeldir, "/en-us/en-us.lm.bin", NULL);
+	dict = string_join(modeldir, "/en-us/cmudict-en-us.dict", NULL);
 
 	if (!hmm || !lm || !dict) {
 		E_ERROR("Failed to allocate ps_decoder_t. No memory\n");
@@ -73,16 +227,11 @@ static ps_decoder_t *get_ps(void)
 
 	config = cmd_ln_init(NULL, ps_args(), TRUE,
 			"-hmm", hmm,
-			"-lm", lm,
-			"-dict", dict,
 			"-dictcase", "yes",
 			"-backtrace", "yes",
 			"-dither", "yes",
 			"-remove_silence", "no",
 			"-cmn", "batch",
-			//"-beam", "le-20",
-			//"-pbeam", "le-20",
-			//"-lw", "2.0",
 			NULL);
 
 	if (!config) {
@@ -90,7 +239,19 @@ static ps_decoder_t *get_ps(void)
 		goto out;
 	}
 
+	if (full) {
+		cmd_ln_set_str_r(config, "-lm", lm);
+		cmd_ln_set_str_r(config, "-dict", dict);
+	}
+
+	apply_params(config, params);
+
+	if (g_seed >= 0)
+		cmd_ln_set_int_r(config, "-seed", g_seed);
+
+	start = stats_now();
 	ps = ps_init(config);
+	stats_stage(YASP_STAGE_MODEL_LOAD, start);
 	if (!ps)
 		E_ERROR("Failed to create recognizer, see log for details\n");
 
@@ -107,10 +268,108 @@ out:
 	return ps;
 }
 
+static ps_decoder_t *get_ps(const char *modeldir,
+			    const struct yasp_decoder_params *params)
+{
+	return init_ps(modeldir, params, true);
+}
+
+/*
+ * A context keeps decoders around between calls so the models are only
+ * loaded once. A decoder can only run one utterance at a time, so
+ * concurrent callers each check one out of the idle pool and hand it
+ * back when they are done. The pool grows to the peak concurrency.
+ */
+struct ps_pool {
+	struct yasp_decoder_params pl_params;
+	bool pl_full;
+	ps_decoder_t **pl_idle;
+	int pl_nidle;
+	int pl_size;
+};
+
+struct yasp_context {
+	char *ctx_modeldir;
+	pthread_mutex_t ctx_lock;
+	struct ps_pool ctx_pool;
+	/* alignment only decoders on the preview profile */
+	struct ps_pool ctx_preview;
+};
+
+static ps_decoder_t *pool_get(struct yasp_context *ctx, struct ps_pool *pool)
+{
+	ps_decoder_t *ps = NULL;
+
+	pthread_mutex_lock(&ctx->ctx_lock);
+	if (pool->pl_nidle > 0)
+		ps = pool->pl_idle[--pool->pl_nidle];
+	pthread_mutex_unlock(&ctx->ctx_lock);
+
+	if (!ps)
+		ps = init_ps(ctx->ctx_modeldir, &pool->pl_params,
+			     pool->pl_full);
+
+	return ps;
+}
+
+static void pool_put(struct yasp_context *ctx, struct ps_pool *pool,
+		     ps_decoder_t *ps)
+{
+	ps_decoder_t **idle;
+
+	pthread_mutex_lock(&ctx->ctx_lock);
+	if (pool->pl_nidle == pool->pl_size) {
+		idle = realloc(pool->pl_idle,
+			       (pool->pl_size + 4) * sizeof(*idle));
+		if (!idle) {
+			pthread_mutex_unlock(&ctx->ctx_lock);
+			ps_free(ps);
+			return;
+		}
+		pool->pl_idle = idle;
+		pool->pl_size += 4;
+	}
+	pool->pl_idle[pool->pl_nidle++] = ps;
+	pthread_mutex_unlock(&ctx->ctx_lock);
+}
+
+static void pool_free(struct ps_pool *pool)
+{
+	int i;
+
+	for (i = 0; i < pool->pl_nidle; i++)
+		ps_free(pool->pl_idle[i]);
+	if (pool->pl_idle)
+		free(pool->pl_idle);
+}
+
+static ps_decoder_t *ctx_get_ps(struct yasp_context *ctx)
+{
+	/* one-shot callers get a fresh decoder */
+	if (!ctx)
+		return get_ps(NULL, &g_params);
+
+	return pool_get(ctx, &ctx->ctx_pool);
+}
+
+static void ctx_put_ps(struct yasp_context *ctx, ps_decoder_t *ps)
+{
+	if (!ps)
+		return;
+
+	if (!ctx) {
+		ps_free(ps);
+		return;
+	}
+
+	pool_put(ctx, &ctx->ctx_pool, ps);
+}
+
 static int parse_segments(ps_decoder_t *ps, struct list_head *seg_list)
 {
 	ps_seg_t *seg;
 	struct yasp_word *word = NULL;
+	unsigned long allocs = 0;
 
 	for (seg = ps_seg_iter(ps); seg; seg = ps_seg_next(seg)) {
 		const char *segment;
@@ -143,8 +402,11 @@ static int parse_segments(ps_decoder_t *ps, struct list_head *seg_list)
 		word->ph_lback = lback;
 
 		list_add_tail(&word->ph_on_list, seg_list);
+		allocs += 2;
 	}
 
+	stats_count(&g_stats.st_allocs, allocs);
+
 	return 0;
 
 fail:
@@ -152,6 +414,9 @@ fail:
 	return -1;
 }
 
+#define YASP_ALLPHONE_SEARCH "yasp_allphone"
+#define YASP_KWS_SEARCH "yasp_kws"
+
 static int set_search_internal(ps_decoder_t *ps, ps_search_t *search)
 {
 	ps_search_t *old_search;
@@ -174,6 +439,7 @@ static int parse_alignment(ps_decoder_t *ps, ps_alignment_t *alignment,
 {
 	ps_alignment_iter_t* it;
 	struct yasp_word *word = NULL;
+	unsigned long allocs = 0;
 	char *ph;
 
 	for (it = ps_alignment_phones(alignment); it;
@@ -198,8 +464,11 @@ static int parse_alignment(ps_decoder_t *ps, ps_alignment_t *alignment,
 		word->ph_lscr = pe->score;
 
 		list_add_tail(&word->ph_on_list, phoneme_list);
+		allocs += 2;
 	}
 
+	stats_count(&g_stats.st_allocs, allocs);
+
 	return 0;
 
 fail:
@@ -207,32 +476,51 @@ fail:
 	return -1;
 }
 
+/*
+ * A word the dictionary doesn't have. Take its pronunciation from the
+ * project's cache, or failing that guess one and remember it there.
+ */
+static s3wid_t add_oov(ps_decoder_t *ps, const char *word)
+{
+	char phones[YASP_DICT_MAX_PRON];
+
+	if (yasp_pron_cache_lookup(word, phones, sizeof(phones))) {
+		if (!g_g2p || yasp_g2p(word, phones, sizeof(phones)))
+			return BAD_S3WID;
+		E_INFO("Guessed pronunciation of %s: %s\n", word, phones);
+		yasp_pron_cache_add(word, phones);
+	}
+
+	if (ps_add_word(ps, word, phones, FALSE) < 0)
+		return BAD_S3WID;
+
+	return dict_wordid(ps->dict, word);
+}
+
 static int set_align(ps_decoder_t *ps, const char *name,
-		     const char *text, ps_alignment_t **alignment)
+		     struct yasp_tokens *ts, ps_alignment_t **alignment)
 {
 	ps_search_t *search;
-	char *textbuf = ckd_salloc(text);
-	char *ptr, *word, delimfound;
-	int n;
+	struct yasp_token *tk;
+	uint32 i;
 
-	textbuf = string_trim(textbuf, STRING_BOTH);
 	*alignment = ps_alignment_init(ps->d2p);
 	ps_alignment_add_word(*alignment, dict_wordid(ps->dict, "<s>"), 0);
-	for (ptr = textbuf;
-		(n = nextword(ptr, " \t\n\r", &word, &delimfound)) >= 0;
-		ptr = word + n, *ptr = delimfound) {
-		int wid;
-		if ((wid = dict_wordid(ps->dict, word)) == BAD_S3WID) {
-			E_ERROR("Unknown word %s\n", word);
-			ckd_free(textbuf);
+	for (i = 0; i < ts->ts_n; i++) {
+		tk = &ts->ts_tokens[i];
+		tk->tk_wid = dict_wordid(ps->dict, tk->tk_word);
+		if (tk->tk_wid == BAD_S3WID)
+			tk->tk_wid = add_oov(ps, tk->tk_word);
+		if (tk->tk_wid == BAD_S3WID) {
+			E_ERROR("Unknown word %s at line %u, column %u\n",
+				tk->tk_word, tk->tk_line, tk->tk_column);
 			return -1;
 		}
-		ps_alignment_add_word(*alignment, wid, 0);
+		ps_alignment_add_word(*alignment, tk->tk_wid, 0);
 	}
 	ps_alignment_add_word(*alignment, dict_wordid(ps->dict, "</s>"), 0);
 	ps_alignment_populate(*alignment);
 	search = state_align_search_init(name, ps->config, ps->acmod, *alignment);
-	ckd_free(textbuf);
 	return set_search_internal(ps, search);
 }
 
@@ -269,671 +557,3207 @@ static void *cache_file(FILE *fh, size_t *size)
 	return buf;
 }
 
-static int interpret(FILE *fh, struct list_head *word_list,
-		     struct list_head *phoneme_list,
-		     FILE *transcript_fh)
+static int add_pron(const char *word, const char *phones, void *user_data)
 {
-	int rc = 0;
-	ps_decoder_t *ps = NULL;
-	char *text = NULL;
-	ps_alignment_t *alignment = NULL;
-
-	ps = get_ps();
-	if (!ps)
-		goto out;
+	ps_add_word(user_data, word, phones, FALSE);
 
-	if (!transcript_fh)
-		goto skip_transcript;
+	return 0;
+}
 
-	text = cache_file(transcript_fh, NULL);
-	if (!text)
-		goto out;
+/* add the transcript's words that ps doesn't know yet to its dictionary */
+static int add_vocab(ps_decoder_t *ps, const char *modeldir,
+		     struct yasp_tokens *ts)
+{
+	struct yasp_dict *dict;
+	const char *word;
+	double start;
+	uint32 i;
+
+	start = stats_now();
+	dict = yasp_dict_get(modeldir);
+	stats_stage(YASP_STAGE_MODEL_LOAD, start);
+	if (!dict)
+		return -1;
 
-	rc = set_align(ps, "align", text, &alignment);
-	if (rc) {
-		E_ERROR("set_align failed\n");
-		goto out;
+	for (i = 0; i < ts->ts_n; i++) {
+		word = ts->ts_tokens[i].tk_word;
+		if (dict_wordid(ps->dict, word) == BAD_S3WID)
+			yasp_dict_lookup(dict, word, add_pron, ps);
 	}
 
-	if (ps_set_search(ps, "align")) {
-		E_ERROR("ps_set_search() failed\n");
-		rc = -1;
-		goto out;
+	return 0;
+}
+
+/*
+ * An alignment decoder whose dictionary holds only the transcript's
+ * words, and no language model. Words that aren't in the dictionary
+ * are left for set_align() to deal with.
+ */
+static ps_decoder_t *get_ps_vocab(const char *modeldir,
+				  struct yasp_tokens *ts)
+{
+	ps_decoder_t *ps;
+
+	ps = init_ps(modeldir, &g_params, false);
+	if (ps && add_vocab(ps, modeldir, ts)) {
+		ps_free(ps);
+		ps = NULL;
 	}
 
-skip_transcript:
-	ps_decode_raw(ps, fh, -1);
+	return ps;
+}
 
-	if ((rc = parse_segments(ps, word_list)))
-		goto out;
+/*
+ * Where the audio comes from. Either a raw/wav file, a buffer of
+ * 16-bit PCM samples owned by the caller, which is decoded in place,
+ * or the cepstra already computed from one, which any decoder of the
+ * same models can search without running the front end again.
+ */
+struct audio_src {
+	FILE *au_fh;
+	const int16 *au_pcm;
+	size_t au_nsamples;
+	mfcc_t **au_cep;
+	int32 au_nframes;
+	struct yasp_control *au_ctl;
+};
+
+/* frames searched between checks of a yasp_control */
+#define YASP_CHUNK_FRAMES	100
+
+static int check_control(struct yasp_control *ctl, double deadline,
+			 int32 frames, int32 total)
+{
+	if (ctl->ct_cancel)
+		return -ECANCELED;
+	if (deadline && stats_now() > deadline)
+		return -ETIMEDOUT;
+	if (ctl->ct_progress &&
+	    ctl->ct_progress(frames, total, ctl->ct_user_data))
+		return -ECANCELED;
 
-	if (!phoneme_list)
-		goto out;
+	return 0;
+}
 
-	rc = parse_alignment(ps, alignment, phoneme_list);
+/*
+ * A private copy of src's cepstra. The feature module normalizes what
+ * it's given in place, and the cepstra may be searched by several
+ * decoders at once.
+ */
+static mfcc_t **dup_cep(ps_decoder_t *ps, struct audio_src *src)
+{
+	int32 ncep = feat_cepsize(ps->acmod->fcb);
+	mfcc_t **cep;
 
-out:
-	if (alignment)
-		ps_alignment_free(alignment);
-	if (ps)
-		ps_free(ps);
-	if (text)
-		free(text);
+	cep = ckd_calloc_2d(src->au_nframes ? src->au_nframes : 1, ncep,
+			    sizeof(mfcc_t));
+	if (src->au_nframes)
+		memcpy(cep[0], src->au_cep[0],
+		       src->au_nframes * ncep * sizeof(mfcc_t));
 
-	return rc;
+	return cep;
 }
 
-static FILE *write_hypothesis_2_file(struct list_head *words,
-				     const char *gen_path)
+/*
+ * The cepstra of the whole clip, normalized over all of it as a
+ * whole utterance decode would. The feature module only does batch
+ * CMN and max AGC when it sees the utterance in one go, so they are
+ * applied here instead, and the search is then fed a chunk at a time
+ * with them turned off.
+ */
+static int chunk_cep(ps_decoder_t *ps, struct audio_src *src,
+		     mfcc_t ***cep, int32 *nframes)
 {
-	FILE *fh;
-	const char *fname;
-	struct yasp_word *word;
+	feat_t *fcb = ps->acmod->fcb;
+	const int16 *pcm = src->au_pcm;
+	size_t nsamples = src->au_nsamples;
+	int16 *buf = NULL;
+	int rc;
 
-	if (gen_path)
-		fname = gen_path;
-	else
-		fname = "generated_hypothesis";
+	*cep = NULL;
 
-	fh = fopen(fname, "w");
+	if (src->au_cep) {
+		/* shared with other decoders, normalize a copy */
+		*nframes = src->au_nframes;
+		*cep = dup_cep(ps, src);
+	} else {
+		if (src->au_fh) {
+			/* all of it is samples, as ps_decode_raw() reads it */
+			buf = cache_file(src->au_fh, &nsamples);
+			if (!buf)
+				return -1;
+			nsamples /= sizeof(*buf);
+			pcm = buf;
+		}
 
-	list_for_each_entry(word, words, ph_on_list) {
-		if (!strcmp(word->ph_word, "<s>") ||
-		    !strcmp(word->ph_word, "</s>") ||
-		    !strcmp(word->ph_word, "<sil>"))
-			continue;
-		fprintf(fh, "%s ", word->ph_word);
+		fe_start_utt(ps_get_fe(ps));
+		rc = fe_process_utt(ps_get_fe(ps), pcm, nsamples, cep,
+				    nframes);
+		free(buf);
+		if (rc < 0) {
+			E_ERROR("Failed to compute features\n");
+			if (*cep)
+				ckd_free_2d(*cep);
+			*cep = NULL;
+			return -1;
+		}
 	}
 
-	fclose(fh);
-
-	fh = fopen(fname, "r");
+	if (*nframes > 0 && fcb->cmn == CMN_BATCH)
+		cmn(fcb->cmn_struct, *cep, fcb->varnorm, *nframes);
+	if (*nframes > 0 && fcb->agc == AGC_MAX)
+		agc_max(fcb->agc_struct, *cep, *nframes);
 
-	return fh;
+	return 0;
 }
 
-static int get_utterance(FILE *fh, FILE *transcript_fh,
-			 struct list_head *word_list,
-			 struct list_head *phoneme_list,
-			 const char *gen_path)
+/*
+ * Search the clip a chunk at a time, checking the control in between.
+ * The features are computed and normalized up front, so the result is
+ * the same as that of a decode without a control.
+ */
+static int decode_chunked(ps_decoder_t *ps, struct audio_src *src)
 {
+	struct yasp_control *ctl = src->au_ctl;
+	feat_t *fcb = ps->acmod->fcb;
+	cmn_type_t cmn_type = fcb->cmn;
+	agc_type_t agc_type = fcb->agc;
+	double deadline = 0;
+	int32 pos = 0, len;
+	int32 total;
+	mfcc_t **cep;
 	int rc;
-	struct list_head local_hypothesis;
-	FILE *local_fh = transcript_fh;
 
-	INIT_LIST_HEAD(&local_hypothesis);
+	if (ctl->ct_timeout > 0)
+		deadline = stats_now() + ctl->ct_timeout;
+
+	rc = chunk_cep(ps, src, &cep, &total);
+	if (rc)
+		return rc;
 
 	/*
-	 * if there is no transcript provided, we'll create our own by
-	 * getting a hypothesis, writing it into a file and then using
-	 * that to get the phonemes
+	 * a partial utterance would also switch the feature module to
+	 * live CMN for good, leaving the pooled decoder changed
 	 */
-	if (!transcript_fh) {
-		rc = interpret(fh, &local_hypothesis, NULL, NULL);
+	if (cmn_type == CMN_BATCH)
+		fcb->cmn = CMN_NONE;
+	if (agc_type == AGC_MAX)
+		fcb->agc = AGC_NONE;
+
+	ps_start_stream(ps);
+	if (ps_start_utt(ps)) {
+		E_ERROR("ps_start_utt() failed\n");
+		rc = -1;
+		goto out;
+	}
+
+	for (;;) {
+		rc = check_control(ctl, deadline, pos, total);
 		if (rc)
-			return rc;
-		local_fh
-		  = write_hypothesis_2_file(&local_hypothesis, gen_path);
-		yasp_free_segment_list(&local_hypothesis);
-		if (!local_fh)
-			return rc;
+			break;
+
+		len = total - pos;
+		if (len > YASP_CHUNK_FRAMES)
+			len = YASP_CHUNK_FRAMES;
+		if (!len)
+			break;
+		if (ps_process_cep(ps, cep + pos, len, FALSE, FALSE) < 0) {
+			E_ERROR("ps_process_cep() failed\n");
+			rc = -1;
+			break;
+		}
+		pos += len;
 	}
 
-	fseek(fh, 0, SEEK_SET);
-	rc = interpret(fh, word_list, phoneme_list, local_fh);
+	if (rc) {
+		if (rc == -ECANCELED || rc == -ETIMEDOUT)
+			E_INFO("Decode stopped after %d of %d frames: %s\n",
+			       pos, total, strerror(-rc));
+		ps_end_utt(ps);
+		goto out;
+	}
+
+	rc = ps_end_utt(ps);
 
-	if (!local_fh)
-		fclose(local_fh);
+out:
+	fcb->cmn = cmn_type;
+	fcb->agc = agc_type;
+	ckd_free_2d(cep);
 
 	return rc;
 }
 
-int yasp_set_modeldir(const char *modeldir)
+static int decode_audio(ps_decoder_t *ps, struct audio_src *src)
 {
-	char *m = NULL;
+	mfcc_t **cep = NULL;
+	int rc;
 
-	if (modeldir) {
-		m = calloc(1, strlen(modeldir) + 1);
-		if (!m) {
-			E_ERROR("out of memory\n");
-			return -ENOMEM;
+	if (src->au_ctl)
+		return decode_chunked(ps, src);
+
+	if (src->au_fh) {
+		fseek(src->au_fh, 0, SEEK_SET);
+		if (ps_decode_raw(ps, src->au_fh, -1) < 0) {
+			E_ERROR("ps_decode_raw() failed\n");
+			return -1;
 		}
-		strncpy(m, modeldir, strlen(modeldir));
+		return 0;
+	}
 
-		if (g_modeldir)
-			free(g_modeldir);
-		g_modeldir = m;
+	/*
+	 * segment frames count from the start of the stream. Start a new
+	 * one, as ps_decode_raw() does, or a pooled decoder's times would
+	 * be shifted by every utterance it decoded before.
+	 */
+	ps_start_stream(ps);
+	if (ps_start_utt(ps)) {
+		E_ERROR("ps_start_utt() failed\n");
+		return -1;
 	}
 
-	return 0;
-}
+	if (src->au_cep) {
+		cep = dup_cep(ps, src);
+		rc = ps_process_cep(ps, cep, src->au_nframes, FALSE, TRUE);
+	} else {
+		rc = ps_process_raw(ps, src->au_pcm, src->au_nsamples,
+				    FALSE, TRUE);
+	}
+	if (rc < 0) {
+		E_ERROR("%s() failed\n",
+			src->au_cep ? "ps_process_cep" : "ps_process_raw");
+		ps_end_utt(ps);
+		rc = -1;
+		goto out;
+	}
 
-void yasp_free_segment_list(struct list_head *seg_list)
-{
-	struct yasp_word *word = NULL;
-	struct yasp_word *tmp;
+	rc = ps_end_utt(ps);
 
-	if (!seg_list)
-		return;
+out:
+	if (cep)
+		ckd_free_2d(cep);
 
-	/* free any allocated memory */
-	list_for_each_entry_safe(word, tmp, seg_list, ph_on_list) {
-		list_del(&word->ph_on_list);
-		if (word->ph_word)
-			free(word->ph_word);
-		free(word);
-	}
+	return rc;
 }
 
-void yasp_print_segment_list(struct list_head *seg_list)
+static int interpret(ps_decoder_t *ps, struct audio_src *src,
+		     struct list_head *word_list,
+		     struct list_head *phoneme_list,
+		     struct yasp_tokens *ts)
 {
-	struct yasp_word *word;
-
-	if (!seg_list)
-		return;
+	int rc = 0;
+	ps_alignment_t *alignment = NULL;
+	double start = stats_now();
 
-	E_INFO("XXXXXXXXXXXXXXXXXXXXXX\n");
-	E_INFO("%s %s %s %s %s %s %s %s\n",
-		"word", "start", "end", "pprob", "ascr", "lscr",
-		"lback", "duration");
+	if (!ts) {
+		/* the decoder may have been left on a previous alignment */
+		if (ps_set_search(ps, PS_DEFAULT_SEARCH)) {
+			E_ERROR("ps_set_search() failed\n");
+			return -1;
+		}
+		goto skip_transcript;
+	}
 
-	list_for_each_entry(word, seg_list, ph_on_list) {
-		E_INFO("%s %d %d %f %d %d %d %d\n",
-			word->ph_word, word->ph_start, word->ph_end,
-			word->ph_prob, word->ph_lscr, word->ph_ascr,
-			word->ph_lback, word->ph_duration);
+	rc = set_align(ps, "align", ts, &alignment);
+	if (rc) {
+		E_ERROR("set_align failed\n");
+		goto out;
 	}
-	E_INFO("XXXXXXXXXXXXXXXXXXXXXX\n\n\n");
 
-}
+	if (ps_set_search(ps, "align")) {
+		E_ERROR("ps_set_search() failed\n");
+		rc = -1;
+		goto out;
+	}
 
-void yasp_pprint_segment_list(struct list_head *seg_list)
-{
-	struct yasp_word *word;
-
-	if (!seg_list)
-		return;
+skip_transcript:
+	rc = decode_audio(ps, src);
+	stats_stage(ts ? YASP_STAGE_ALIGN : YASP_STAGE_DECODE, start);
+	if (rc)
+		goto out;
+	stats_frames(ps);
 
-	E_INFO("XXXXXXXXXXXXXXXXXXXXXX\n");
-	E_INFO("%-20s %-5s %-5s %-5s %-10s %-10s %-3s\n",
-		"word", "start", "end", "pprob", "ascr", "lscr",
-		"lback");
+	start = stats_now();
+	rc = parse_segments(ps, word_list);
+	if (!rc && phoneme_list)
+		rc = parse_alignment(ps, alignment, phoneme_list);
+	stats_stage(YASP_STAGE_PARSE, start);
 
-	list_for_each_entry(word, seg_list, ph_on_list) {
-		E_INFO("%-20s %-5d %-5d %-1.3f %-10d %-10d %-3d\n",
-			word->ph_word, word->ph_start, word->ph_end,
-			word->ph_prob, word->ph_lscr, word->ph_ascr,
-			word->ph_lback);
-	}
-	E_INFO("XXXXXXXXXXXXXXXXXXXXXX\n\n\n");
+out:
+	if (alignment)
+		ps_alignment_free(alignment);
 
+	return rc;
 }
 
-
-int set_transcript_word(struct list_head *transcript, char * word)
+/*
+ * Phone loop search, built the first time a decoder needs it and kept
+ * with the decoder's other searches.
+ */
+static int set_allphone(ps_decoder_t *ps)
 {
-	struct yasp_word *hyp_word = NULL;
-
-	/* end of word */
-	hyp_word = calloc(1, sizeof(*hyp_word));
-	if (!hyp_word)
-		return -ENOMEM;
-
-	hyp_word->ph_word = word;
-	list_add(&hyp_word->ph_on_list, transcript);
-
-	return 0;
-}
+	void *search;
+	const char *hmm;
+	char *lm;
+	int rc;
 
-int yasp_parse_transcript(struct list_head *transcript, FILE *fh)
-{
-	char *word = NULL;
-	int ccount = 0;
-	int rc = 0;
+	if (!hash_table_lookup(ps->searches, YASP_ALLPHONE_SEARCH, &search))
+		return ps_set_search(ps, YASP_ALLPHONE_SEARCH);
 
-	/* read the transcript and breakdown into words */
 	/*
-	 * read a byte at a time, and check to see if the byte is a ' ',
-	 * if it is, then it's the end of the word.
+	 * the phonetic LM ships alongside the acoustic model, as
+	 * en-us/en-us-phone.lm.bin next to en-us/en-us
 	 */
-	word = calloc(1, sizeof(*word) * 1024);
-	if (!word)
-		goto failed;
-	while (!feof(fh)) {
-		size_t nread;
-		char c;
-		nread = fread(&c, 1, 1, fh);
-		if (nread != 1)
-			goto failed;
-		if (c != ' ' && ccount < 1023) {
-			word[ccount] = c;
-			ccount++;
-		} else if (ccount > 0 && ccount < 1023) {
-			rc = set_transcript_word(transcript, word);
-			if (rc)
-				goto failed;
-
-			/* allocate new word */
-			word = calloc(1, sizeof(*word) * 1024);
-			if (!word)
-				goto failed;
-			ccount = 0;
-		} else if (ccount >= 1023) {
-			/* word is too large */
-			E_ERROR("Word is too large in "
-				"transcript\n");
-			goto failed;
-		}
-		/* skip white spaces */
+	hmm = cmd_ln_str_r(ps_get_config(ps), "-hmm");
+	lm = string_join(hmm, "-phone.lm.bin", NULL);
+	if (!lm) {
+		E_ERROR("out of memory\n");
+		return -ENOMEM;
 	}
-	/* deal with the last word before eof */
-	if (ccount > 0 && ccount < 1024) {
-		rc = set_transcript_word(transcript, word);
-		if (rc)
-			goto failed;
+
+	if (access(lm, R_OK)) {
+		E_WARN("No phonetic LM at %s, any phone may follow any "
+		       "other\n", lm);
+		ckd_free(lm);
+		lm = NULL;
 	}
 
-	return 0;
+	rc = ps_set_allphone_file(ps, YASP_ALLPHONE_SEARCH, lm);
+	if (lm)
+		ckd_free(lm);
+	if (rc) {
+		E_ERROR("ps_set_allphone_file() failed\n");
+		return -1;
+	}
 
-failed:
-	E_ERROR("Failed due to: %s\n", strerror(errno));
-	if (word)
-		free(word);
-	return -1;
+	return ps_set_search(ps, YASP_ALLPHONE_SEARCH);
 }
 
 /*
- * the assumption here is that word_list and phoneme list are generated
- * via the same transcript (whether user provided or auto-generated), so
- * they should match exactly
- *
- * Phoneme list will have relative start time within the utterance and
- * the correct duration for each phoneme. This function will correct the
- * time by adding the offset
+ * One pass over the audio with the phone loop. The segments are phones
+ * rather than words, so they go straight onto the phoneme list.
  */
-static int consolidate_utterance(struct list_head *word_list,
-				 struct list_head *phoneme_list)
+static int interpret_allphone(ps_decoder_t *ps, struct audio_src *src,
+			      struct list_head *phoneme_list)
 {
-	struct yasp_word *word;
 	struct yasp_word *phoneme;
-	int offset = -1;
+	double start = stats_now();
+	int rc;
 
-	if (!word_list || !phoneme_list)
+	if (set_allphone(ps)) {
+		E_ERROR("Failed to set up the allphone search\n");
 		return -1;
-
-	list_for_each_entry(word, word_list, ph_on_list) {
-		if (!strcmp(word->ph_word, "<s>"))
-			offset = word->ph_start;
 	}
 
-	if (offset == -1)
-		return -1;
+	rc = decode_audio(ps, src);
+	stats_stage(YASP_STAGE_DECODE, start);
+	if (rc)
+		return rc;
+	stats_frames(ps);
+
+	start = stats_now();
+	rc = parse_segments(ps, phoneme_list);
+	stats_stage(YASP_STAGE_PARSE, start);
+	if (rc)
+		return rc;
 
+	/* segment end frames are inclusive, match parse_alignment() */
 	list_for_each_entry(phoneme, phoneme_list, ph_on_list)
-		phoneme->ph_start += offset;
+		phoneme->ph_duration = phoneme->ph_end - phoneme->ph_start + 1;
 
 	return 0;
 }
 
-static int
-consolidate(const char *audioFile, const char *transcript,
-	    struct list_head *word_list,
-	    struct list_head *phoneme_list,
-	    const char *genpath)
+/*
+ * pocketsphinx only takes a list of keyphrases as a file, one phrase
+ * per line with an optional /threshold/. Write one out for the search
+ * and drop it once the search has read it.
+ */
+static int set_kws(ps_decoder_t *ps, const char **keywords, int nkeywords,
+		   double threshold)
 {
+	char path[] = "/tmp/yasp_kws_XXXXXX";
 	FILE *fh;
-	FILE *transcript_fh = NULL;
-	int rc;
+	int fd, i, rc;
 
-	if (!word_list || !phoneme_list) {
-		E_ERROR("bad parameter\n");
-		return -1;
+	fd = mkstemp(path);
+	if (fd < 0) {
+		E_ERROR("unable to create keyword file. errno = %s\n",
+			strerror(errno));
+		return -errno;
 	}
 
-	/* Open audio File */
-	fh = fopen(audioFile, "rb");
+	fh = fdopen(fd, "w");
 	if (!fh) {
-		E_ERROR("unable to open audio file %s. errno = %s\n",
-			audioFile, strerror(errno));
-		return -1;
+		close(fd);
+		unlink(path);
+		return -ENOMEM;
 	}
 
-	if (transcript) {
-		/* consolidate hypothesis with transcript */
-		transcript_fh = fopen(transcript, "r");
-		if (!transcript_fh) {
-			E_ERROR("unable to open transcript %s. errno = %s\n",
-				transcript, strerror(errno));
-			return -1;
-		}
+	for (i = 0; i < nkeywords; i++) {
+		if (threshold > 0 && !strchr(keywords[i], '/'))
+			fprintf(fh, "%s /%g/\n", keywords[i], threshold);
+		else
+			fprintf(fh, "%s\n", keywords[i]);
 	}
 
-	/* Get the phonemes */
-	rc = get_utterance(fh, transcript_fh, word_list, phoneme_list,
-			   genpath);
+	rc = fclose(fh) ? -EIO : 0;
+	if (!rc && ps_set_kws(ps, YASP_KWS_SEARCH, path)) {
+		E_ERROR("ps_set_kws() failed, are all the keywords in the "
+			"dictionary?\n");
+		rc = -EINVAL;
+	}
+	unlink(path);
 
-	if (!rc) {
-		rc = consolidate_utterance(word_list, phoneme_list);
-		if (rc)
-			E_ERROR("Timing incompatibility between word and "
-				"phoneme lists. Result maybe unreliable\n");
+	if (!rc && ps_set_search(ps, YASP_KWS_SEARCH)) {
+		E_ERROR("ps_set_search() failed\n");
+		rc = -1;
 	}
 
-	/* close files */
-	fclose(fh);
-	if (transcript)
-		fclose(transcript_fh);
+	return rc;
+}
+
+/*
+ * One pass of the keyword spotter. Each detection is a segment named
+ * after its keyphrase, with its confidence in ph_prob.
+ */
+static int interpret_kws(ps_decoder_t *ps, struct audio_src *src,
+			 const char **keywords, int nkeywords,
+			 double threshold, struct list_head *hit_list)
+{
+	double start = stats_now();
+	int rc;
+
+	rc = set_kws(ps, keywords, nkeywords, threshold);
+	if (rc)
+		return rc;
+
+	rc = decode_audio(ps, src);
+	stats_stage(YASP_STAGE_DECODE, start);
+	if (rc)
+		return rc;
+	stats_frames(ps);
+
+	start = stats_now();
+	rc = parse_segments(ps, hit_list);
+	stats_stage(YASP_STAGE_PARSE, start);
 
 	return rc;
 }
 
 /*
- * {
- *   "words": [
- *       {
- *           "word": "blah",
- *           "start": 1280,
- *           "duration": 720,
- *           "phonemes": [
- *                {
- *                     "phoneme": "EH",
- *                     "start": 23,
- *                     "duration": 2,
- *                },
- *           ],
- *       },
- *       {
- *           "word": "blah2",
- *           "start": 1280,
- *           "duration": 720,
- *           "phonemes": [
- *                {
- *                     "phoneme": "EH",
- *                     "start": 23,
- *                     "duration": 2,
- *                },
- *           ],
- *       },
- *   ],
- * }
+ * Flatten the hypothesis into a space separated transcript, skipping
+ * the sentence markers and silences.
  */
-char *yasp_create_json(struct list_head *word_list,
-		       struct list_head *phoneme_list)
+static char *hypothesis_2_text(struct list_head *words)
 {
 	struct yasp_word *word;
-	struct yasp_word *phoneme;
-	struct list_head *cur;
-	int next_time;
-	char *string = NULL;
-	cJSON *jroot, *jword, *jwords;
-	cJSON *jphoneme, *jphonemes;
+	size_t len = 1;
+	char *text;
 
-	if (!word_list || !phoneme_list) {
-		E_ERROR("bad parameter list\n");
+	list_for_each_entry(word, words, ph_on_list)
+		len += strlen(word->ph_word) + 1;
+
+	text = calloc(1, len);
+	if (!text) {
+		E_ERROR("out of memory\n");
 		return NULL;
 	}
 
-	jroot = cJSON_CreateObject();
-	if (!jroot)
-		goto end;
-
-	jwords = cJSON_AddArrayToObject(jroot, "words");
-	if (!jwords)
-		goto end;
-
-	cur = phoneme_list;
-	list_for_each_entry(word, word_list, ph_on_list) {
+	list_for_each_entry(word, words, ph_on_list) {
 		if (!strcmp(word->ph_word, "<s>") ||
 		    !strcmp(word->ph_word, "</s>") ||
 		    !strcmp(word->ph_word, "<sil>"))
 			continue;
+		strcat(text, word->ph_word);
+		strcat(text, " ");
+	}
 
-		jword = cJSON_CreateObject();
-		if (!cJSON_AddStringToObject(jword, "word", word->ph_word))
-			goto end;
-		if (!cJSON_AddNumberToObject(jword, "start",
-					     word->ph_start))
-			goto end;
-		if (!cJSON_AddNumberToObject(jword, "duration",
-					     word->ph_duration))
-			goto end;
-		jphonemes = cJSON_AddArrayToObject(jword,
-						  "phonemes");
-		if (!jphonemes)
-			goto end;
+	return text;
+}
 
-		list_for_each_entry(phoneme, cur, ph_on_list) {
-			next_time =
-			  phoneme->ph_start + phoneme->ph_duration + 1;
-			if (!strcmp(phoneme->ph_word, "SIL"))
-				goto skip_phoneme;
+/*
+ * The generated hypothesis is only written out for the user's benefit.
+ * The alignment pass works off the in-memory copy, so concurrent
+ * callers sharing the default path can't trip over each other.
+ */
+static void write_hypothesis_2_file(const char *text, const char *gen_path)
+{
+	FILE *fh;
+	const char *fname;
 
-			jphoneme = cJSON_CreateObject();
-			if (!cJSON_AddStringToObject(jphoneme, "phoneme",
-						     phoneme->ph_word))
-				goto end;
-			if (!cJSON_AddNumberToObject(jphoneme, "start",
-						     phoneme->ph_start))
-				goto end;
-			if (!cJSON_AddNumberToObject(jphoneme, "duration",
-						     phoneme->ph_duration))
-				goto end;
-			cJSON_AddItemToArray(jphonemes, jphoneme);
+	if (gen_path)
+		fname = gen_path;
+	else
+		fname = "generated_hypothesis";
+
+	fh = fopen(fname, "w");
+	if (!fh) {
+		E_ERROR("unable to write hypothesis %s. errno = %s\n",
+			fname, strerror(errno));
+		return;
+	}
+
+	fprintf(fh, "%s", text);
+	fclose(fh);
+}
+
+static int get_utterance(ps_decoder_t *ps, struct audio_src *src,
+			 struct yasp_tokens *ts,
+			 struct list_head *word_list,
+			 struct list_head *phoneme_list,
+			 const char *gen_path)
+{
+	int rc;
+	struct list_head local_hypothesis;
+	struct yasp_tokens local_ts;
+	char *local_text = NULL;
+
+	INIT_LIST_HEAD(&local_hypothesis);
+
+	/*
+	 * if there is no transcript provided, we'll create our own by
+	 * getting a hypothesis and then using that to get the phonemes
+	 */
+	if (!ts) {
+		rc = interpret(ps, src, &local_hypothesis, NULL, NULL);
+		if (rc)
+			return rc;
+		local_text = hypothesis_2_text(&local_hypothesis);
+		yasp_free_segment_list(&local_hypothesis);
+		if (!local_text)
+			return -ENOMEM;
+		write_hypothesis_2_file(local_text, gen_path);
+		rc = yasp_tokenize(local_text, strlen(local_text), &local_ts);
+		free(local_text);
+		if (rc)
+			return rc;
+		ts = &local_ts;
+	}
+
+	rc = interpret(ps, src, word_list, phoneme_list, ts);
+
+	if (ts == &local_ts)
+		yasp_tokens_free(&local_ts);
+
+	return rc;
+}
+
+int yasp_set_modeldir(const char *modeldir)
+{
+	char *m = NULL;
+
+	if (modeldir) {
+		m = calloc(1, strlen(modeldir) + 1);
+		if (!m) {
+			E_ERROR("out of memory\n");
+			return -ENOMEM;
+		}
+		strncpy(m, modeldir, strlen(modeldir));
+
+		if (g_modeldir)
+			free(g_modeldir);
+		g_modeldir = m;
+	}
+
+	return 0;
+}
+
+const char *yasp_get_modeldir(void)
+{
+	return g_modeldir ? g_modeldir : MODELDIR;
+}
+
+void yasp_set_seed(int seed)
+{
+	g_seed = seed;
+}
+
+void yasp_set_transcript_dict(int enable)
+{
+	g_transcript_dict = enable;
+}
+
+void yasp_set_g2p(int enable)
+{
+	g_g2p = enable;
+}
+
+int yasp_set_decoder_params(const struct yasp_decoder_params *params)
+{
+	if (!params) {
+		memset(&g_params, 0, sizeof(g_params));
+		return 0;
+	}
+
+	if ((unsigned) params->dp_profile >= YASP_PROFILE_MAX) {
+		E_ERROR("bad parameter\n");
+		return -EINVAL;
+	}
+	g_params = *params;
+
+	return 0;
+}
+
+static int parse_param(struct yasp_decoder_params *params, const char *key,
+		       const char *val)
+{
+	char *end;
+	double d;
+	int i;
+
+	if (!strcmp(key, "profile")) {
+		for (i = 0; i < YASP_PROFILE_MAX; i++) {
+			if (!strcmp(val, profiles[i].pr_name)) {
+				params->dp_profile = i;
+				return 0;
+			}
+		}
+		E_ERROR("Unknown decoder profile %s\n", val);
+		return -EINVAL;
+	}
+
+	d = strtod(val, &end);
+	if (end == val || *end) {
+		E_ERROR("Bad value for %s: %s\n", key, val);
+		return -EINVAL;
+	}
+
+	if (!strcmp(key, "beam"))
+		params->dp_beam = d;
+	else if (!strcmp(key, "wbeam"))
+		params->dp_wbeam = d;
+	else if (!strcmp(key, "pbeam"))
+		params->dp_pbeam = d;
+	else if (!strcmp(key, "lw"))
+		params->dp_lw = d;
+	else if (!strcmp(key, "frate"))
+		params->dp_frate = (int) d;
+	else if (!strcmp(key, "ds"))
+		params->dp_ds = (int) d;
+	else if (!strcmp(key, "topn"))
+		params->dp_topn = (int) d;
+	else if (!strcmp(key, "maxhmmpf"))
+		params->dp_maxhmmpf = (int) d;
+	else {
+		E_ERROR("Unknown decoder setting %s\n", key);
+		return -EINVAL;
+	}
+
+	return 0;
+}
+
+int yasp_parse_decoder_params(const char *spec,
+			      struct yasp_decoder_params *params)
+{
+	char *buf, *cur, *item, *val;
+	int rc = 0;
+
+	if (!spec || !params) {
+		E_ERROR("bad parameter\n");
+		return -EINVAL;
+	}
+
+	buf = strdup(spec);
+	if (!buf) {
+		E_ERROR("out of memory\n");
+		return -ENOMEM;
+	}
+
+	cur = buf;
+	while (!rc && (item = strsep(&cur, ","))) {
+		if (!item[0])
+			continue;
+		val = strchr(item, '=');
+		if (val)
+			*val++ = '\0';
+		/* a bare name is a profile */
+		rc = val ? parse_param(params, item, val) :
+			   parse_param(params, "profile", item);
+	}
+
+	free(buf);
+
+	return rc;
+}
+
+void yasp_free_segment_list(struct list_head *seg_list)
+{
+	struct yasp_word *word = NULL;
+	struct yasp_word *tmp;
+
+	if (!seg_list)
+		return;
+
+	/* free any allocated memory */
+	list_for_each_entry_safe(word, tmp, seg_list, ph_on_list) {
+		list_del(&word->ph_on_list);
+		if (word->ph_word)
+			free(word->ph_word);
+		free(word);
+	}
+}
+
+void yasp_print_segment_list(struct list_head *seg_list)
+{
+	struct yasp_word *word;
+
+	if (!seg_list)
+		return;
+
+	E_INFO("XXXXXXXXXXXXXXXXXXXXXX\n");
+	E_INFO("%s %s %s %s %s %s %s %s\n",
+		"word", "start", "end", "pprob", "ascr", "lscr",
+		"lback", "duration");
+
+	list_for_each_entry(word, seg_list, ph_on_list) {
+		E_INFO("%s %d %d %f %d %d %d %d\n",
+			word->ph_word, word->ph_start, word->ph_end,
+			word->ph_prob, word->ph_lscr, word->ph_ascr,
+			word->ph_lback, word->ph_duration);
+	}
+	E_INFO("XXXXXXXXXXXXXXXXXXXXXX\n\n\n");
+
+}
+
+void yasp_pprint_segment_list(struct list_head *seg_list)
+{
+	struct yasp_word *word;
+
+	if (!seg_list)
+		return;
+
+	E_INFO("XXXXXXXXXXXXXXXXXXXXXX\n");
+	E_INFO("%-20s %-5s %-5s %-5s %-10s %-10s %-3s\n",
+		"word", "start", "end", "pprob", "ascr", "lscr",
+		"lback");
+
+	list_for_each_entry(word, seg_list, ph_on_list) {
+		E_INFO("%-20s %-5d %-5d %-1.3f %-10d %-10d %-3d\n",
+			word->ph_word, word->ph_start, word->ph_end,
+			word->ph_prob, word->ph_lscr, word->ph_ascr,
+			word->ph_lback);
+	}
+	E_INFO("XXXXXXXXXXXXXXXXXXXXXX\n\n\n");
+
+}
+
+
+int yasp_parse_transcript(struct list_head *transcript, FILE *fh)
+{
+	struct yasp_word *word;
+	struct yasp_tokens ts;
+	size_t size;
+	char *text;
+	uint32 i;
+	int rc;
+
+	text = cache_file(fh, &size);
+	if (!text)
+		return -1;
+
+	rc = yasp_tokenize(text, size, &ts);
+	free(text);
+	if (rc)
+		return rc;
+
+	for (i = 0; i < ts.ts_n; i++) {
+		word = calloc(1, sizeof(*word));
+		if (word)
+			word->ph_word = strdup(ts.ts_tokens[i].tk_word);
+		if (!word || !word->ph_word) {
+			E_ERROR("out of memory\n");
+			free(word);
+			rc = -ENOMEM;
+			break;
+		}
+		list_add_tail(&word->ph_on_list, transcript);
+	}
+
+	yasp_tokens_free(&ts);
+
+	return rc;
+}
+
+/*
+ * the assumption here is that word_list and phoneme list are generated
+ * via the same transcript (whether user provided or auto-generated), so
+ * they should match exactly
+ *
+ * Phoneme list will have relative start time within the utterance and
+ * the correct duration for each phoneme. This function will correct the
+ * time by adding the offset
+ */
+static int consolidate_utterance(struct list_head *word_list,
+				 struct list_head *phoneme_list)
+{
+	struct yasp_word *word;
+	struct yasp_word *phoneme;
+	int offset = -1;
+
+	if (!word_list || !phoneme_list)
+		return -1;
+
+	list_for_each_entry(word, word_list, ph_on_list) {
+		if (!strcmp(word->ph_word, "<s>"))
+			offset = word->ph_start;
+	}
+
+	if (offset == -1)
+		return -1;
+
+	list_for_each_entry(phoneme, phoneme_list, ph_on_list)
+		phoneme->ph_start += offset;
+
+	return 0;
+}
+
+static ps_decoder_t *get_align_ps(struct yasp_context *ctx,
+				  struct yasp_tokens *ts)
+{
+	/* contexts keep full decoders around, so only one-shots qualify */
+	if (!ctx && ts && g_transcript_dict)
+		return get_ps_vocab(NULL, ts);
+
+	return ctx_get_ps(ctx);
+}
+
+static int
+consolidate_src(struct yasp_context *ctx, struct audio_src *src,
+		const char *text, struct list_head *word_list,
+		struct list_head *phoneme_list, const char *genpath)
+{
+	struct yasp_tokens ts;
+	ps_decoder_t *ps;
+	int rc;
+
+	if (text && yasp_tokenize(text, strlen(text), &ts))
+		return -ENOMEM;
+
+	ps = get_align_ps(ctx, text ? &ts : NULL);
+	if (!ps) {
+		if (text)
+			yasp_tokens_free(&ts);
+		return -1;
+	}
+
+	/* Get the phonemes */
+	rc = get_utterance(ps, src, text ? &ts : NULL, word_list,
+			   phoneme_list, genpath);
+	ctx_put_ps(ctx, ps);
+	if (text)
+		yasp_tokens_free(&ts);
+
+	if (!rc) {
+		double start = stats_now();
+
+		rc = consolidate_utterance(word_list, phoneme_list);
+		stats_stage(YASP_STAGE_CONSOLIDATE, start);
+		if (rc)
+			E_ERROR("Timing incompatibility between word and "
+				"phoneme lists. Result maybe unreliable\n");
+	}
+
+	return rc;
+}
+
+/*
+ * transcript is a path to the transcript file, text is the transcript
+ * itself. At most one of them should be given.
+ */
+static int
+consolidate(struct yasp_context *ctx,
+	    const char *audioFile, const char *transcript,
+	    const char *text, struct list_head *word_list,
+	    struct list_head *phoneme_list,
+	    const char *genpath, struct yasp_control *ctl)
+{
+	struct audio_src src = { .au_ctl = ctl };
+	FILE *transcript_fh = NULL;
+	char *file_text = NULL;
+	int rc;
+
+	if (!word_list || !phoneme_list || !audioFile) {
+		E_ERROR("bad parameter\n");
+		return -1;
+	}
+
+	/* Open audio File */
+	src.au_fh = fopen(audioFile, "rb");
+	if (!src.au_fh) {
+		E_ERROR("unable to open audio file %s. errno = %s\n",
+			audioFile, strerror(errno));
+		return -1;
+	}
+
+	if (transcript && !text) {
+		/* consolidate hypothesis with transcript */
+		transcript_fh = fopen(transcript, "r");
+		if (!transcript_fh) {
+			E_ERROR("unable to open transcript %s. errno = %s\n",
+				transcript, strerror(errno));
+			fclose(src.au_fh);
+			return -1;
+		}
+		file_text = cache_file(transcript_fh, NULL);
+		fclose(transcript_fh);
+		if (!file_text) {
+			fclose(src.au_fh);
+			return -1;
+		}
+		text = file_text;
+	}
+
+	rc = consolidate_src(ctx, &src, text, word_list, phoneme_list,
+			     genpath);
+
+	/* close files */
+	fclose(src.au_fh);
+	if (file_text)
+		free(file_text);
+
+	return rc;
+}
+
+static bool is_marker(const char *word)
+{
+	return !strcmp(word, "<s>") || !strcmp(word, "</s>") ||
+	       !strcmp(word, "<sil>");
+}
+
+/*
+ * A word of a previous result may name an alternate pronunciation,
+ * "read(2)", the transcript's never does.
+ */
+static bool same_word(const char *prev, const char *word)
+{
+	size_t len = strlen(word);
+
+	return !strncmp(prev, word, len) && (!prev[len] || prev[len] == '(');
+}
+
+/*
+ * Replace the segments of list that start within [t0, t1] with those
+ * of span that start within [lo, hi]. span is emptied.
+ */
+static void splice_segments(struct list_head *list, struct list_head *span,
+			    int t0, int t1, int lo, int hi)
+{
+	struct yasp_word *seg, *tmp;
+	struct list_head *pos = list;
+
+	list_for_each_entry_safe(seg, tmp, list, ph_on_list) {
+		if (seg->ph_start < t0)
+			continue;
+		if (seg->ph_start > t1) {
+			pos = &seg->ph_on_list;
+			break;
+		}
+		list_del(&seg->ph_on_list);
+		free(seg->ph_word);
+		free(seg);
+	}
+
+	list_for_each_entry_safe(seg, tmp, span, ph_on_list) {
+		list_del(&seg->ph_on_list);
+		if (seg->ph_start < lo || seg->ph_start > hi) {
+			free(seg->ph_word);
+			free(seg);
+			continue;
+		}
+		list_add_tail(&seg->ph_on_list, pos);
+	}
+}
+
+/*
+ * Align again only the words between the last unchanged one before
+ * the edit and the first unchanged one after it. The two anchors are
+ * aligned with them so the edges of the edit can move, everything
+ * else keeps its timing. Several edits collapse into the one span that
+ * covers them all. word_list and phoneme_list are only touched once
+ * the span has been aligned.
+ */
+static int realign(struct yasp_context *ctx, const char *audioFile,
+		   struct yasp_tokens *ts, struct list_head *word_list,
+		   struct list_head *phoneme_list)
+{
+	struct list_head span_words, span_phonemes;
+	struct audio_src src = { 0 };
+	struct yasp_word **prev = NULL, *word;
+	struct yasp_tokens span = { 0 };
+	uint32 nprev = 0, npre = 0, nsuf = 0, first, last;
+	size_t size, nsamples, s0, s1;
+	int t0, t1, lo, hi, spf;
+	int16 *pcm = NULL;
+	ps_decoder_t *ps;
+	FILE *fh;
+	int rc = -1;
+
+	INIT_LIST_HEAD(&span_words);
+	INIT_LIST_HEAD(&span_phonemes);
+
+	list_for_each_entry(word, word_list, ph_on_list) {
+		if (!is_marker(word->ph_word))
+			nprev++;
+	}
+	if (!nprev || !ts->ts_n)
+		return -1;
+
+	prev = calloc(nprev, sizeof(*prev));
+	if (!prev) {
+		E_ERROR("out of memory\n");
+		return -ENOMEM;
+	}
+	nprev = 0;
+	list_for_each_entry(word, word_list, ph_on_list) {
+		if (!is_marker(word->ph_word))
+			prev[nprev++] = word;
+	}
+
+	while (npre < nprev && npre < ts->ts_n &&
+	       same_word(prev[npre]->ph_word, ts->ts_tokens[npre].tk_word))
+		npre++;
+	while (nsuf < nprev - npre && nsuf < ts->ts_n - npre &&
+	       same_word(prev[nprev - nsuf - 1]->ph_word,
+			 ts->ts_tokens[ts->ts_n - nsuf - 1].tk_word))
+		nsuf++;
+
+	if (npre == nprev && npre == ts->ts_n) {
+		E_INFO("Transcript of %s is unchanged\n", audioFile);
+		rc = 0;
+		goto out;
+	}
+
+	/* the span in frames, open ended at either end of the clip */
+	t0 = npre ? prev[npre - 1]->ph_start : 0;
+	t1 = nsuf ? prev[nprev - nsuf]->ph_end : INT_MAX;
+
+	first = npre ? npre - 1 : 0;
+	last = nsuf ? ts->ts_n - nsuf : ts->ts_n - 1;
+	span.ts_tokens = ts->ts_tokens + first;
+	span.ts_n = last - first + 1;
+
+	fh = fopen(audioFile, "rb");
+	if (!fh) {
+		E_ERROR("unable to open audio file %s. errno = %s\n",
+			audioFile, strerror(errno));
+		goto out;
+	}
+	/* ps_decode_raw() reads the whole file as samples, so do we */
+	pcm = cache_file(fh, &size);
+	fclose(fh);
+	if (!pcm)
+		goto out;
+	nsamples = size / sizeof(*pcm);
+
+	ps = get_align_ps(ctx, &span);
+	if (!ps)
+		goto out;
+
+	spf = (int) cmd_ln_float_r(ps_get_config(ps), "-samprate") /
+	      cmd_ln_int_r(ps_get_config(ps), "-frate");
+	s0 = (size_t) t0 * spf;
+	s1 = t1 == INT_MAX ? nsamples : (size_t) (t1 + 1) * spf;
+	if (s1 > nsamples)
+		s1 = nsamples;
+	if (s0 >= s1) {
+		E_ERROR("%s is shorter than its previous alignment\n",
+			audioFile);
+		ctx_put_ps(ctx, ps);
+		goto out;
+	}
+
+	E_INFO("Re-aligning words %u to %u of %u, frames %d to %d\n",
+	       first, last, ts->ts_n, t0, t1 == INT_MAX ? -1 : t1);
+
+	src.au_pcm = pcm + s0;
+	src.au_nsamples = s1 - s0;
+	rc = get_utterance(ps, &src, &span, &span_words, &span_phonemes,
+			   NULL);
+	ctx_put_ps(ctx, ps);
+	if (!rc)
+		rc = consolidate_utterance(&span_words, &span_phonemes);
+	if (rc)
+		goto out;
+
+	/*
+	 * back to clip time. Only keep the sentence markers at the ends
+	 * of the clip, inside it the anchors are the span's edges.
+	 */
+	lo = npre ? INT_MAX : INT_MIN;
+	hi = nsuf ? INT_MIN : INT_MAX;
+	list_for_each_entry(word, &span_words, ph_on_list) {
+		word->ph_start += t0;
+		word->ph_end += t0;
+		if (is_marker(word->ph_word))
+			continue;
+		if (npre && word->ph_start < lo)
+			lo = word->ph_start;
+		if (nsuf && word->ph_end > hi)
+			hi = word->ph_end;
+	}
+	list_for_each_entry(word, &span_phonemes, ph_on_list)
+		word->ph_start += t0;
+
+	splice_segments(word_list, &span_words, t0, t1, lo, hi);
+	splice_segments(phoneme_list, &span_phonemes, t0, t1, lo, hi);
+
+out:
+	yasp_free_segment_list(&span_words);
+	yasp_free_segment_list(&span_phonemes);
+	free(pcm);
+	free(prev);
+
+	return rc;
+}
+
+/*
+ * {
+ *   "words": [
+ *       {
+ *           "word": "blah",
+ *           "start": 1280,
+ *           "duration": 720,
+ *           "phonemes": [
+ *                {
+ *                     "phoneme": "EH",
+ *                     "start": 23,
+ *                     "duration": 2,
+ *                },
+ *           ],
+ *       },
+ *       {
+ *           "word": "blah2",
+ *           "start": 1280,
+ *           "duration": 720,
+ *           "phonemes": [
+ *                {
+ *                     "phoneme": "EH",
+ *                     "start": 23,
+ *                     "duration": 2,
+ *                },
+ *           ],
+ *       },
+ *   ],
+ * }
+ *
+ * A phoneme list with no words, as the allphone search produces, is
+ * written as a top level "phonemes" array next to an empty "words".
+ */
+char *yasp_create_json(struct list_head *word_list,
+		       struct list_head *phoneme_list)
+{
+	struct yasp_word *word;
+	struct yasp_word *phoneme;
+	struct list_head *cur;
+	int next_time;
+	char *string = NULL;
+	double start = stats_now();
+	cJSON *jroot, *jword, *jwords;
+	cJSON *jphoneme, *jphonemes;
+
+	if (!word_list || !phoneme_list) {
+		E_ERROR("bad parameter list\n");
+		return NULL;
+	}
+
+	jroot = cJSON_CreateObject();
+	if (!jroot)
+		goto end;
+
+	jwords = cJSON_AddArrayToObject(jroot, "words");
+	if (!jwords)
+		goto end;
+
+	cur = phoneme_list;
+	list_for_each_entry(word, word_list, ph_on_list) {
+		if (!strcmp(word->ph_word, "<s>") ||
+		    !strcmp(word->ph_word, "</s>") ||
+		    !strcmp(word->ph_word, "<sil>"))
+			continue;
+
+		jword = cJSON_CreateObject();
+		if (!cJSON_AddStringToObject(jword, "word", word->ph_word))
+			goto end;
+		if (!cJSON_AddNumberToObject(jword, "start",
+					     word->ph_start))
+			goto end;
+		if (!cJSON_AddNumberToObject(jword, "duration",
+					     word->ph_duration))
+			goto end;
+		jphonemes = cJSON_AddArrayToObject(jword,
+						  "phonemes");
+		if (!jphonemes)
+			goto end;
+
+		list_for_each_entry(phoneme, cur, ph_on_list) {
+			next_time =
+			  phoneme->ph_start + phoneme->ph_duration + 1;
+			if (!strcmp(phoneme->ph_word, "SIL"))
+				goto skip_phoneme;
+
+			jphoneme = cJSON_CreateObject();
+			if (!cJSON_AddStringToObject(jphoneme, "phoneme",
+						     phoneme->ph_word))
+				goto end;
+			if (!cJSON_AddNumberToObject(jphoneme, "start",
+						     phoneme->ph_start))
+				goto end;
+			if (!cJSON_AddNumberToObject(jphoneme, "duration",
+						     phoneme->ph_duration))
+				goto end;
+			cJSON_AddItemToArray(jphonemes, jphoneme);
+
+skip_phoneme:
+			if (next_time > word->ph_end) {
+				/* start the next word */
+				cur = &phoneme->ph_on_list;
+				break;
+			}
+		}
+
+		cJSON_AddItemToArray(jwords, jword);
+	}
+
+	if (!list_empty(word_list) || list_empty(phoneme_list))
+		goto print;
+
+	jphonemes = cJSON_AddArrayToObject(jroot, "phonemes");
+	if (!jphonemes)
+		goto end;
+
+	list_for_each_entry(phoneme, phoneme_list, ph_on_list) {
+		if (!strcmp(phoneme->ph_word, "SIL"))
+			continue;
+
+		jphoneme = cJSON_CreateObject();
+		if (!jphoneme)
+			goto end;
+		cJSON_AddItemToArray(jphonemes, jphoneme);
+		if (!cJSON_AddStringToObject(jphoneme, "phoneme",
+					     phoneme->ph_word))
+			goto end;
+		if (!cJSON_AddNumberToObject(jphoneme, "start",
+					     phoneme->ph_start))
+			goto end;
+		if (!cJSON_AddNumberToObject(jphoneme, "duration",
+					     phoneme->ph_duration))
+			goto end;
+	}
+
+print:
+	string = cJSON_Print(jroot);
+	if (!string) {
+		E_ERROR("Failed to print json file\n");
+		goto end;
+	}
+
+	stats_count(&g_stats.st_output_bytes, strlen(string));
+
+end:
+	cJSON_Delete(jroot);
+	stats_stage(YASP_STAGE_JSON, start);
+	return string;
+}
+
+int yasp_create_json_file(struct list_head *word_list,
+			  struct list_head *phoneme_list,
+			  const char *output)
+{
+	FILE *json_fh;
+	char *json_str;
+	int rc = 0;
+
+	json_str = yasp_create_json(word_list, phoneme_list);
+	if (!json_str) {
+		rc = -EINVAL;
+		goto end;
+	}
+
+	json_fh = fopen(output, "w");
+	if (!json_fh) {
+		E_ERROR("Failed to open output: %s\n", output);
+		rc = -errno;
+		goto end;
+	}
+
+	fprintf(json_fh, "%s", json_str);
+	fclose(json_fh);
+
+end:
+	if (json_str)
+		free(json_str);
+	return rc;
+}
+
+static struct yasp_word *json_segment(cJSON *jseg, const char *name,
+				      struct list_head *list)
+{
+	cJSON *jname, *jstart, *jduration, *jconf;
+	struct yasp_word *seg;
+
+	jname = cJSON_GetObjectItemCaseSensitive(jseg, name);
+	jstart = cJSON_GetObjectItemCaseSensitive(jseg, "start");
+	jduration = cJSON_GetObjectItemCaseSensitive(jseg, "duration");
+	jconf = cJSON_GetObjectItemCaseSensitive(jseg, "confidence");
+	if (!cJSON_IsString(jname) || !cJSON_IsNumber(jstart) ||
+	    !cJSON_IsNumber(jduration))
+		return NULL;
+
+	seg = calloc(1, sizeof(*seg));
+	if (!seg)
+		return NULL;
+	seg->ph_word = strdup(jname->valuestring);
+	if (!seg->ph_word) {
+		free(seg);
+		return NULL;
+	}
+
+	seg->ph_start = jstart->valueint;
+	seg->ph_duration = jduration->valueint;
+	seg->ph_end = seg->ph_start + seg->ph_duration;
+	/* the alignment doesn't score words, they're all certain */
+	seg->ph_prob = cJSON_IsNumber(jconf) ? jconf->valuedouble : 1;
+	list_add_tail(&seg->ph_on_list, list);
+
+	return seg;
+}
+
+int yasp_parse_json(const char *json, struct list_head *word_list,
+		    struct list_head *phoneme_list)
+{
+	cJSON *jroot, *jword, *jphoneme;
+	int rc = -EINVAL;
+
+	if (!json || !word_list || !phoneme_list) {
+		E_ERROR("bad parameter\n");
+		return -EINVAL;
+	}
+
+	jroot = cJSON_Parse(json);
+	if (!jroot)
+		return -EINVAL;
+
+	cJSON_ArrayForEach(jword,
+			   cJSON_GetObjectItemCaseSensitive(jroot, "words")) {
+		if (!json_segment(jword, "word", word_list))
+			goto out;
+		cJSON_ArrayForEach(jphoneme,
+				   cJSON_GetObjectItemCaseSensitive(jword,
+								    "phonemes")) {
+			if (!json_segment(jphoneme, "phoneme", phoneme_list))
+				goto out;
+		}
+	}
+
+	/* allphone results only have phonemes */
+	cJSON_ArrayForEach(jphoneme,
+			   cJSON_GetObjectItemCaseSensitive(jroot,
+							    "phonemes")) {
+		if (!json_segment(jphoneme, "phoneme", phoneme_list))
+			goto out;
+	}
+
+	rc = 0;
+
+out:
+	cJSON_Delete(jroot);
+	if (rc) {
+		yasp_free_segment_list(word_list);
+		yasp_free_segment_list(phoneme_list);
+	}
+
+	return rc;
+}
+
+/*
+ * {
+ *   "hits": [
+ *       {
+ *           "keyword": "blah",
+ *           "start": 1280,
+ *           "duration": 72,
+ *           "confidence": 0.83,
+ *       },
+ *   ],
+ * }
+ */
+char *yasp_create_kws_json(struct list_head *hit_list)
+{
+	struct yasp_word *hit;
+	char *string = NULL;
+	double start = stats_now();
+	cJSON *jroot, *jhits, *jhit;
+
+	if (!hit_list) {
+		E_ERROR("bad parameter list\n");
+		return NULL;
+	}
+
+	jroot = cJSON_CreateObject();
+	if (!jroot)
+		goto end;
+
+	jhits = cJSON_AddArrayToObject(jroot, "hits");
+	if (!jhits)
+		goto end;
+
+	list_for_each_entry(hit, hit_list, ph_on_list) {
+		jhit = cJSON_CreateObject();
+		if (!jhit)
+			goto end;
+		cJSON_AddItemToArray(jhits, jhit);
+		if (!cJSON_AddStringToObject(jhit, "keyword", hit->ph_word))
+			goto end;
+		if (!cJSON_AddNumberToObject(jhit, "start", hit->ph_start))
+			goto end;
+		if (!cJSON_AddNumberToObject(jhit, "duration",
+					     hit->ph_duration))
+			goto end;
+		if (!cJSON_AddNumberToObject(jhit, "confidence",
+					     hit->ph_prob))
+			goto end;
+	}
+
+	string = cJSON_Print(jroot);
+	if (!string) {
+		E_ERROR("Failed to print json file\n");
+		goto end;
+	}
+
+	stats_count(&g_stats.st_output_bytes, strlen(string));
+
+end:
+	cJSON_Delete(jroot);
+	stats_stage(YASP_STAGE_JSON, start);
+	return string;
+}
+
+int yasp_interpret_hypothesis(const char *faudio, const char *ftranscript,
+			      const char *genpath,
+			      struct list_head *word_list)
+{
+	struct list_head phoneme_list;
+	int rc;
+
+	INIT_LIST_HEAD(&phoneme_list);
+
+	if (!word_list) {
+		E_ERROR("bad parameter\n");
+		return -EINVAL;
+	}
+
+	/*
+	 * Parse audio file
+	 */
+	rc = consolidate(NULL, faudio, ftranscript, NULL, word_list,
+			 &phoneme_list, genpath, NULL);
+	if (rc)
+		E_ERROR("Failed to parse speech clip %s\n",
+			faudio);
+
+	yasp_free_segment_list(&phoneme_list);
+
+	return rc;
+}
+
+int yasp_decode_hypothesis(const char *faudio, const char *genpath,
+			   struct list_head *word_list)
+{
+	struct audio_src src = { 0 };
+	ps_decoder_t *ps;
+	char *text;
+	int rc;
+
+	if (!faudio || !word_list) {
+		E_ERROR("bad parameter\n");
+		return -EINVAL;
+	}
+
+	src.au_fh = fopen(faudio, "rb");
+	if (!src.au_fh) {
+		E_ERROR("unable to open audio file %s. errno = %s\n",
+			faudio, strerror(errno));
+		return -1;
+	}
+
+	ps = ctx_get_ps(NULL);
+	if (!ps) {
+		fclose(src.au_fh);
+		return -1;
+	}
+
+	rc = interpret(ps, &src, word_list, NULL, NULL);
+	ctx_put_ps(NULL, ps);
+	fclose(src.au_fh);
+
+	if (rc) {
+		E_ERROR("Failed to parse speech clip %s\n", faudio);
+		return rc;
+	}
+
+	if (genpath) {
+		text = hypothesis_2_text(word_list);
+		if (text) {
+			write_hypothesis_2_file(text, genpath);
+			free(text);
+		}
+	}
+
+	return 0;
+}
+
+int yasp_interpret_phonemes(const char *faudio, const char *ftranscript,
+			    const char *genpath,
+			    struct list_head *phoneme_list)
+{
+	struct list_head word_list;
+	int rc;
+
+	INIT_LIST_HEAD(&word_list);
+
+	if (!phoneme_list) {
+		E_ERROR("bad parameter\n");
+		return -EINVAL;
+	}
+
+	/*
+	 * Parse audio file
+	 */
+	rc = consolidate(NULL, faudio, ftranscript, NULL, &word_list,
+			 phoneme_list, genpath, NULL);
+	if (rc)
+		E_ERROR("Failed to parse speech clip %s\n",
+			faudio);
+
+	yasp_free_segment_list(&word_list);
+
+	return rc;
+}
+
+static int allphone_file(struct yasp_context *ctx, const char *audioFile,
+			 struct list_head *phoneme_list)
+{
+	struct audio_src src = { 0 };
+	ps_decoder_t *ps;
+	int rc;
+
+	if (!audioFile || !phoneme_list) {
+		E_ERROR("bad parameter\n");
+		return -EINVAL;
+	}
+
+	src.au_fh = fopen(audioFile, "rb");
+	if (!src.au_fh) {
+		E_ERROR("unable to open audio file %s. errno = %s\n",
+			audioFile, strerror(errno));
+		return -1;
+	}
+
+	ps = ctx_get_ps(ctx);
+	if (!ps) {
+		fclose(src.au_fh);
+		return -1;
+	}
+
+	rc = interpret_allphone(ps, &src, phoneme_list);
+	ctx_put_ps(ctx, ps);
+	fclose(src.au_fh);
+
+	if (rc)
+		E_ERROR("Failed to parse speech clip %s\n", audioFile);
+
+	return rc;
+}
+
+int yasp_interpret_allphone(const char *audioFile,
+			    struct list_head *phoneme_list)
+{
+	return allphone_file(NULL, audioFile, phoneme_list);
+}
+
+static int kws_file(struct yasp_context *ctx, const char *audioFile,
+		    const char **keywords, int nkeywords, double threshold,
+		    struct list_head *hit_list)
+{
+	struct audio_src src = { 0 };
+	ps_decoder_t *ps;
+	int rc;
+
+	if (!audioFile || !keywords || nkeywords <= 0 || !hit_list) {
+		E_ERROR("bad parameter\n");
+		return -EINVAL;
+	}
+
+	src.au_fh = fopen(audioFile, "rb");
+	if (!src.au_fh) {
+		E_ERROR("unable to open audio file %s. errno = %s\n",
+			audioFile, strerror(errno));
+		return -1;
+	}
+
+	ps = ctx_get_ps(ctx);
+	if (!ps) {
+		fclose(src.au_fh);
+		return -1;
+	}
+
+	rc = interpret_kws(ps, &src, keywords, nkeywords, threshold,
+			   hit_list);
+	ctx_put_ps(ctx, ps);
+	fclose(src.au_fh);
+
+	if (rc)
+		E_ERROR("Failed to spot keywords in %s\n", audioFile);
+
+	return rc;
+}
+
+int yasp_spot_keywords(const char *audioFile, const char **keywords,
+		       int nkeywords, double threshold,
+		       struct list_head *hit_list)
+{
+	return kws_file(NULL, audioFile, keywords, nkeywords, threshold,
+			hit_list);
+}
+
+/*
+ * The audio comes either from audioFile or, when it's NULL, from src.
+ * The transcript comes either from the transcript file or from text.
+ */
+static int
+yasp_interpret_helper(struct yasp_context *ctx,
+		      const char *audioFile, struct audio_src *src,
+		      const char *transcript, const char *text,
+		      const char *output, const char *genpath,
+		      char **json, bool write, struct yasp_control *ctl)
+{
+	int rc;
+	struct list_head word_list;
+	struct list_head phoneme_list;
+
+	INIT_LIST_HEAD(&word_list);
+	INIT_LIST_HEAD(&phoneme_list);
+
+	/*
+	 * Parse audio file
+	 */
+	if (audioFile) {
+		rc = consolidate(ctx, audioFile, transcript, text, &word_list,
+				 &phoneme_list, genpath, ctl);
+	} else if (src) {
+		if (ctl)
+			src->au_ctl = ctl;
+		rc = consolidate_src(ctx, src, text, &word_list,
+				     &phoneme_list, genpath);
+	} else {
+		rc = -EINVAL;
+	}
+	if (rc) {
+		E_ERROR("Failed to parse speech clip %s\n",
+			audioFile ? audioFile : "<pcm>");
+		goto out;
+	}
+
+	if (write) {
+		if (!output)
+			goto out;
+
+		rc = yasp_create_json_file(&word_list, &phoneme_list,
+					   output);
+		if (rc) {
+			E_ERROR("Failed to create json file: %s\n",
+				output);
+			goto out;
+		}
+	} else {
+		if (!json) {
+			rc = -EINVAL;
+			goto out;
+		}
+		*json = yasp_create_json(&word_list, &phoneme_list);
+	}
+
+out:
+
+	yasp_print_segment_list(&word_list);
+	yasp_print_segment_list(&phoneme_list);
+
+	yasp_free_segment_list(&word_list);
+	yasp_free_segment_list(&phoneme_list);
+
+	return rc;
+}
+
+void yasp_free_json_str(char *json)
+{
+	if (json)
+		free(json);
+}
+
+char *
+yasp_interpret_get_str(const char *audioFile,
+		       const char *transcript,
+		       const char *genpath)
+{
+	int rc;
+	char *json = NULL;
+
+	rc = yasp_interpret_helper(NULL, audioFile, NULL, transcript, NULL,
+				   NULL, genpath, &json, false, NULL);
+
+	if (rc)
+		return NULL;
+
+	return json;
+}
+
+int
+yasp_interpret(const char *audioFile, const char *transcript,
+	       const char *output, const char *genpath)
+{
+	return yasp_interpret_helper(NULL, audioFile, NULL, transcript, NULL,
+				     output, genpath, NULL, true, NULL);
+}
+
+int yasp_interpret_breadown(const char *audioFile, const char *transcript,
+			    const char *output, const char *genpath,
+			    struct list_head *word_list,
+			    struct list_head *phoneme_list)
+{
+	int rc;
+
+	if (!word_list || !phoneme_list) {
+		E_ERROR("bad arguments\n");
+		return -1;
+	}
+
+	/*
+	 * Parse audio file
+	 */
+	rc = consolidate(NULL, audioFile, transcript, NULL, word_list,
+			 phoneme_list, genpath, NULL);
+	if (rc)
+		E_ERROR("Failed to parse speech clip %s\n",
+			audioFile);
+
+	return rc;
+}
+
+struct yasp_context *yasp_context_create(const char *modeldir)
+{
+	return yasp_context_create_params(modeldir, &g_params);
+}
+
+struct yasp_context *yasp_context_create_profile(const char *modeldir,
+						 const char *spec)
+{
+	struct yasp_decoder_params params = { 0 };
+
+	if (spec && yasp_parse_decoder_params(spec, &params))
+		return NULL;
+
+	return yasp_context_create_params(modeldir, &params);
+}
+
+struct yasp_context *
+yasp_context_create_params(const char *modeldir,
+			   const struct yasp_decoder_params *params)
+{
+	struct yasp_context *ctx;
+	ps_decoder_t *ps;
+
+	if (params && (unsigned) params->dp_profile >= YASP_PROFILE_MAX) {
+		E_ERROR("bad parameter\n");
+		return NULL;
+	}
+
+	ctx = calloc(1, sizeof(*ctx));
+	if (!ctx) {
+		E_ERROR("out of memory\n");
+		return NULL;
+	}
+
+	if (params)
+		ctx->ctx_pool.pl_params = *params;
+	ctx->ctx_pool.pl_full = true;
+	/* the preview shares the features, so keeps the frame rate */
+	ctx->ctx_preview.pl_params.dp_profile = YASP_PROFILE_PREVIEW;
+	ctx->ctx_preview.pl_params.dp_frate =
+		ctx->ctx_pool.pl_params.dp_frate;
+
+	if (modeldir) {
+		ctx->ctx_modeldir = strdup(modeldir);
+		if (!ctx->ctx_modeldir) {
+			E_ERROR("out of memory\n");
+			free(ctx);
+			return NULL;
+		}
+	}
+
+	pthread_mutex_init(&ctx->ctx_lock, NULL);
+
+	/* load the models up front so the first job doesn't pay for it */
+	ps = ctx_get_ps(ctx);
+	if (!ps) {
+		yasp_context_destroy(ctx);
+		return NULL;
+	}
+	ctx_put_ps(ctx, ps);
+
+	return ctx;
+}
+
+void yasp_context_destroy(struct yasp_context *ctx)
+{
+	if (!ctx)
+		return;
+
+	pool_free(&ctx->ctx_pool);
+	pool_free(&ctx->ctx_preview);
+
+	pthread_mutex_destroy(&ctx->ctx_lock);
+	if (ctx->ctx_modeldir)
+		free(ctx->ctx_modeldir);
+	free(ctx);
+}
+
+int yasp_context_warm(struct yasp_context *ctx, int ndecoders)
+{
+	ps_decoder_t **ps;
+	int i, n, rc = 0;
+
+	if (!ctx || ndecoders <= 0) {
+		E_ERROR("bad parameter\n");
+		return -EINVAL;
+	}
+
+	ps = calloc(ndecoders, sizeof(*ps));
+	if (!ps) {
+		E_ERROR("out of memory\n");
+		return -ENOMEM;
+	}
+
+	/*
+	 * holding them all at once forces the pool to grow to ndecoders,
+	 * idle ones are reused rather than loaded again
+	 */
+	for (n = 0; n < ndecoders; n++) {
+		ps[n] = ctx_get_ps(ctx);
+		if (!ps[n]) {
+			rc = -1;
+			break;
+		}
+	}
+
+	for (i = 0; i < n; i++)
+		ctx_put_ps(ctx, ps[i]);
+	free(ps);
+
+	return rc;
+}
+
+int yasp_context_interpret(struct yasp_context *ctx,
+			   const char *audioFile, const char *transcript,
+			   const char *output, const char *genpath)
+{
+	if (!ctx) {
+		E_ERROR("bad parameter\n");
+		return -EINVAL;
+	}
+
+	return yasp_interpret_helper(ctx, audioFile, NULL, transcript, NULL,
+				     output, genpath, NULL, true, NULL);
+}
+
+char *yasp_context_interpret_get_str(struct yasp_context *ctx,
+				     const char *audioFile,
+				     const char *transcript,
+				     const char *genpath)
+{
+	char *json = NULL;
+
+	if (!ctx) {
+		E_ERROR("bad parameter\n");
+		return NULL;
+	}
+
+	if (yasp_interpret_helper(ctx, audioFile, NULL, transcript, NULL,
+				  NULL, genpath, &json, false, NULL))
+		return NULL;
+
+	return json;
+}
+
+char *yasp_context_interpret_text_get_str(struct yasp_context *ctx,
+					  const char *audioFile,
+					  const char *text,
+					  const char *genpath)
+{
+	char *json = NULL;
+
+	if (!ctx) {
+		E_ERROR("bad parameter\n");
+		return NULL;
+	}
+
+	if (yasp_interpret_helper(ctx, audioFile, NULL, NULL, text,
+				  NULL, genpath, &json, false, NULL))
+		return NULL;
+
+	return json;
+}
+
+int yasp_context_interpret_ctl(struct yasp_context *ctx,
+			       const char *audioFile, const char *transcript,
+			       const char *text, const char *genpath,
+			       struct yasp_control *ctl, char **json)
+{
+	if (!ctx || !json || (transcript && text)) {
+		E_ERROR("bad parameter\n");
+		return -EINVAL;
+	}
+
+	*json = NULL;
+
+	return yasp_interpret_helper(ctx, audioFile, NULL, transcript, text,
+				     NULL, genpath, json, false, ctl);
+}
+
+int yasp_context_realign(struct yasp_context *ctx, const char *audioFile,
+			 const char *text, struct list_head *word_list,
+			 struct list_head *phoneme_list)
+{
+	struct yasp_tokens ts;
+	int rc;
+
+	if (!audioFile || !text || !word_list || !phoneme_list) {
+		E_ERROR("bad parameter\n");
+		return -EINVAL;
+	}
+
+	rc = yasp_tokenize(text, strlen(text), &ts);
+	if (rc)
+		return rc;
+
+	rc = realign(ctx, audioFile, &ts, word_list, phoneme_list);
+	yasp_tokens_free(&ts);
+	if (!rc)
+		return 0;
+
+	E_WARN("Failed to re-align part of %s, aligning all of it\n",
+	       audioFile);
+	yasp_free_segment_list(word_list);
+	yasp_free_segment_list(phoneme_list);
+
+	return consolidate(ctx, audioFile, NULL, text, word_list,
+			   phoneme_list, NULL, NULL);
+}
+
+char *yasp_context_realign_get_str(struct yasp_context *ctx,
+				   const char *audioFile,
+				   const char *json, const char *text)
+{
+	struct list_head word_list, phoneme_list;
+	char *str = NULL;
+
+	INIT_LIST_HEAD(&word_list);
+	INIT_LIST_HEAD(&phoneme_list);
+
+	if (yasp_parse_json(json, &word_list, &phoneme_list)) {
+		E_ERROR("Malformed previous result for %s\n",
+			audioFile ? audioFile : "<null>");
+		return NULL;
+	}
+
+	if (!yasp_context_realign(ctx, audioFile, text, &word_list,
+				  &phoneme_list))
+		str = yasp_create_json(&word_list, &phoneme_list);
+
+	yasp_free_segment_list(&word_list);
+	yasp_free_segment_list(&phoneme_list);
+
+	return str;
+}
+
+/*
+ * The decoder's front end is set up for one sample rate. Rather than
+ * silently mis-decoding, refuse buffers that don't match it.
+ */
+static int check_samprate(struct yasp_context *ctx, int samprate)
+{
+	ps_decoder_t *ps;
+	int rate;
+
+	ps = ctx_get_ps(ctx);
+	if (!ps)
+		return -1;
+	rate = (int) cmd_ln_float_r(ps_get_config(ps), "-samprate");
+	ctx_put_ps(ctx, ps);
+
+	if (rate != samprate) {
+		E_ERROR("PCM sample rate %d doesn't match the decoder's %d\n",
+			samprate, rate);
+		return -EINVAL;
+	}
+
+	return 0;
+}
+
+int yasp_context_interpret_pcm(struct yasp_context *ctx,
+			       const int16 *pcm, size_t nsamples,
+			       int samprate, const char *text,
+			       const char *genpath,
+			       struct list_head *word_list,
+			       struct list_head *phoneme_list)
+{
+	struct audio_src src = { 0 };
+	int rc;
+
+	if (!ctx || !pcm || !word_list || !phoneme_list) {
+		E_ERROR("bad arguments\n");
+		return -EINVAL;
+	}
+
+	rc = check_samprate(ctx, samprate);
+	if (rc)
+		return rc;
+
+	src.au_pcm = pcm;
+	src.au_nsamples = nsamples;
+
+	rc = consolidate_src(ctx, &src, text, word_list, phoneme_list,
+			     genpath);
+	if (rc)
+		E_ERROR("Failed to parse PCM buffer\n");
+
+	return rc;
+}
+
+char *yasp_context_interpret_pcm_get_str(struct yasp_context *ctx,
+					 const int16 *pcm, size_t nsamples,
+					 int samprate, const char *text,
+					 const char *genpath)
+{
+	struct audio_src src = { 0 };
+	char *json = NULL;
+
+	if (!ctx || !pcm) {
+		E_ERROR("bad parameter\n");
+		return NULL;
+	}
+
+	if (check_samprate(ctx, samprate))
+		return NULL;
+
+	src.au_pcm = pcm;
+	src.au_nsamples = nsamples;
+
+	if (yasp_interpret_helper(ctx, NULL, &src, NULL, text,
+				  NULL, genpath, &json, false, NULL))
+		return NULL;
+
+	return json;
+}
+
+int yasp_context_interpret_allphone(struct yasp_context *ctx,
+				    const char *audioFile,
+				    struct list_head *phoneme_list)
+{
+	if (!ctx) {
+		E_ERROR("bad parameter\n");
+		return -EINVAL;
+	}
+
+	return allphone_file(ctx, audioFile, phoneme_list);
+}
+
+char *yasp_context_interpret_allphone_get_str(struct yasp_context *ctx,
+					      const char *audioFile)
+{
+	struct list_head word_list;
+	struct list_head phoneme_list;
+	char *json = NULL;
+
+	INIT_LIST_HEAD(&word_list);
+	INIT_LIST_HEAD(&phoneme_list);
+
+	if (!yasp_context_interpret_allphone(ctx, audioFile, &phoneme_list))
+		json = yasp_create_json(&word_list, &phoneme_list);
+
+	yasp_free_segment_list(&phoneme_list);
+
+	return json;
+}
+
+int yasp_context_spot_keywords(struct yasp_context *ctx,
+			       const char *audioFile, const char **keywords,
+			       int nkeywords, double threshold,
+			       struct list_head *hit_list)
+{
+	if (!ctx) {
+		E_ERROR("bad parameter\n");
+		return -EINVAL;
+	}
+
+	return kws_file(ctx, audioFile, keywords, nkeywords, threshold,
+			hit_list);
+}
+
+char *yasp_context_spot_keywords_get_str(struct yasp_context *ctx,
+					 const char *audioFile,
+					 const char **keywords,
+					 int nkeywords, double threshold)
+{
+	struct list_head hit_list;
+	char *json = NULL;
+
+	INIT_LIST_HEAD(&hit_list);
+
+	if (!yasp_context_spot_keywords(ctx, audioFile, keywords, nkeywords,
+					threshold, &hit_list))
+		json = yasp_create_kws_json(&hit_list);
+
+	yasp_free_segment_list(&hit_list);
+
+	return json;
+}
+
+int yasp_context_interpret_breakdown(struct yasp_context *ctx,
+				     const char *audioFile,
+				     const char *transcript,
+				     const char *genpath,
+				     struct list_head *word_list,
+				     struct list_head *phoneme_list)
+{
+	int rc;
+
+	if (!ctx || !word_list || !phoneme_list) {
+		E_ERROR("bad arguments\n");
+		return -EINVAL;
+	}
+
+	rc = consolidate(ctx, audioFile, transcript, NULL, word_list,
+			 phoneme_list, genpath, NULL);
+	if (rc)
+		E_ERROR("Failed to parse speech clip %s\n",
+			audioFile);
+
+	return rc;
+}
+
+struct batch_state {
+	struct yasp_context *bs_ctx;
+	struct yasp_job *bs_jobs;
+	int bs_njobs;
+	int bs_next;
+	int bs_failed;
+	yasp_job_done_f bs_cb;
+	void *bs_user_data;
+	pthread_mutex_t bs_lock;
+};
+
+/* a cancelled control fails the jobs that haven't started yet */
+static int batch_run(struct yasp_context *ctx, struct yasp_job *job)
+{
+	if (job->jb_ctl && job->jb_ctl->ct_cancel)
+		return -ECANCELED;
+
+	return yasp_interpret_helper(ctx, job->jb_audio, NULL,
+				     job->jb_transcript, NULL, job->jb_output,
+				     job->jb_genpath, &job->jb_json,
+				     job->jb_output != NULL, job->jb_ctl);
+}
+
+/*
+ * Workers pull the next unclaimed job off the shared array until it
+ * runs dry, so a slow clip never holds up the jobs behind it.
+ */
+static void *batch_worker(void *arg)
+{
+	struct batch_state *bs = arg;
+	struct yasp_job *job;
+	int i;
+
+	for (;;) {
+		pthread_mutex_lock(&bs->bs_lock);
+		i = bs->bs_next++;
+		pthread_mutex_unlock(&bs->bs_lock);
+
+		if (i >= bs->bs_njobs)
+			break;
+
+		job = &bs->bs_jobs[i];
+		job->jb_json = NULL;
+		job->jb_rc = batch_run(bs->bs_ctx, job);
+		if (job->jb_rc) {
+			pthread_mutex_lock(&bs->bs_lock);
+			bs->bs_failed++;
+			pthread_mutex_unlock(&bs->bs_lock);
+		}
+
+		if (bs->bs_cb)
+			bs->bs_cb(job, bs->bs_user_data);
+	}
+
+	return NULL;
+}
+
+int yasp_context_batch(struct yasp_context *ctx, struct yasp_job *jobs,
+		       int njobs, int nworkers, yasp_job_done_f cb,
+		       void *user_data)
+{
+	struct batch_state bs;
+	pthread_t *threads;
+	int i, nthreads;
+
+	if (!ctx || (!jobs && njobs > 0) || njobs < 0) {
+		E_ERROR("bad parameter\n");
+		return -EINVAL;
+	}
+
+	if (nworkers > njobs)
+		nworkers = njobs;
+	if (nworkers < 1)
+		nworkers = 1;
+
+	memset(&bs, 0, sizeof(bs));
+	bs.bs_ctx = ctx;
+	bs.bs_jobs = jobs;
+	bs.bs_njobs = njobs;
+	bs.bs_cb = cb;
+	bs.bs_user_data = user_data;
+	pthread_mutex_init(&bs.bs_lock, NULL);
+
+	threads = calloc(nworkers, sizeof(*threads));
+	if (!threads) {
+		E_ERROR("out of memory\n");
+		pthread_mutex_destroy(&bs.bs_lock);
+		return -ENOMEM;
+	}
+
+	for (nthreads = 0; nthreads < nworkers; nthreads++) {
+		if (pthread_create(&threads[nthreads], NULL, batch_worker,
+				   &bs)) {
+			E_ERROR("Failed to start batch worker %d\n",
+				nthreads);
+			break;
+		}
+	}
+
+	/* couldn't start any workers, run the batch on this thread */
+	if (!nthreads)
+		batch_worker(&bs);
+
+	for (i = 0; i < nthreads; i++)
+		pthread_join(threads[i], NULL);
+
+	free(threads);
+	pthread_mutex_destroy(&bs.bs_lock);
+
+	return bs.bs_failed;
+}
+
+/*
+ * Alternative transcripts of one clip. The front end runs once, every
+ * candidate's alignment searches the same cepstra.
+ */
+struct cand_state {
+	struct yasp_context *cs_ctx;
+	struct audio_src cs_src;
+	struct yasp_candidate *cs_cands;
+	int cs_ncands;
+	int cs_next;
+	int cs_failed;
+	pthread_mutex_t cs_lock;
+};
+
+/*
+ * The score of the best path out of the final phone, which the
+ * alignment was backtraced from. Each frame's senone scores are
+ * relative to the best one scored, and the search only scores the
+ * senones of its own transcript, so align_candidate() turns on
+ * compallsen to make that the best of all senones. Then the frame
+ * offsets are the same for every candidate and the scores compare.
+ * The search renormalizes its HMMs when the path score gets near the
+ * bottom of the range, which only very long clips would reach.
+ */
+static int32 align_score(ps_decoder_t *ps)
+{
+	state_align_search_t *sas = (state_align_search_t *) ps->search;
+
+	return hmm_out_score(sas->hmms + sas->n_phones - 1);
+}
+
+static int align_candidate(struct yasp_context *ctx, struct audio_src *src,
+			   struct yasp_candidate *cand)
+{
+	struct yasp_tokens ts;
+	ps_decoder_t *ps;
+	uint8 compallsen;
+	int rc;
+
+	rc = yasp_tokenize(cand->cd_text, strlen(cand->cd_text), &ts);
+	if (rc)
+		return rc;
+
+	ps = ctx_get_ps(ctx);
+	if (!ps) {
+		yasp_tokens_free(&ts);
+		return -1;
+	}
+
+	compallsen = ps->acmod->compallsen;
+	ps->acmod->compallsen = TRUE;
+	rc = interpret(ps, src, &cand->cd_words, &cand->cd_phonemes, &ts);
+	if (!rc)
+		cand->cd_ascr = align_score(ps);
+	ps->acmod->compallsen = compallsen;
+	ctx_put_ps(ctx, ps);
+	yasp_tokens_free(&ts);
+	if (rc)
+		return rc;
+
+	return consolidate_utterance(&cand->cd_words, &cand->cd_phonemes);
+}
+
+static void *cand_worker(void *arg)
+{
+	struct cand_state *cs = arg;
+	struct yasp_candidate *cand;
+	int i;
+
+	for (;;) {
+		pthread_mutex_lock(&cs->cs_lock);
+		i = cs->cs_next++;
+		pthread_mutex_unlock(&cs->cs_lock);
+
+		if (i >= cs->cs_ncands)
+			break;
+
+		cand = &cs->cs_cands[i];
+		cand->cd_rc = align_candidate(cs->cs_ctx, &cs->cs_src, cand);
+		if (cand->cd_rc) {
+			E_ERROR("Failed to align candidate %d\n", i);
+			yasp_free_segment_list(&cand->cd_words);
+			yasp_free_segment_list(&cand->cd_phonemes);
+			pthread_mutex_lock(&cs->cs_lock);
+			cs->cs_failed++;
+			pthread_mutex_unlock(&cs->cs_lock);
+		}
+	}
+
+	return NULL;
+}
+
+/*
+ * Run the front end of one of the context's decoders over the whole
+ * clip. The cepstra are freed with ckd_free_2d().
+ */
+static int compute_cep(struct yasp_context *ctx, const char *audioFile,
+		       struct audio_src *src)
+{
+	ps_decoder_t *ps;
+	size_t size;
+	int16 *pcm;
+	FILE *fh;
+	int rc;
+
+	fh = fopen(audioFile, "rb");
+	if (!fh) {
+		E_ERROR("unable to open audio file %s. errno = %s\n",
+			audioFile, strerror(errno));
+		return -1;
+	}
+	/* the whole file is samples, as ps_decode_raw() reads it */
+	pcm = cache_file(fh, &size);
+	fclose(fh);
+	if (!pcm)
+		return -1;
+
+	ps = ctx_get_ps(ctx);
+	if (!ps) {
+		free(pcm);
+		return -1;
+	}
+
+	fe_start_utt(ps_get_fe(ps));
+	rc = fe_process_utt(ps_get_fe(ps), pcm, size / sizeof(*pcm),
+			    &src->au_cep, &src->au_nframes);
+	ctx_put_ps(ctx, ps);
+	free(pcm);
+	if (rc < 0) {
+		E_ERROR("Failed to compute features of %s\n", audioFile);
+		if (src->au_cep)
+			ckd_free_2d(src->au_cep);
+		src->au_cep = NULL;
+		return -1;
+	}
+
+	return 0;
+}
+
+int yasp_context_align_candidates(struct yasp_context *ctx,
+				  const char *audioFile,
+				  struct yasp_candidate *cands, int ncands,
+				  int nworkers)
+{
+	struct cand_state cs;
+	pthread_t *threads;
+	int i, nthreads;
+
+	if (!ctx || !audioFile || !cands || ncands <= 0) {
+		E_ERROR("bad parameter\n");
+		return -EINVAL;
+	}
+
+	for (i = 0; i < ncands; i++) {
+		if (!cands[i].cd_text) {
+			E_ERROR("candidate %d has no transcript\n", i);
+			return -EINVAL;
+		}
+		INIT_LIST_HEAD(&cands[i].cd_words);
+		INIT_LIST_HEAD(&cands[i].cd_phonemes);
+		cands[i].cd_ascr = 0;
+		cands[i].cd_rc = 0;
+	}
+
+	if (nworkers > ncands)
+		nworkers = ncands;
+	if (nworkers < 1)
+		nworkers = 1;
+
+	memset(&cs, 0, sizeof(cs));
+	cs.cs_ctx = ctx;
+	cs.cs_cands = cands;
+	cs.cs_ncands = ncands;
+
+	if (compute_cep(ctx, audioFile, &cs.cs_src))
+		return -1;
+
+	threads = calloc(nworkers, sizeof(*threads));
+	if (!threads) {
+		E_ERROR("out of memory\n");
+		ckd_free_2d(cs.cs_src.au_cep);
+		return -ENOMEM;
+	}
+
+	pthread_mutex_init(&cs.cs_lock, NULL);
+
+	for (nthreads = 0; nthreads < nworkers; nthreads++) {
+		if (pthread_create(&threads[nthreads], NULL, cand_worker,
+				   &cs)) {
+			E_ERROR("Failed to start candidate worker %d\n",
+				nthreads);
+			break;
+		}
+	}
+
+	if (!nthreads)
+		cand_worker(&cs);
+
+	for (i = 0; i < nthreads; i++)
+		pthread_join(threads[i], NULL);
+
+	free(threads);
+	pthread_mutex_destroy(&cs.cs_lock);
+	ckd_free_2d(cs.cs_src.au_cep);
+
+	return cs.cs_failed;
+}
+
+/*
+ * {
+ *   "candidates": [
+ *       { "words": [ ... ], "score": -1234567 },
+ *       { "words": [ ... ], "score": -1200345 },
+ *       null,
+ *   ],
+ *   "best": 1,
+ * }
+ *
+ * A candidate that failed to align is null, "best" is -1 if they all
+ * did.
+ */
+char *yasp_context_align_candidates_get_str(struct yasp_context *ctx,
+					    const char *audioFile,
+					    const char **texts, int ntexts,
+					    int nworkers)
+{
+	struct yasp_candidate *cands;
+	cJSON *jroot = NULL, *jcands, *jcand;
+	char *json, *string = NULL;
+	int i, best = -1;
+
+	if (!texts || ntexts <= 0) {
+		E_ERROR("bad parameter\n");
+		return NULL;
+	}
+
+	cands = calloc(ntexts, sizeof(*cands));
+	if (!cands) {
+		E_ERROR("out of memory\n");
+		return NULL;
+	}
+	for (i = 0; i < ntexts; i++)
+		cands[i].cd_text = texts[i];
+
+	if (yasp_context_align_candidates(ctx, audioFile, cands, ntexts,
+					  nworkers) < 0) {
+		free(cands);
+		return NULL;
+	}
+
+	jroot = cJSON_CreateObject();
+	if (!jroot)
+		goto end;
+	jcands = cJSON_AddArrayToObject(jroot, "candidates");
+	if (!jcands)
+		goto end;
+
+	for (i = 0; i < ntexts; i++) {
+		jcand = NULL;
+		if (!cands[i].cd_rc) {
+			json = yasp_create_json(&cands[i].cd_words,
+						&cands[i].cd_phonemes);
+			if (json) {
+				jcand = cJSON_Parse(json);
+				free(json);
+			}
+			if (jcand && !cJSON_AddNumberToObject(jcand, "score",
+							      cands[i].cd_ascr)) {
+				cJSON_Delete(jcand);
+				jcand = NULL;
+			}
+			if (jcand && (best < 0 ||
+				      cands[i].cd_ascr > cands[best].cd_ascr))
+				best = i;
+		}
+		if (!jcand)
+			jcand = cJSON_CreateNull();
+		cJSON_AddItemToArray(jcands, jcand);
+	}
+
+	if (!cJSON_AddNumberToObject(jroot, "best", best))
+		goto end;
+
+	string = cJSON_Print(jroot);
+	if (!string)
+		E_ERROR("Failed to print json file\n");
+
+end:
+	cJSON_Delete(jroot);
+	for (i = 0; i < ntexts; i++) {
+		yasp_free_segment_list(&cands[i].cd_words);
+		yasp_free_segment_list(&cands[i].cd_phonemes);
+	}
+	free(cands);
+
+	return string;
+}
+
+/*
+ * Preview then refine. The clip's features are computed once, the
+ * preview searches them on the preview decoders and the refinement
+ * searches the same cepstra again on the context's own.
+ */
+struct yasp_refine {
+	struct yasp_context *rf_ctx;
+	struct audio_src rf_src;
+	char *rf_text;
+	yasp_refine_done_f rf_cb;
+	void *rf_user_data;
+	pthread_t rf_thread;
+	int rf_rc;
+};
+
+static int preview_src(struct yasp_context *ctx, struct audio_src *src,
+		       const char *text, struct list_head *word_list,
+		       struct list_head *phoneme_list)
+{
+	struct yasp_tokens ts;
+	ps_decoder_t *ps;
+	int rc;
+
+	ps = pool_get(ctx, &ctx->ctx_preview);
+	if (!ps)
+		return -1;
+
+	/* without a transcript, phonemes from a single phone loop pass */
+	if (!text) {
+		rc = interpret_allphone(ps, src, phoneme_list);
+		goto out;
+	}
+
+	rc = yasp_tokenize(text, strlen(text), &ts);
+	if (rc)
+		goto out;
+
+	rc = add_vocab(ps, ctx->ctx_modeldir, &ts);
+	if (!rc)
+		rc = interpret(ps, src, word_list, phoneme_list, &ts);
+	if (!rc)
+		rc = consolidate_utterance(word_list, phoneme_list);
+	yasp_tokens_free(&ts);
+
+out:
+	pool_put(ctx, &ctx->ctx_preview, ps);
+
+	return rc;
+}
+
+static void *refine_main(void *arg)
+{
+	struct yasp_refine *rf = arg;
+	char *json = NULL;
+
+	rf->rf_rc = yasp_interpret_helper(rf->rf_ctx, NULL, &rf->rf_src,
+					  NULL, rf->rf_text, NULL, NULL,
+					  &json, false, NULL);
+	rf->rf_cb(json, rf->rf_rc, rf->rf_user_data);
+	yasp_free_json_str(json);
+
+	return NULL;
+}
+
+char *yasp_context_preview(struct yasp_context *ctx, const char *audioFile,
+			   const char *text, yasp_refine_done_f cb,
+			   void *user_data, struct yasp_refine **refine)
+{
+	struct list_head word_list, phoneme_list;
+	struct audio_src src = { 0 };
+	struct yasp_refine *rf;
+	char *json = NULL;
+	int rc;
+
+	INIT_LIST_HEAD(&word_list);
+	INIT_LIST_HEAD(&phoneme_list);
+
+	if (!ctx || !audioFile || (cb && !refine)) {
+		E_ERROR("bad parameter\n");
+		return NULL;
+	}
+	if (refine)
+		*refine = NULL;
+
+	if (compute_cep(ctx, audioFile, &src))
+		return NULL;
+
+	rc = preview_src(ctx, &src, text, &word_list, &phoneme_list);
+	if (!rc)
+		json = yasp_create_json(&word_list, &phoneme_list);
+	else
+		E_ERROR("Failed to preview %s\n", audioFile);
+	yasp_free_segment_list(&word_list);
+	yasp_free_segment_list(&phoneme_list);
+
+	if (!json || !cb)
+		goto out;
+
+	rf = calloc(1, sizeof(*rf));
+	if (!rf || (text && !(rf->rf_text = strdup(text)))) {
+		E_ERROR("out of memory\n");
+		goto fail;
+	}
+	rf->rf_ctx = ctx;
+	rf->rf_src = src;
+	rf->rf_cb = cb;
+	rf->rf_user_data = user_data;
+
+	if (pthread_create(&rf->rf_thread, NULL, refine_main, rf)) {
+		E_ERROR("Failed to start refining %s\n", audioFile);
+		goto fail;
+	}
+
+	/* the refinement owns the cepstra now */
+	*refine = rf;
+	return json;
+
+fail:
+	if (rf)
+		free(rf->rf_text);
+	free(rf);
+	yasp_free_json_str(json);
+	json = NULL;
+out:
+	ckd_free_2d(src.au_cep);
+
+	return json;
+}
+
+int yasp_refine_wait(struct yasp_refine *refine)
+{
+	int rc;
+
+	if (!refine)
+		return -EINVAL;
+
+	pthread_join(refine->rf_thread, NULL);
+	rc = refine->rf_rc;
+
+	ckd_free_2d(refine->rf_src.au_cep);
+	free(refine->rf_text);
+	free(refine);
+
+	return rc;
+}
+
+/*
+ * Process batches. The parent holds the loaded models and each worker
+ * is forked off it, so the workers start without a model load and
+ * share the model pages copy-on-write. A worker talks to the parent
+ * over a socket pair: it's sent a job index, runs the job and answers
+ * with a fork_reply followed by fr_len bytes of JSON.
+ */
+struct fork_reply {
+	int32 fr_rc;
+	uint32 fr_len;
+	struct yasp_stats fr_stats;
+};
+
+struct fork_worker {
+	pid_t fw_pid;
+	int fw_fd;
+	int fw_job;
+};
+
+static int read_full(int fd, void *buf, size_t len)
+{
+	char *p = buf;
+	ssize_t n;
+
+	while (len > 0) {
+		n = read(fd, p, len);
+		if (n < 0 && errno == EINTR)
+			continue;
+		if (n <= 0)
+			return -1;
+		p += n;
+		len -= n;
+	}
+
+	return 0;
+}
+
+static int write_full(int fd, const void *buf, size_t len)
+{
+	const char *p = buf;
+	ssize_t n;
+
+	while (len > 0) {
+		n = send(fd, p, len, MSG_NOSIGNAL);
+		if (n < 0 && errno == EINTR)
+			continue;
+		if (n < 0)
+			return -1;
+		p += n;
+		len -= n;
+	}
 
-skip_phoneme:
-			if (next_time > word->ph_end) {
-				/* start the next word */
-				cur = &phoneme->ph_on_list;
-				break;
-			}
-		}
+	return 0;
+}
 
-		cJSON_AddItemToArray(jwords, jword);
+static void stats_merge(const struct yasp_stats *stats)
+{
+	int i;
+
+	pthread_mutex_lock(&g_stats_lock);
+	for (i = 0; i < YASP_STAGE_MAX; i++) {
+		g_stats.st_time[i] += stats->st_time[i];
+		g_stats.st_calls[i] += stats->st_calls[i];
 	}
+	g_stats.st_frames += stats->st_frames;
+	g_stats.st_audio_secs += stats->st_audio_secs;
+	g_stats.st_allocs += stats->st_allocs;
+	g_stats.st_output_bytes += stats->st_output_bytes;
+	pthread_mutex_unlock(&g_stats_lock);
+}
 
-	string = cJSON_Print(jroot);
-	if (!string) {
-		E_ERROR("Failed to print json file\n");
-		goto end;
+static void __attribute__((noreturn))
+fork_worker_main(struct yasp_context *ctx, struct yasp_job *jobs, int fd)
+{
+	struct fork_reply reply;
+	struct yasp_control ctl;
+	struct yasp_job *job;
+	char *json;
+	int32 i;
+
+	/*
+	 * the counters inherited from the parent are already counted
+	 * there. Only this worker's share is sent back with each reply.
+	 */
+	pthread_mutex_init(&g_stats_lock, NULL);
+	memset(&g_stats, 0, sizeof(g_stats));
+	pthread_mutex_init(&ctx->ctx_lock, NULL);
+
+	while (!read_full(fd, &i, sizeof(i))) {
+		job = &jobs[i];
+		json = NULL;
+
+		/*
+		 * the caller's flag and callback don't reach across the
+		 * fork, only the time limit does
+		 */
+		memset(&ctl, 0, sizeof(ctl));
+		if (job->jb_ctl)
+			ctl.ct_timeout = job->jb_ctl->ct_timeout;
+
+		memset(&reply, 0, sizeof(reply));
+		reply.fr_rc = yasp_interpret_helper(ctx, job->jb_audio, NULL,
+						    job->jb_transcript, NULL,
+						    job->jb_output,
+						    job->jb_genpath, &json,
+						    job->jb_output != NULL,
+						    job->jb_ctl ? &ctl : NULL);
+		reply.fr_len = json ? strlen(json) : 0;
+		reply.fr_stats = g_stats;
+		memset(&g_stats, 0, sizeof(g_stats));
+
+		if (write_full(fd, &reply, sizeof(reply)) ||
+		    write_full(fd, json, reply.fr_len))
+			break;
+		yasp_free_json_str(json);
 	}
 
-end:
-	cJSON_Delete(jroot);
-	return string;
+	_exit(0);
 }
 
-int yasp_create_json_file(struct list_head *word_list,
-			  struct list_head *phoneme_list,
-			  const char *output)
+static int fork_spawn(struct yasp_context *ctx, struct yasp_job *jobs,
+		      struct fork_worker *workers, int nworkers, int w)
 {
-	FILE *json_fh;
-	char *json_str;
-	int rc = 0;
+	int fds[2], i;
+	pid_t pid;
 
-	json_str = yasp_create_json(word_list, phoneme_list);
-	if (!json_str) {
-		rc = -EINVAL;
-		goto end;
+	if (socketpair(AF_UNIX, SOCK_STREAM, 0, fds)) {
+		E_ERROR("socketpair failed. errno = %s\n", strerror(errno));
+		return -errno;
 	}
 
-	json_fh = fopen(output, "w");
-	if (!json_fh) {
-		E_ERROR("Failed to open output: %s\n", output);
-		rc = -errno;
-		goto end;
+	/* don't let buffered output be written twice */
+	fflush(NULL);
+
+	pid = fork();
+	if (pid < 0) {
+		E_ERROR("fork failed. errno = %s\n", strerror(errno));
+		close(fds[0]);
+		close(fds[1]);
+		return -errno;
 	}
 
-	fprintf(json_fh, "%s", json_str);
-	fclose(json_fh);
+	if (!pid) {
+		close(fds[0]);
+		for (i = 0; i < nworkers; i++) {
+			if (workers[i].fw_fd >= 0)
+				close(workers[i].fw_fd);
+		}
+		fork_worker_main(ctx, jobs, fds[1]);
+	}
 
-end:
-	if (json_str)
-		free(json_str);
-	return rc;
+	close(fds[1]);
+	workers[w].fw_pid = pid;
+	workers[w].fw_fd = fds[0];
+	workers[w].fw_job = -1;
+
+	return 0;
 }
 
-int yasp_interpret_hypothesis(const char *faudio, const char *ftranscript,
-			      const char *genpath,
-			      struct list_head *word_list)
+static void fork_reap(struct fork_worker *fw)
 {
-	struct list_head phoneme_list;
-	int rc;
+	int status;
 
-	INIT_LIST_HEAD(&phoneme_list);
+	close(fw->fw_fd);
+	fw->fw_fd = -1;
+	fw->fw_job = -1;
 
-	if (!word_list) {
-		E_ERROR("bad parameter\n");
-		return -EINVAL;
-	}
+	if (waitpid(fw->fw_pid, &status, 0) == fw->fw_pid &&
+	    WIFSIGNALED(status))
+		E_ERROR("worker %d killed by signal %d\n", (int) fw->fw_pid,
+			WTERMSIG(status));
+	fw->fw_pid = 0;
+}
 
-	/*
-	 * Parse audio file
-	 */
-	rc = consolidate(faudio, ftranscript, word_list,
-			 &phoneme_list, genpath);
-	if (rc)
-		E_ERROR("Failed to parse speech clip %s\n",
-			faudio);
+/* read a finished job's reply. Fails if the worker died on it. */
+static int fork_collect(struct fork_worker *fw, struct yasp_job *job)
+{
+	struct fork_reply reply;
 
-	yasp_free_segment_list(&phoneme_list);
+	if (read_full(fw->fw_fd, &reply, sizeof(reply)))
+		return -1;
 
-	return rc;
+	stats_merge(&reply.fr_stats);
+
+	job->jb_rc = reply.fr_rc;
+	if (!reply.fr_len)
+		return 0;
+
+	job->jb_json = malloc(reply.fr_len + 1);
+	if (!job->jb_json)
+		return -1;
+	if (read_full(fw->fw_fd, job->jb_json, reply.fr_len)) {
+		free(job->jb_json);
+		job->jb_json = NULL;
+		return -1;
+	}
+	job->jb_json[reply.fr_len] = '\0';
+
+	return 0;
 }
 
-int yasp_interpret_phonemes(const char *faudio, const char *ftranscript,
-			    const char *genpath,
-			    struct list_head *phoneme_list)
+static int fork_dispatch(struct fork_worker *fw, int32 i)
 {
-	struct list_head word_list;
-	int rc;
+	if (write_full(fw->fw_fd, &i, sizeof(i)))
+		return -1;
+	fw->fw_job = i;
 
-	INIT_LIST_HEAD(&word_list);
+	return 0;
+}
 
-	if (!phoneme_list) {
+int yasp_context_batch_fork(struct yasp_context *ctx, struct yasp_job *jobs,
+			    int njobs, int nprocs, yasp_job_done_f cb,
+			    void *user_data)
+{
+	struct fork_worker *workers;
+	struct pollfd *pfds;
+	struct yasp_job *job;
+	int next = 0, done = 0, failed = 0;
+	int w, n, nbusy;
+	int *busy;
+
+	if (!ctx || (!jobs && njobs > 0) || njobs < 0) {
 		E_ERROR("bad parameter\n");
 		return -EINVAL;
 	}
 
-	/*
-	 * Parse audio file
-	 */
-	rc = consolidate(faudio, ftranscript, &word_list,
-			 phoneme_list, genpath);
-	if (rc)
-		E_ERROR("Failed to parse speech clip %s\n",
-			faudio);
-
-	yasp_free_segment_list(&word_list);
+	if (nprocs > njobs)
+		nprocs = njobs;
+	if (nprocs < 1)
+		nprocs = 1;
 
-	return rc;
-}
+	for (n = 0; n < njobs; n++) {
+		jobs[n].jb_json = NULL;
+		jobs[n].jb_rc = 0;
+	}
 
-static int
-yasp_interpret_helper(const char *audioFile, const char *transcript,
-		      const char *output, const char *genpath,
-		      char **json, bool write)
-{
-	int rc;
-	struct list_head word_list;
-	struct list_head phoneme_list;
+	workers = calloc(nprocs, sizeof(*workers));
+	pfds = calloc(nprocs, sizeof(*pfds));
+	busy = calloc(nprocs, sizeof(*busy));
+	if (!workers || !pfds || !busy) {
+		E_ERROR("out of memory\n");
+		failed = -ENOMEM;
+		goto out;
+	}
 
-	INIT_LIST_HEAD(&word_list);
-	INIT_LIST_HEAD(&phoneme_list);
+	/* a slot that fails to spawn must not count as busy */
+	for (w = 0; w < nprocs; w++) {
+		workers[w].fw_fd = -1;
+		workers[w].fw_job = -1;
+	}
 
-	/*
-	 * Parse audio file
-	 */
-	rc = consolidate(audioFile, transcript, &word_list,
-			 &phoneme_list, genpath);
-	if (rc) {
-		E_ERROR("Failed to parse speech clip %s\n",
-			audioFile);
+	/* warm the pool so every worker inherits a loaded decoder */
+	if (yasp_context_warm(ctx, 1)) {
+		failed = -1;
 		goto out;
 	}
 
-	if (write) {
-		if (!output)
-			goto out;
+	for (w = 0; w < nprocs; w++) {
+		if (fork_spawn(ctx, jobs, workers, nprocs, w))
+			continue;
+		if (next < njobs && !fork_dispatch(&workers[w], next))
+			next++;
+	}
 
-		rc = yasp_create_json_file(&word_list, &phoneme_list,
-					   output);
-		if (rc) {
-			E_ERROR("Failed to create json file: %s\n",
-				output);
-			goto out;
+	while (done < njobs) {
+		nbusy = 0;
+		for (w = 0; w < nprocs; w++) {
+			if (workers[w].fw_job < 0)
+				continue;
+			pfds[nbusy].fd = workers[w].fw_fd;
+			pfds[nbusy].events = POLLIN;
+			busy[nbusy++] = w;
 		}
-	} else {
-		if (!json) {
-			rc = -EINVAL;
-			goto out;
+
+		/* every worker is gone and none could be replaced */
+		if (!nbusy) {
+			E_ERROR("no batch workers left, failing %d jobs\n",
+				njobs - done);
+			for (; next < njobs; next++, done++) {
+				jobs[next].jb_rc = -ECHILD;
+				failed++;
+				if (cb)
+					cb(&jobs[next], user_data);
+			}
+			break;
+		}
+
+		if (poll(pfds, nbusy, -1) < 0) {
+			if (errno == EINTR)
+				continue;
+			E_ERROR("poll failed. errno = %s\n", strerror(errno));
+			failed = -errno;
+			break;
+		}
+
+		for (n = 0; n < nbusy; n++) {
+			if (!pfds[n].revents)
+				continue;
+
+			w = busy[n];
+			job = &jobs[workers[w].fw_job];
+
+			/*
+			 * the worker crashed on this job. Only the job is
+			 * lost, the worker is replaced from the parent,
+			 * which still holds the warm models.
+			 */
+			if (fork_collect(&workers[w], job)) {
+				E_ERROR("worker died on %s\n", job->jb_audio);
+				job->jb_rc = -ECHILD;
+				fork_reap(&workers[w]);
+				if (next < njobs)
+					fork_spawn(ctx, jobs, workers, nprocs,
+						   w);
+			}
+
+			workers[w].fw_job = -1;
+			done++;
+			if (job->jb_rc)
+				failed++;
+			if (cb)
+				cb(job, user_data);
+
+			if (workers[w].fw_fd >= 0 && next < njobs &&
+			    !fork_dispatch(&workers[w], next))
+				next++;
 		}
-		*json = yasp_create_json(&word_list, &phoneme_list);
+	}
+
+	/* closing the socket tells an idle worker to exit */
+	for (w = 0; w < nprocs; w++) {
+		if (workers[w].fw_fd >= 0)
+			fork_reap(&workers[w]);
 	}
 
 out:
+	free(workers);
+	free(pfds);
+	free(busy);
 
-	yasp_print_segment_list(&word_list);
-	yasp_print_segment_list(&phoneme_list);
+	return failed;
+}
 
-	yasp_free_segment_list(&word_list);
-	yasp_free_segment_list(&phoneme_list);
+void yasp_get_stats(struct yasp_stats *stats)
+{
+	struct rusage ru;
 
-	return rc;
+	if (!stats)
+		return;
+
+	pthread_mutex_lock(&g_stats_lock);
+	*stats = g_stats;
+	pthread_mutex_unlock(&g_stats_lock);
+
+	if (!getrusage(RUSAGE_SELF, &ru))
+		stats->st_peak_rss_kb = ru.ru_maxrss;
 }
 
-void yasp_free_json_str(char *json)
+void yasp_reset_stats(void)
 {
-	if (json)
-		free(json);
+	pthread_mutex_lock(&g_stats_lock);
+	memset(&g_stats, 0, sizeof(g_stats));
+	pthread_mutex_unlock(&g_stats_lock);
 }
 
-char *
-yasp_interpret_get_str(const char *audioFile,
-		       const char *transcript,
-		       const char *genpath)
+double yasp_stats_rtf(const struct yasp_stats *stats)
 {
-	int rc;
-	char *json = NULL;
+	if (!stats || stats->st_audio_secs <= 0)
+		return 0;
 
-	rc = yasp_interpret_helper(audioFile, transcript, NULL,
-				   genpath, &json, false);
+	return (stats->st_time[YASP_STAGE_DECODE] +
+		stats->st_time[YASP_STAGE_ALIGN]) / stats->st_audio_secs;
+}
 
-	if (rc)
+/*
+ * {
+ *   "stages": {
+ *       "model_load": { "seconds": 0.52, "calls": 1 },
+ *       ...
+ *   },
+ *   "frames": 1234,
+ *   "audio_seconds": 12.34,
+ *   "rtf": 0.21,
+ *   "allocations": 345,
+ *   "output_bytes": 6789,
+ *   "peak_rss_kb": 81234
+ * }
+ */
+char *yasp_stats_json(const struct yasp_stats *stats)
+{
+	cJSON *jroot, *jstages, *jstage;
+	char *string = NULL;
+	int i;
+
+	if (!stats) {
+		E_ERROR("bad parameter\n");
 		return NULL;
+	}
 
-	return json;
-}
+	jroot = cJSON_CreateObject();
+	if (!jroot)
+		return NULL;
 
-int
-yasp_interpret(const char *audioFile, const char *transcript,
-	       const char *output, const char *genpath)
-{
-	return yasp_interpret_helper(audioFile, transcript, output,
-				     genpath, NULL, true);
+	jstages = cJSON_AddObjectToObject(jroot, "stages");
+	if (!jstages)
+		goto end;
+
+	for (i = 0; i < YASP_STAGE_MAX; i++) {
+		jstage = cJSON_AddObjectToObject(jstages, stage_names[i]);
+		if (!jstage)
+			goto end;
+		if (!cJSON_AddNumberToObject(jstage, "seconds",
+					     stats->st_time[i]))
+			goto end;
+		if (!cJSON_AddNumberToObject(jstage, "calls",
+					     stats->st_calls[i]))
+			goto end;
+	}
+
+	if (!cJSON_AddNumberToObject(jroot, "frames", stats->st_frames) ||
+	    !cJSON_AddNumberToObject(jroot, "audio_seconds",
+				     stats->st_audio_secs) ||
+	    !cJSON_AddNumberToObject(jroot, "rtf", yasp_stats_rtf(stats)) ||
+	    !cJSON_AddNumberToObject(jroot, "allocations",
+				     stats->st_allocs) ||
+	    !cJSON_AddNumberToObject(jroot, "output_bytes",
+				     stats->st_output_bytes) ||
+	    !cJSON_AddNumberToObject(jroot, "peak_rss_kb",
+				     stats->st_peak_rss_kb))
+		goto end;
+
+	string = cJSON_Print(jroot);
+	if (!string)
+		E_ERROR("Failed to print stats\n");
+
+end:
+	cJSON_Delete(jroot);
+	return string;
 }
 
-int yasp_interpret_breadown(const char *audioFile, const char *transcript,
-			    const char *output, const char *genpath,
-			    struct list_head *word_list,
-			    struct list_head *phoneme_list)
+void yasp_print_stats(FILE *fh, const struct yasp_stats *stats)
 {
-	int rc;
+	int i;
 
-	if (!word_list || !phoneme_list) {
-		E_ERROR("bad arguments\n");
-		return -1;
-	}
-
-	/*
-	 * Parse audio file
-	 */
-	rc = consolidate(audioFile, transcript, word_list,
-			 phoneme_list, genpath);
-	if (rc)
-		E_ERROR("Failed to parse speech clip %s\n",
-			audioFile);
+	if (!fh || !stats)
+		return;
 
-	return rc;
+	fprintf(fh, "%-12s %-10s %-6s\n", "stage", "seconds", "calls");
+	for (i = 0; i < YASP_STAGE_MAX; i++)
+		fprintf(fh, "%-12s %-10.4f %-6lu\n", stage_names[i],
+			stats->st_time[i], stats->st_calls[i]);
+	fprintf(fh, "frames:       %lu\n", stats->st_frames);
+	fprintf(fh, "audio:        %.2fs\n", stats->st_audio_secs);
+	fprintf(fh, "rtf:          %.4f\n", yasp_stats_rtf(stats));
+	fprintf(fh, "allocations:  %lu\n", stats->st_allocs);
+	fprintf(fh, "output bytes: %lu\n", stats->st_output_bytes);
+	fprintf(fh, "peak rss:     %lukB\n", stats->st_peak_rss_kb);
 }
 
 void yasp_log(void *user_data, err_lvl_t el, const char *fmt, ...)
@@ -984,6 +3808,13 @@ void yasp_setup_logging(struct yasp_logs *logs, err_cb_f cb,
 	redirect_ps_log(cb, logs);
 }
 
+void yasp_set_log_callback(err_cb_f cb, void *user_data)
+{
+	/* disable pocketsphinx logging */
+	err_set_logfp(NULL);
+	err_set_callback(cb, user_data);
+}
+
 void yasp_finish_logging(struct yasp_logs *logs)
 {
 	if (!logs)
@@ -995,83 +3826,3 @@ void yasp_finish_logging(struct yasp_logs *logs)
 	if (logs->lg_info)
 		fclose(logs->lg_info);
 }
-
-int
-main(int argc, char *argv[])
-{
-	int rc;
-	int opt;
-	const char *audioFile = NULL;
-	const char *transcript = NULL;
-	const char *genpath = NULL;
-	const char *output = NULL;
-	const char *logfile = "default_log";
-	struct list_head word_list;
-	struct yasp_logs logs;
-
-	INIT_LIST_HEAD(&word_list);
-
-	const char *const short_options = "a:t:o:g:l:m:h";
-	static const struct option long_options[] = {
-		{ .name = "audio", .has_arg = required_argument, .val = 'a' },
-		{ .name = "transcript", .has_arg = required_argument, .val = 't' },
-		{ .name = "output", .has_arg = required_argument, .val = 'o' },
-		{ .name = "genpath", .has_arg = required_argument, .val = 'g' },
-		{ .name = "logfile", .has_arg = required_argument, .val = 'l' },
-		{ .name = "modeldir", .has_arg = required_argument, .val = 'm' },
-		{ .name = "help", .has_arg = no_argument, .val = 'h' },
-		{ .name = NULL },
-	};
-
-	while ((opt = getopt_long(argc, argv, short_options,
-				  long_options, NULL)) != -1) {
-		switch (opt) {
-		case 'a':
-			audioFile = optarg;
-			break;
-		case 't':
-			transcript = optarg;
-			break;
-		case 'o':
-			output = optarg;
-			break;
-		case 'g':
-			genpath = optarg;
-			break;
-		case 'm':
-			yasp_set_modeldir(optarg);
-			break;
-		case 'h':
-			printf("Usage: \n"
-			       "run -a </path/to/audio/file> "
-			       "-t [</path/to/audio/transcript>] "
-                   "-g [</path/to/genfile>] "
-                   "-m [</path/to/modeldir>]\n");
-			return -1;
-		default:
-			E_ERROR("Unknown command line option\n");
-			return -1;
-		}
-	}
-
-	if (!audioFile) {
-		E_ERROR("No audio file provided. Please provide one\n");
-		return -1;
-	}
-
-	yasp_setup_logging(&logs, NULL, logfile);
-
-	rc = yasp_interpret(audioFile, transcript, output, genpath);
-	if (rc)
-		E_ERROR("Failed to interpret audio file %s\n",
-			audioFile);
-
-	//rc = yasp_interpret_hypothesis(audioFile, transcript, genpath,
-	//			       &word_list);
-	//yasp_free_segment_list(&word_list);
-
-	yasp_finish_logging(&logs);
-
-	return rc;
-}
-
@@ -1,4 +1,4 @@
-%module yasp
+%module(threads="1") yasp
 
 %{
 struct yasp_logs {
@@ -26,11 +26,742 @@ extern char *yasp_interpret_get_str(const char *audioFile,
 extern void yasp_setup_logging(struct yasp_logs *logs, err_cb_f cb,
                                const char *logfile);
 extern void yasp_finish_logging(struct yasp_logs *logs);
+extern void yasp_set_log_callback(err_cb_f cb, void *user_data);
 extern void yasp_set_modeldir(const char *modeldir);
 extern void yasp_free_json_str(char *json);
-extern void yasp_set_modeldir(const char *modeldir);
+
+struct yasp_context;
+
+typedef int (*yasp_progress_f)(int frames, int total, void *user_data);
+
+struct yasp_control {
+	volatile int ct_cancel;
+	double ct_timeout;
+	yasp_progress_f ct_progress;
+	void *ct_user_data;
+};
+
+struct yasp_job {
+	const char *jb_audio;
+	const char *jb_transcript;
+	const char *jb_output;
+	const char *jb_genpath;
+	char *jb_json;
+	int jb_rc;
+	struct yasp_control *jb_ctl;
+};
+
+typedef void (*yasp_job_done_f)(struct yasp_job *job, void *user_data);
+
+extern struct yasp_context *yasp_context_create(const char *modeldir);
+extern struct yasp_context *yasp_context_create_profile(const char *modeldir,
+                                                       const char *spec);
+extern void yasp_context_destroy(struct yasp_context *ctx);
+extern int yasp_context_interpret(struct yasp_context *ctx,
+                                  const char *audioFile,
+                                  const char *transcript,
+                                  const char *output, const char *genpath);
+extern char *yasp_context_interpret_get_str(struct yasp_context *ctx,
+                                            const char *audioFile,
+                                            const char *transcript,
+                                            const char *genpath);
+extern char *yasp_context_interpret_text_get_str(struct yasp_context *ctx,
+                                                 const char *audioFile,
+                                                 const char *text,
+                                                 const char *genpath);
+extern int yasp_context_interpret_ctl(struct yasp_context *ctx,
+                                     const char *audioFile,
+                                     const char *transcript,
+                                     const char *text, const char *genpath,
+                                     struct yasp_control *ctl, char **json);
+extern char *yasp_context_interpret_pcm_get_str(struct yasp_context *ctx,
+                                                const short *pcm,
+                                                size_t nsamples,
+                                                int samprate,
+                                                const char *text,
+                                                const char *genpath);
+extern char *yasp_context_interpret_allphone_get_str(struct yasp_context *ctx,
+                                                     const char *audioFile);
+extern char *yasp_context_realign_get_str(struct yasp_context *ctx,
+                                          const char *audioFile,
+                                          const char *json,
+                                          const char *text);
+extern char *yasp_context_spot_keywords_get_str(struct yasp_context *ctx,
+                                                const char *audioFile,
+                                                const char **keywords,
+                                                int nkeywords,
+                                                double threshold);
+extern char *yasp_context_align_candidates_get_str(struct yasp_context *ctx,
+                                                   const char *audioFile,
+                                                   const char **texts,
+                                                   int ntexts,
+                                                   int nworkers);
+extern int yasp_context_batch(struct yasp_context *ctx,
+                              struct yasp_job *jobs, int njobs,
+                              int nworkers, yasp_job_done_f cb,
+                              void *user_data);
+
+struct yasp_refine;
+
+typedef void (*yasp_refine_done_f)(const char *json, int rc,
+                                   void *user_data);
+
+extern char *yasp_context_preview(struct yasp_context *ctx,
+                                  const char *audioFile, const char *text,
+                                  yasp_refine_done_f cb, void *user_data,
+                                  struct yasp_refine **refine);
+extern int yasp_refine_wait(struct yasp_refine *refine);
+
+struct yasp_oov {
+	char *ov_word;
+	int ov_index;
+	int ov_line;
+	int ov_column;
+};
+
+extern int yasp_check_transcript(const char *text, struct yasp_oov **oovs);
+extern void yasp_free_oovs(struct yasp_oov *oovs, int n);
+
+/*
+ * Python logging support.
+ *
+ * The decoding entry points run with the GIL released, so the
+ * pocketsphinx log callback can fire on any thread without the GIL
+ * held. Format the message first, then take the GIL before touching
+ * any Python object.
+ */
+static PyObject *yasp_py_log_cb = NULL;
+
+static void yasp_py_log(void *user_data, err_lvl_t el, const char *fmt, ...)
+{
+	PyGILState_STATE gstate;
+	PyObject *res;
+	char msg[1024];
+	va_list ap;
+
+	va_start(ap, fmt);
+	vsnprintf(msg, sizeof(msg), fmt, ap);
+	va_end(ap);
+
+	gstate = PyGILState_Ensure();
+	if (yasp_py_log_cb) {
+		res = PyObject_CallFunction(yasp_py_log_cb, "is", (int) el, msg);
+		if (!res)
+			PyErr_Print();
+		else
+			Py_DECREF(res);
+	}
+	PyGILState_Release(gstate);
+}
+
+static void yasp_setup_py_logging(PyObject *cb)
+{
+	PyObject *old = yasp_py_log_cb;
+
+	if (cb == Py_None)
+		cb = NULL;
+
+	Py_XINCREF(cb);
+	yasp_py_log_cb = cb;
+
+	if (cb)
+		yasp_set_log_callback(yasp_py_log, NULL);
+	else
+		yasp_set_log_callback(NULL, NULL);
+
+	Py_XDECREF(old);
+}
+
+/*
+ * Batch support.
+ *
+ * Copy the (audio, transcript) pairs out of python, run them on native
+ * worker threads with the GIL released and report each result to
+ * done_cb(index, json) as soon as it is ready. json is None on failure.
+ */
+struct yasp_py_batch_data {
+	struct yasp_job *pb_jobs;
+	PyObject *pb_cb;
+};
+
+static void yasp_py_job_done(struct yasp_job *job, void *user_data)
+{
+	struct yasp_py_batch_data *pb = user_data;
+	Py_ssize_t idx = job - pb->pb_jobs;
+	PyGILState_STATE gstate;
+	PyObject *res;
+
+	gstate = PyGILState_Ensure();
+	if (job->jb_json)
+		res = PyObject_CallFunction(pb->pb_cb, "ns", idx, job->jb_json);
+	else
+		res = PyObject_CallFunction(pb->pb_cb, "nO", idx, Py_None);
+	if (!res)
+		PyErr_Print();
+	else
+		Py_DECREF(res);
+	PyGILState_Release(gstate);
+
+	yasp_free_json_str(job->jb_json);
+	job->jb_json = NULL;
+}
+
+static char *yasp_py_strdup(PyObject *o)
+{
+	const char *s;
+
+	if (o == Py_None)
+		return NULL;
+
+	s = PyUnicode_AsUTF8(o);
+	if (!s)
+		return NULL;
+
+	return strdup(s);
+}
+
+static void yasp_py_control_free(PyObject *capsule)
+{
+	free(PyCapsule_GetPointer(capsule, "yasp_control"));
+}
+
+static PyObject *yasp_py_control_new(void)
+{
+	struct yasp_control *ctl;
+	PyObject *handle;
+
+	ctl = calloc(1, sizeof(*ctl));
+	if (!ctl)
+		return PyErr_NoMemory();
+
+	handle = PyCapsule_New(ctl, "yasp_control", yasp_py_control_free);
+	if (!handle)
+		free(ctl);
+
+	return handle;
+}
+
+static PyObject *yasp_py_control_cancel(PyObject *handle)
+{
+	struct yasp_control *ctl;
+
+	ctl = PyCapsule_GetPointer(handle, "yasp_control");
+	if (!ctl)
+		return NULL;
+	ctl->ct_cancel = 1;
+
+	Py_RETURN_NONE;
+}
+
+static PyObject *yasp_py_batch(struct yasp_context *ctx, PyObject *pairs,
+			       int nworkers, PyObject *done_cb,
+			       PyObject *control)
+{
+	struct yasp_control *ctl = NULL;
+	struct yasp_py_batch_data pb;
+	PyObject *seq, *item;
+	struct yasp_job *jobs;
+	Py_ssize_t n, i;
+	int rc;
+
+	if (control != Py_None) {
+		ctl = PyCapsule_GetPointer(control, "yasp_control");
+		if (!ctl)
+			return NULL;
+	}
+
+	seq = PySequence_Fast(pairs, "expected a sequence of "
+			      "(audio, transcript) pairs");
+	if (!seq)
+		return NULL;
+
+	n = PySequence_Fast_GET_SIZE(seq);
+	jobs = calloc(n ? n : 1, sizeof(*jobs));
+	if (!jobs) {
+		Py_DECREF(seq);
+		return PyErr_NoMemory();
+	}
+
+	for (i = 0; i < n; i++) {
+		PyObject *audio, *transcript;
+
+		item = PySequence_Fast_GET_ITEM(seq, i);
+		if (!PyArg_ParseTuple(item, "OO", &audio, &transcript))
+			goto fail;
+		jobs[i].jb_ctl = ctl;
+		jobs[i].jb_audio = yasp_py_strdup(audio);
+		if (!jobs[i].jb_audio)
+			goto fail;
+		jobs[i].jb_transcript = yasp_py_strdup(transcript);
+		if (!jobs[i].jb_transcript && transcript != Py_None)
+			goto fail;
+	}
+	Py_DECREF(seq);
+	seq = NULL;
+
+	pb.pb_jobs = jobs;
+	pb.pb_cb = done_cb;
+
+	Py_BEGIN_ALLOW_THREADS
+	rc = yasp_context_batch(ctx, jobs, (int) n, nworkers,
+				yasp_py_job_done, &pb);
+	Py_END_ALLOW_THREADS
+
+	for (i = 0; i < n; i++) {
+		free((char *) jobs[i].jb_audio);
+		free((char *) jobs[i].jb_transcript);
+	}
+	free(jobs);
+
+	return PyLong_FromLong(rc);
+
+fail:
+	if (!PyErr_Occurred())
+		PyErr_SetString(PyExc_TypeError, "bad (audio, transcript) pair");
+	for (i = 0; i < n; i++) {
+		free((char *) jobs[i].jb_audio);
+		free((char *) jobs[i].jb_transcript);
+	}
+	free(jobs);
+	Py_XDECREF(seq);
+	return NULL;
+}
+
+/*
+ * In-memory audio support.
+ *
+ * pcm is any object exporting the buffer protocol: bytes, bytearray,
+ * array('h'), a numpy int16 array, ... It must be C contiguous 16-bit
+ * native endian mono samples, or raw bytes holding the same. The
+ * buffer is handed to the decoder as is, no copy is made.
+ */
+/*
+ * Only samples in the host's byte order are decoded right: "h" or "H"
+ * alone, or behind a prefix that means native order.
+ */
+static int yasp_py_native_int16(const char *format)
+{
+	if (!format)
+		return 0;
+
+	if (*format == '@' || *format == '=' ||
+	    (*format == '<' && PY_LITTLE_ENDIAN) ||
+	    ((*format == '>' || *format == '!') && !PY_LITTLE_ENDIAN))
+		format++;
+
+	return (*format == 'h' || *format == 'H') && !format[1];
+}
+
+static PyObject *yasp_py_interpret_pcm(struct yasp_context *ctx,
+				       PyObject *pcm, int samprate,
+				       PyObject *text)
+{
+	const char *ctext = NULL;
+	Py_buffer view;
+	char *json;
+	PyObject *res;
+
+	if (text != Py_None) {
+		ctext = PyUnicode_AsUTF8(text);
+		if (!ctext)
+			return NULL;
+	}
+
+	if (PyObject_GetBuffer(pcm, &view, PyBUF_C_CONTIGUOUS | PyBUF_FORMAT))
+		return NULL;
+
+	if (!((view.itemsize == 2 && yasp_py_native_int16(view.format)) ||
+	      (view.itemsize == 1 && view.len % 2 == 0))) {
+		PyBuffer_Release(&view);
+		PyErr_SetString(PyExc_TypeError,
+				"expected 16-bit PCM samples");
+		return NULL;
+	}
+
+	/*
+	 * text and the buffer stay referenced by our caller for the
+	 * duration of the call, so they are safe to use without the GIL
+	 */
+	Py_BEGIN_ALLOW_THREADS
+	json = yasp_context_interpret_pcm_get_str(ctx, view.buf, view.len / 2,
+						  samprate, ctext, NULL);
+	Py_END_ALLOW_THREADS
+
+	PyBuffer_Release(&view);
+
+	if (!json)
+		Py_RETURN_NONE;
+
+	res = PyUnicode_FromString(json);
+	yasp_free_json_str(json);
+
+	return res;
+}
+
+/*
+ * Keyword spotting support. The keyword strings are borrowed from the
+ * list, which the caller keeps alive for the duration of the call.
+ */
+static PyObject *yasp_py_spot_keywords(struct yasp_context *ctx,
+				       const char *audio, PyObject *keywords,
+				       double threshold)
+{
+	const char **ckeywords;
+	PyObject *seq, *res;
+	Py_ssize_t i, n;
+	char *json;
+
+	seq = PySequence_Fast(keywords, "keywords must be a sequence");
+	if (!seq)
+		return NULL;
+
+	n = PySequence_Fast_GET_SIZE(seq);
+	ckeywords = calloc(n + 1, sizeof(*ckeywords));
+	if (!ckeywords) {
+		Py_DECREF(seq);
+		return PyErr_NoMemory();
+	}
+
+	for (i = 0; i < n; i++) {
+		ckeywords[i] = PyUnicode_AsUTF8(PySequence_Fast_GET_ITEM(seq,
+									 i));
+		if (!ckeywords[i]) {
+			free(ckeywords);
+			Py_DECREF(seq);
+			return NULL;
+		}
+	}
+
+	Py_BEGIN_ALLOW_THREADS
+	json = yasp_context_spot_keywords_get_str(ctx, audio, ckeywords,
+						  (int) n, threshold);
+	Py_END_ALLOW_THREADS
+
+	free(ckeywords);
+	Py_DECREF(seq);
+
+	if (!json)
+		Py_RETURN_NONE;
+
+	res = PyUnicode_FromString(json);
+	yasp_free_json_str(json);
+
+	return res;
+}
+
+static PyObject *yasp_py_align_candidates(struct yasp_context *ctx,
+					  const char *audio, PyObject *texts,
+					  int nworkers)
+{
+	const char **ctexts;
+	PyObject *seq, *res;
+	Py_ssize_t i, n;
+	char *json;
+
+	seq = PySequence_Fast(texts, "texts must be a sequence");
+	if (!seq)
+		return NULL;
+
+	n = PySequence_Fast_GET_SIZE(seq);
+	ctexts = calloc(n + 1, sizeof(*ctexts));
+	if (!ctexts) {
+		Py_DECREF(seq);
+		return PyErr_NoMemory();
+	}
+
+	for (i = 0; i < n; i++) {
+		ctexts[i] = PyUnicode_AsUTF8(PySequence_Fast_GET_ITEM(seq, i));
+		if (!ctexts[i]) {
+			free(ctexts);
+			Py_DECREF(seq);
+			return NULL;
+		}
+	}
+
+	Py_BEGIN_ALLOW_THREADS
+	json = yasp_context_align_candidates_get_str(ctx, audio, ctexts,
+						     (int) n, nworkers);
+	Py_END_ALLOW_THREADS
+
+	free(ctexts);
+	Py_DECREF(seq);
+
+	if (!json)
+		Py_RETURN_NONE;
+
+	res = PyUnicode_FromString(json);
+	yasp_free_json_str(json);
+
+	return res;
+}
+
+/*
+ * Preview and refinement. The refinement reports back from its own
+ * thread, so its callback takes the GIL like the batch one. The handle
+ * is a capsule that waits for the refinement when it's released.
+ */
+struct yasp_py_refine {
+	struct yasp_refine *pr_refine;
+	PyObject *pr_cb;
+};
+
+static void yasp_py_refined(const char *json, int rc, void *user_data)
+{
+	struct yasp_py_refine *pr = user_data;
+	PyGILState_STATE gstate;
+	PyObject *res;
+
+	gstate = PyGILState_Ensure();
+	if (json)
+		res = PyObject_CallFunction(pr->pr_cb, "s", json);
+	else
+		res = PyObject_CallFunction(pr->pr_cb, "O", Py_None);
+	if (!res)
+		PyErr_Print();
+	else
+		Py_DECREF(res);
+	PyGILState_Release(gstate);
+}
+
+static int yasp_py_refine_join(struct yasp_py_refine *pr)
+{
+	struct yasp_refine *refine = pr->pr_refine;
+	int rc = 0;
+
+	if (!refine)
+		return 0;
+	pr->pr_refine = NULL;
+
+	Py_BEGIN_ALLOW_THREADS
+	rc = yasp_refine_wait(refine);
+	Py_END_ALLOW_THREADS
+
+	return rc;
+}
+
+static void yasp_py_refine_free(PyObject *capsule)
+{
+	struct yasp_py_refine *pr;
+
+	pr = PyCapsule_GetPointer(capsule, "yasp_refine");
+	if (!pr)
+		return;
+
+	yasp_py_refine_join(pr);
+	Py_XDECREF(pr->pr_cb);
+	free(pr);
+}
+
+static PyObject *yasp_py_preview(struct yasp_context *ctx,
+				 const char *audio, PyObject *text,
+				 PyObject *refined_cb)
+{
+	struct yasp_py_refine *pr = NULL;
+	PyObject *handle = Py_None;
+	const char *ctext = NULL;
+	PyObject *res;
+	char *json;
+
+	if (text != Py_None) {
+		ctext = PyUnicode_AsUTF8(text);
+		if (!ctext)
+			return NULL;
+	}
+
+	if (refined_cb != Py_None) {
+		pr = calloc(1, sizeof(*pr));
+		if (!pr)
+			return PyErr_NoMemory();
+		Py_INCREF(refined_cb);
+		pr->pr_cb = refined_cb;
+	}
+
+	Py_BEGIN_ALLOW_THREADS
+	json = yasp_context_preview(ctx, audio, ctext,
+				    pr ? yasp_py_refined : NULL, pr,
+				    pr ? &pr->pr_refine : NULL);
+	Py_END_ALLOW_THREADS
+
+	if (pr && json) {
+		handle = PyCapsule_New(pr, "yasp_refine",
+				       yasp_py_refine_free);
+		if (!handle) {
+			yasp_py_refine_join(pr);
+			Py_DECREF(pr->pr_cb);
+			free(pr);
+			yasp_free_json_str(json);
+			return NULL;
+		}
+	} else if (pr) {
+		Py_DECREF(pr->pr_cb);
+		free(pr);
+	}
+
+	if (handle == Py_None)
+		Py_INCREF(handle);
+
+	if (json)
+		res = Py_BuildValue("(sN)", json, handle);
+	else
+		res = Py_BuildValue("(ON)", Py_None, handle);
+	yasp_free_json_str(json);
+
+	return res;
+}
+
+static PyObject *yasp_py_refine_wait(PyObject *handle)
+{
+	struct yasp_py_refine *pr;
+
+	pr = PyCapsule_GetPointer(handle, "yasp_refine");
+	if (!pr)
+		return NULL;
+
+	return PyLong_FromLong(yasp_py_refine_join(pr));
+}
+
+/*
+ * Cancellation and progress support.
+ *
+ * Between chunks of the decode the GIL is taken to ask cancel, a
+ * threading.Event, whether it's set and to report progress(frames,
+ * total). A true return from progress cancels too. A cancelled decode
+ * returns None, one that runs out of time raises TimeoutError.
+ */
+struct yasp_py_control {
+	struct yasp_control pc_ctl;
+	PyObject *pc_progress;
+	PyObject *pc_cancel;
+};
+
+static int yasp_py_call_true(PyObject *res)
+{
+	int rc;
+
+	if (!res) {
+		PyErr_Print();
+		return 0;
+	}
+	rc = PyObject_IsTrue(res) == 1;
+	Py_DECREF(res);
+
+	return rc;
+}
+
+static int yasp_py_progress(int frames, int total, void *user_data)
+{
+	struct yasp_py_control *pc = user_data;
+	PyGILState_STATE gstate;
+	int stop = 0;
+
+	gstate = PyGILState_Ensure();
+	if (pc->pc_cancel != Py_None)
+		stop = yasp_py_call_true(PyObject_CallMethod(pc->pc_cancel,
+							     "is_set", NULL));
+	if (!stop && pc->pc_progress != Py_None)
+		stop = yasp_py_call_true(PyObject_CallFunction(pc->pc_progress,
+							       "ii", frames,
+							       total));
+	PyGILState_Release(gstate);
+
+	return stop;
+}
+
+static PyObject *yasp_py_interpret(struct yasp_context *ctx,
+				   const char *audio, PyObject *transcript,
+				   PyObject *text, const char *genpath,
+				   double timeout, PyObject *progress,
+				   PyObject *cancel)
+{
+	const char *ctranscript = NULL, *ctext = NULL;
+	struct yasp_py_control pc;
+	PyObject *res;
+	char *json;
+	int rc;
+
+	if (transcript != Py_None) {
+		ctranscript = PyUnicode_AsUTF8(transcript);
+		if (!ctranscript)
+			return NULL;
+	}
+	if (text != Py_None) {
+		ctext = PyUnicode_AsUTF8(text);
+		if (!ctext)
+			return NULL;
+	}
+
+	memset(&pc, 0, sizeof(pc));
+	pc.pc_ctl.ct_timeout = timeout;
+	pc.pc_progress = progress;
+	pc.pc_cancel = cancel;
+	if (progress != Py_None || cancel != Py_None) {
+		pc.pc_ctl.ct_progress = yasp_py_progress;
+		pc.pc_ctl.ct_user_data = &pc;
+	}
+
+	/* the caller holds on to every object for the duration */
+	Py_BEGIN_ALLOW_THREADS
+	rc = yasp_context_interpret_ctl(ctx, audio, ctranscript, ctext,
+					genpath, &pc.pc_ctl, &json);
+	Py_END_ALLOW_THREADS
+
+	if (rc == -ETIMEDOUT)
+		return PyErr_Format(PyExc_TimeoutError,
+				    "aligning %s took over %g seconds",
+				    audio, timeout);
+	if (rc || !json)
+		Py_RETURN_NONE;
+
+	res = PyUnicode_FromString(json);
+	yasp_free_json_str(json);
+
+	return res;
+}
+
+/*
+ * Transcript checking. The first call reads the dictionary, so the GIL
+ * is released for it like for decoding.
+ */
+static PyObject *yasp_py_check_transcript(const char *text)
+{
+	struct yasp_oov *oovs;
+	PyObject *res, *item;
+	int i, n;
+
+	Py_BEGIN_ALLOW_THREADS
+	n = yasp_check_transcript(text, &oovs);
+	Py_END_ALLOW_THREADS
+
+	if (n < 0) {
+		PyErr_SetString(PyExc_RuntimeError,
+				"failed to read the dictionary");
+		return NULL;
+	}
+
+	res = PyList_New(n);
+	for (i = 0; res && i < n; i++) {
+		item = Py_BuildValue("(siii)", oovs[i].ov_word,
+				     oovs[i].ov_index, oovs[i].ov_line,
+				     oovs[i].ov_column);
+		if (!item) {
+			Py_CLEAR(res);
+			break;
+		}
+		PyList_SET_ITEM(res, i, item);
+	}
+	yasp_free_oovs(oovs, n);
+
+	return res;
+}
 %}
 
+%newobject yasp_interpret_get_str;
+%newobject yasp_context_interpret_get_str;
+%newobject yasp_context_interpret_text_get_str;
+%newobject yasp_context_interpret_allphone_get_str;
+%newobject yasp_context_realign_get_str;
+%typemap(newfree) char * "yasp_free_json_str($1);";
+
 struct yasp_logs {
 	FILE *lg_error;
 	FILE *lg_info;
@@ -48,15 +779,317 @@ typedef enum err_e {
 
 typedef void (*err_cb_f)(void * user_data, err_lvl_t, const char *, ...);
 
-extern int yasp_interpret(const char *audioFile, const char *transcript,
-                          const char *output, const char *genpath);
-extern char *yasp_interpret_get_str(const char *audioFile,
-                                    const char *transcript,
-                                    const char *genpath);
+/*
+ * Everything below is cheap, keep the GIL.
+ */
+%nothread;
+
 extern void yasp_setup_logging(struct yasp_logs *logs, err_cb_f cb,
                                const char *logfile);
 extern void yasp_finish_logging(struct yasp_logs *logs);
 extern void yasp_set_modeldir(const char *modeldir);
 extern void yasp_free_json_str(char *json);
-extern void yasp_set_modeldir(const char *modeldir);
 
+/*
+ * yasp_setup_py_logging(cb)
+ *	cb(level, message) is called for every log line. Pass None to
+ *	turn logging off again.
+ */
+extern void yasp_setup_py_logging(PyObject *cb);
+
+struct yasp_context;
+
+extern void yasp_context_destroy(struct yasp_context *ctx);
+
+/*
+ * yasp_py_batch(ctx, pairs, nworkers, done_cb, control)
+ *	Releases the GIL itself while the batch runs. control is None
+ *	or from yasp_py_control_new(), cancelling it fails the jobs not
+ *	started yet. Use Context.batch() rather than calling this
+ *	directly.
+ */
+extern PyObject *yasp_py_batch(struct yasp_context *ctx, PyObject *pairs,
+                               int nworkers, PyObject *done_cb,
+                               PyObject *control);
+extern PyObject *yasp_py_control_new(void);
+extern PyObject *yasp_py_control_cancel(PyObject *handle);
+
+/*
+ * yasp_py_interpret_pcm(ctx, pcm, samprate, text)
+ *	Releases the GIL itself while decoding. Use
+ *	Context.interpret_pcm() rather than calling this directly.
+ */
+extern PyObject *yasp_py_interpret_pcm(struct yasp_context *ctx,
+                                       PyObject *pcm, int samprate,
+                                       PyObject *text);
+
+/*
+ * yasp_py_spot_keywords(ctx, audio, keywords, threshold)
+ *	Releases the GIL itself while decoding. Use Context.spot()
+ *	rather than calling this directly.
+ */
+extern PyObject *yasp_py_spot_keywords(struct yasp_context *ctx,
+                                       const char *audio,
+                                       PyObject *keywords,
+                                       double threshold);
+
+/*
+ * yasp_py_align_candidates(ctx, audio, texts, nworkers)
+ *	Releases the GIL itself while aligning. Use
+ *	Context.align_candidates() rather than calling this directly.
+ */
+extern PyObject *yasp_py_align_candidates(struct yasp_context *ctx,
+                                          const char *audio,
+                                          PyObject *texts, int nworkers);
+
+/*
+ * yasp_py_preview(ctx, audio, text, refined_cb)
+ * yasp_py_refine_wait(handle)
+ *	Release the GIL themselves. Use Context.preview() and
+ *	Context.wait_refined() rather than calling these directly.
+ */
+extern PyObject *yasp_py_preview(struct yasp_context *ctx,
+                                 const char *audio, PyObject *text,
+                                 PyObject *refined_cb);
+extern PyObject *yasp_py_refine_wait(PyObject *handle);
+
+/*
+ * yasp_py_interpret(ctx, audio, transcript, text, genpath, timeout,
+ *		     progress, cancel)
+ *	Releases the GIL itself while decoding. Use Context.interpret()
+ *	rather than calling this directly.
+ */
+extern PyObject *yasp_py_interpret(struct yasp_context *ctx,
+                                   const char *audio, PyObject *transcript,
+                                   PyObject *text, const char *genpath,
+                                   double timeout, PyObject *progress,
+                                   PyObject *cancel);
+
+/*
+ * yasp_py_check_transcript(text)
+ *	Returns a list of (word, index, line, column) for every word of
+ *	text missing from the dictionary. Use check_transcript().
+ */
+extern PyObject *yasp_py_check_transcript(const char *text);
+
+/*
+ * Decoding can take seconds. Release the GIL for the duration of the
+ * call so other Python threads, and the Blender UI, keep running.
+ */
+%thread;
+
+extern int yasp_interpret(const char *audioFile, const char *transcript,
+                          const char *output, const char *genpath);
+extern char *yasp_interpret_get_str(const char *audioFile,
+                                    const char *transcript,
+                                    const char *genpath);
+extern struct yasp_context *yasp_context_create(const char *modeldir);
+extern struct yasp_context *yasp_context_create_profile(const char *modeldir,
+                                                       const char *spec);
+extern int yasp_context_interpret(struct yasp_context *ctx,
+                                  const char *audioFile,
+                                  const char *transcript,
+                                  const char *output, const char *genpath);
+extern char *yasp_context_interpret_get_str(struct yasp_context *ctx,
+                                            const char *audioFile,
+                                            const char *transcript,
+                                            const char *genpath);
+extern char *yasp_context_interpret_text_get_str(struct yasp_context *ctx,
+                                                 const char *audioFile,
+                                                 const char *text,
+                                                 const char *genpath);
+extern char *yasp_context_interpret_allphone_get_str(struct yasp_context *ctx,
+                                                     const char *audioFile);
+extern char *yasp_context_realign_get_str(struct yasp_context *ctx,
+                                          const char *audioFile,
+                                          const char *json,
+                                          const char *text);
+
+%nothread;
+
+%pythoncode %{
+import queue as _queue
+import threading as _threading
+
+def check_transcript(text):
+    """
+    The words of the transcript text that alignment would reject as
+    unknown, as (word, index, line, column) tuples. Only the
+    dictionary is read, no models are loaded.
+    """
+    return yasp_py_check_transcript(text)
+
+class Context(object):
+    """
+    Persistent yasp context. The models are loaded once when the
+    context is created and reused by every call made through it.
+    """
+    def __init__(self, modeldir=None, profile=None, **settings):
+        """
+        profile is "preview", "default" or "precise". settings
+        override single values of it, e.g. beam=1e-40, topn=4. The
+        names are those of struct yasp_decoder_params without dp_.
+        """
+        self._refines = []
+        self._batches = []
+        spec = [profile] if profile else []
+        spec += ["%s=%s" % kv for kv in settings.items()]
+        self._ctx = yasp_context_create_profile(modeldir,
+                                                ",".join(spec) or None)
+        if not self._ctx:
+            raise RuntimeError("failed to create yasp context")
+
+    def close(self):
+        if self._ctx:
+            self.wait_refined()
+            # native batch workers may still be using the context
+            for runner in list(self._batches):
+                runner.join()
+            yasp_context_destroy(self._ctx)
+            self._ctx = None
+
+    def __enter__(self):
+        return self
+
+    def __exit__(self, *exc):
+        self.close()
+
+    def __del__(self):
+        self.close()
+
+    def interpret(self, audio, transcript=None, genpath=None, text=None,
+                  progress=None, timeout=0, cancel=None):
+        """
+        Align a single clip and return the JSON string, or None.
+        The transcript can be given either as a path, or as a string
+        through text.
+
+        progress(frames, total) is called about once per second of
+        audio, from the decoding thread. Setting cancel, a
+        threading.Event, or returning True from progress stops the
+        decode and None is returned. If it runs for more than timeout
+        seconds TimeoutError is raised.
+        """
+        if progress or timeout or cancel:
+            if text is not None:
+                transcript = None
+            return yasp_py_interpret(self._ctx, audio, transcript, text,
+                                     genpath, timeout, progress, cancel)
+        if text is not None:
+            return yasp_context_interpret_text_get_str(self._ctx, audio,
+                                                       text, genpath)
+        return yasp_context_interpret_get_str(self._ctx, audio,
+                                              transcript, genpath)
+
+    def interpret_pcm(self, pcm, samprate=16000, text=None):
+        """
+        Align 16-bit mono PCM held in memory, anything supporting the
+        buffer protocol. text is the transcript string, if any.
+        Returns the JSON string, or None.
+        """
+        return yasp_py_interpret_pcm(self._ctx, pcm, samprate, text)
+
+    def preview(self, audio, text=None, refined=None):
+        """
+        A rough alignment of audio to show right away, as a JSON
+        string, or None. text is the transcript string, without it
+        only phonemes come back. If refined is given, the full
+        alignment then runs in the background on the preview's
+        features and refined(json) is called from another thread when
+        it's done, json None if it failed.
+        """
+        json, handle = yasp_py_preview(self._ctx, audio, text, refined)
+        if handle is not None:
+            self._refines.append(handle)
+        return json
+
+    def wait_refined(self):
+        """Wait for every refinement started by preview() to finish"""
+        while self._refines:
+            yasp_py_refine_wait(self._refines.pop())
+
+    def allphone(self, audio):
+        """
+        Phoneme timing only, in a single pass without recognizing any
+        words. Returns the JSON string, with the phonemes in a top
+        level "phonemes" array, or None.
+        """
+        return yasp_context_interpret_allphone_get_str(self._ctx, audio)
+
+    def realign(self, audio, previous, text):
+        """
+        Update previous, the JSON string of an earlier alignment of
+        audio, to the edited transcript text. Only the audio around
+        the words that changed is aligned again. Returns the JSON
+        string, or None.
+        """
+        return yasp_context_realign_get_str(self._ctx, audio, previous,
+                                            text)
+
+    def spot(self, audio, keywords, threshold=0):
+        """
+        Find when any of the keywords, a list of words or phrases, are
+        spoken in audio without transcribing the rest of it. Returns
+        the JSON string of hits, each with its start, duration and
+        confidence, or None.
+        """
+        return yasp_py_spot_keywords(self._ctx, audio, list(keywords),
+                                     threshold)
+
+    def align_candidates(self, audio, texts, workers=4):
+        """
+        Align each of several alternative transcript strings against
+        the same audio. The features are computed once and shared.
+        Returns the JSON string with a result and acoustic score per
+        candidate, null for any that failed, and the index of the
+        best match, or None.
+        """
+        return yasp_py_align_candidates(self._ctx, audio, list(texts),
+                                        workers)
+
+    def interpret_file(self, audio, output, transcript=None, genpath=None):
+        """Align a single clip and write the JSON to output"""
+        return yasp_context_interpret(self._ctx, audio, transcript,
+                                      output, genpath)
+
+    def batch(self, jobs, workers=4):
+        """
+        Align a list of (audio, transcript) pairs on native worker
+        threads. transcript may be None. Yields (index, json) tuples in
+        completion order, json is None if the job failed. A bad pair
+        raises once the batch is over. Stopping early cancels the jobs
+        not started yet and stops those being decoded, close() waits
+        for any batch still running.
+        """
+        results = _queue.Queue()
+        done = object()
+        errors = []
+        control = yasp_py_control_new()
+
+        def run():
+            try:
+                yasp_py_batch(self._ctx, list(jobs), workers,
+                              lambda i, json: results.put((i, json)),
+                              control)
+            except BaseException as e:
+                errors.append(e)
+            finally:
+                results.put(done)
+
+        runner = _threading.Thread(target=run, daemon=True)
+        self._batches.append(runner)
+        runner.start()
+        try:
+            while True:
+                item = results.get()
+                if item is done:
+                    break
+                yield item
+        finally:
+            # the workers use the context until they've all returned
+            yasp_py_control_cancel(control)
+            runner.join()
+            self._batches.remove(runner)
+        if errors:
+            raise errors[0]
+%}
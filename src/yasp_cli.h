@@ -0,0 +1,62 @@
+/*
+  Copyright (c) 2019 Amir Shehata
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in
+  all copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+  THE SOFTWARE.
+*/
+
+/*
+ * Sub-commands of the yasp command line tool. They aren't part of
+ * libyasp.
+ */
+
+#ifndef YASP_CLI_H
+#define YASP_CLI_H
+
+#include "yasp.h"
+
+/*
+ * yasp_serve
+ *	yasp serve [options]. Runs the alignment daemon until it's
+ *	interrupted.
+ */
+int yasp_serve(int argc, char *argv[]);
+
+/*
+ * yasp_index_cmd
+ *	yasp index [options] <index> <command> ...
+ * yasp_index_results
+ *	add the output of every successful job to the index at path
+ */
+int yasp_index_cmd(int argc, char *argv[]);
+int yasp_index_results(const char *path, struct yasp_job *jobs, int njobs);
+
+/*
+ * yasp_compile_dict_cmd
+ *	yasp compile-dict [-m <modeldir>] [-o <output>] [<dict>]
+ */
+int yasp_compile_dict_cmd(int argc, char *argv[]);
+
+/*
+ * yasp_check_cmd
+ *	yasp check [-m <modeldir>] [-c <cache>] <transcript> ... Exits
+ *	with 1 if any word is missing from the dictionary and cache.
+ */
+int yasp_check_cmd(int argc, char *argv[]);
+
+#endif /* YASP_CLI_H */
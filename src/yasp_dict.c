@@ -0,0 +1,1007 @@
+/*
+  Copyright (c) 2019 Amir Shehata
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in
+  all copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+  THE SOFTWARE.
+*/
+
+/*
+ * The pronunciation dictionary, for pulling out the entries of a
+ * handful of words without building a full decoder dictionary.
+ *
+ * The text dictionary is read in whole and split in place. Entries are
+ * sorted on their base word, the part before any "(2)", with alternates
+ * kept in file order after the base entry, and looked up with a binary
+ * search.
+ *
+ * The compiled dictionary holds the same entries, ready to be mapped
+ * and used without parsing anything. All integers are in host byte
+ * order:
+ *	dict_header
+ *	nphones x uint32	offset of each phone name in the strings
+ *	nbuckets x uint32	1 + index of the first entry of a base word,
+ *				0 for an empty bucket
+ *	nwords x dict_bin_entry
+ *	phone ids, one byte each
+ *	strings, NUL terminated
+ * The buckets are an open addressed hash table over the base words,
+ * probed linearly and never more than half full.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <pocketsphinx.h>
+#include <hash_table.h>
+#include "strfuncs.h"
+#include "yasp.h"
+#include "yasp_dict.h"
+#include "yasp_text.h"
+
+#define DICT_MAGIC		"YASPDIC1"
+#define DICT_VERSION		1
+#define DICT_SUFFIX		".bin"
+#define DICT_MAX_PHONES		256
+
+struct dict_header {
+	char dh_magic[8];
+	uint32 dh_version;
+	uint32 dh_nphones;
+	uint32 dh_nwords;
+	uint32 dh_nbuckets;
+	/* section offsets from the start of the file */
+	uint32 dh_phones;
+	uint32 dh_buckets;
+	uint32 dh_entries;
+	uint32 dh_seqs;
+	uint32 dh_strings;
+	uint32 dh_size;
+};
+
+struct dict_bin_entry {
+	uint32 be_word;
+	uint32 be_seq;
+	uint32 be_nphones;
+};
+
+struct dict_entry {
+	const char *de_word;
+	const char *de_phones;
+};
+
+struct yasp_dict {
+	char *yd_path;
+	struct yasp_dict *yd_next;
+	/* text */
+	char *yd_buf;
+	struct dict_entry *yd_entries;
+	uint32 yd_n;
+	/* compiled */
+	void *yd_map;
+	size_t yd_mapsize;
+	const struct dict_header *yd_hdr;
+};
+
+/*
+ * Pronunciations for words the dictionary doesn't have, kept in a
+ * file per project in the same format as the dictionary. Each entry is
+ * "word\0phones" in one allocation, hashed on the word.
+ */
+struct pron_cache {
+	char *pc_path;
+	hash_table_t *pc_hash;
+	char **pc_entries;
+	uint32 pc_n;
+	uint32 pc_size;
+};
+
+static struct yasp_dict *g_dicts;
+static pthread_mutex_t g_dicts_lock = PTHREAD_MUTEX_INITIALIZER;
+static struct pron_cache *g_cache;
+static pthread_mutex_t g_cache_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/* compare up to the alternate suffix */
+static int base_cmp(const char *a, const char *b)
+{
+	while (*a && *a != '(' && *a == *b) {
+		a++;
+		b++;
+	}
+
+	return (unsigned char) (*a == '(' ? '\0' : *a) -
+	       (unsigned char) (*b == '(' ? '\0' : *b);
+}
+
+/* FNV-1a over the base word */
+static uint32 base_hash(const char *word)
+{
+	uint32 h = 2166136261u;
+
+	for (; *word && *word != '('; word++)
+		h = (h ^ (unsigned char) *word) * 16777619u;
+
+	return h;
+}
+
+static int dict_entry_cmp(const void *a, const void *b)
+{
+	const struct dict_entry *ea = a, *eb = b;
+	int rc;
+
+	rc = base_cmp(ea->de_word, eb->de_word);
+	if (rc)
+		return rc;
+
+	/* entries point into one buffer, so this keeps file order */
+	return ea->de_word < eb->de_word ? -1 : ea->de_word > eb->de_word;
+}
+
+static void dict_free(struct yasp_dict *dict)
+{
+	if (!dict)
+		return;
+
+	if (dict->yd_map)
+		munmap(dict->yd_map, dict->yd_mapsize);
+	free(dict->yd_path);
+	free(dict->yd_buf);
+	free(dict->yd_entries);
+	free(dict);
+}
+
+static char *read_text(const char *path)
+{
+	char *buf = NULL;
+	size_t len = 0;
+	FILE *fh;
+
+	fh = fopen(path, "r");
+	if (!fh) {
+		E_ERROR("unable to open %s. errno = %s\n", path,
+			strerror(errno));
+		return NULL;
+	}
+
+	if (getdelim(&buf, &len, '\0', fh) < 0) {
+		E_ERROR("unable to read %s\n", path);
+		free(buf);
+		buf = NULL;
+	}
+	fclose(fh);
+
+	return buf;
+}
+
+static struct yasp_dict *dict_load_text(const char *path)
+{
+	struct yasp_dict *dict;
+	char *line, *cur, *phones;
+	uint32 size = 0;
+
+	dict = calloc(1, sizeof(*dict));
+	if (!dict)
+		goto nomem;
+
+	dict->yd_path = strdup(path);
+	if (!dict->yd_path)
+		goto nomem;
+
+	dict->yd_buf = read_text(path);
+	if (!dict->yd_buf)
+		goto fail;
+
+	cur = dict->yd_buf;
+	while ((line = strsep(&cur, "\n"))) {
+		line += strspn(line, " \t\r");
+		if (!line[0] || !strncmp(line, ";;", 2))
+			continue;
+
+		phones = line + strcspn(line, " \t");
+		if (!*phones)
+			continue;
+		*phones++ = '\0';
+		phones += strspn(phones, " \t");
+		phones[strcspn(phones, "\r#")] = '\0';
+
+		if (dict->yd_n == size) {
+			struct dict_entry *entries;
+
+			entries = realloc(dict->yd_entries,
+					  (size * 2 + 1024) * sizeof(*entries));
+			if (!entries)
+				goto nomem;
+			dict->yd_entries = entries;
+			size = size * 2 + 1024;
+		}
+
+		dict->yd_entries[dict->yd_n].de_word = line;
+		dict->yd_entries[dict->yd_n].de_phones = phones;
+		dict->yd_n++;
+	}
+
+	qsort(dict->yd_entries, dict->yd_n, sizeof(*dict->yd_entries),
+	      dict_entry_cmp);
+
+	return dict;
+
+nomem:
+	E_ERROR("out of memory\n");
+fail:
+	dict_free(dict);
+	return NULL;
+}
+
+static bool section_ok(const struct dict_header *hdr, uint32 off,
+		       uint32 n, uint32 size)
+{
+	return off <= hdr->dh_size && n <= (hdr->dh_size - off) / size;
+}
+
+static struct yasp_dict *dict_load_bin(const char *path, const char *text)
+{
+	const struct dict_header *hdr;
+	struct yasp_dict *dict;
+	struct stat st;
+	void *map;
+	int fd;
+
+	fd = open(path, O_RDONLY);
+	if (fd < 0) {
+		E_ERROR("unable to open %s. errno = %s\n", path,
+			strerror(errno));
+		return NULL;
+	}
+
+	if (fstat(fd, &st) || st.st_size < (off_t) sizeof(*hdr)) {
+		E_ERROR("%s isn't a compiled dictionary\n", path);
+		close(fd);
+		return NULL;
+	}
+
+	map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (map == MAP_FAILED) {
+		E_ERROR("unable to map %s. errno = %s\n", path,
+			strerror(errno));
+		return NULL;
+	}
+
+	/*
+	 * Only the layout is checked here. Entries are checked as they
+	 * are looked up, so loading stays independent of the size.
+	 */
+	hdr = map;
+	if (memcmp(hdr->dh_magic, DICT_MAGIC, sizeof(hdr->dh_magic)) ||
+	    hdr->dh_version != DICT_VERSION ||
+	    (off_t) hdr->dh_size != st.st_size ||
+	    hdr->dh_nbuckets & (hdr->dh_nbuckets - 1) ||
+	    !hdr->dh_nbuckets ||
+	    !section_ok(hdr, hdr->dh_phones, hdr->dh_nphones, sizeof(uint32)) ||
+	    !section_ok(hdr, hdr->dh_buckets, hdr->dh_nbuckets,
+			sizeof(uint32)) ||
+	    !section_ok(hdr, hdr->dh_entries, hdr->dh_nwords,
+			sizeof(struct dict_bin_entry)) ||
+	    hdr->dh_seqs > hdr->dh_strings ||
+	    hdr->dh_strings >= hdr->dh_size ||
+	    ((const char *) map)[hdr->dh_size - 1]) {
+		E_ERROR("%s is corrupt or from another version\n", path);
+		munmap(map, st.st_size);
+		return NULL;
+	}
+
+	dict = calloc(1, sizeof(*dict));
+	if (dict)
+		dict->yd_path = strdup(text);
+	if (!dict || !dict->yd_path) {
+		E_ERROR("out of memory\n");
+		munmap(map, st.st_size);
+		free(dict);
+		return NULL;
+	}
+
+	dict->yd_map = map;
+	dict->yd_mapsize = st.st_size;
+	dict->yd_hdr = hdr;
+
+	return dict;
+}
+
+static struct yasp_dict *dict_load(const char *path)
+{
+	struct stat text_st, bin_st;
+	struct yasp_dict *dict;
+	char *bin;
+
+	bin = string_join(path, DICT_SUFFIX, NULL);
+	if (!bin)
+		return NULL;
+
+	if (!stat(bin, &bin_st) &&
+	    (stat(path, &text_st) || bin_st.st_mtime >= text_st.st_mtime)) {
+		dict = dict_load_bin(bin, path);
+		if (dict) {
+			ckd_free(bin);
+			return dict;
+		}
+	} else if (!access(bin, F_OK)) {
+		E_WARN("%s is older than %s, ignoring it\n", bin, path);
+	}
+	ckd_free(bin);
+
+	return dict_load_text(path);
+}
+
+struct yasp_dict *yasp_dict_get(const char *modeldir)
+{
+	struct yasp_dict *dict;
+	char *path;
+
+	if (!modeldir)
+		modeldir = yasp_get_modeldir();
+
+	path = string_join(modeldir, "/en-us/cmudict-en-us.dict", NULL);
+	if (!path)
+		return NULL;
+
+	pthread_mutex_lock(&g_dicts_lock);
+	for (dict = g_dicts; dict; dict = dict->yd_next) {
+		if (!strcmp(dict->yd_path, path))
+			break;
+	}
+	if (!dict) {
+		dict = dict_load(path);
+		if (dict) {
+			dict->yd_next = g_dicts;
+			g_dicts = dict;
+		}
+	}
+	pthread_mutex_unlock(&g_dicts_lock);
+
+	ckd_free(path);
+
+	return dict;
+}
+
+static int lookup_text(struct yasp_dict *dict, const char *word,
+		       yasp_dict_pron_f cb, void *user_data)
+{
+	uint32 lo = 0, hi = dict->yd_n, mid;
+	int n = 0, rc;
+
+	while (lo < hi) {
+		mid = lo + (hi - lo) / 2;
+		if (base_cmp(dict->yd_entries[mid].de_word, word) < 0)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+
+	for (; lo < dict->yd_n &&
+	     !base_cmp(dict->yd_entries[lo].de_word, word); lo++) {
+		if (cb) {
+			rc = cb(dict->yd_entries[lo].de_word,
+				dict->yd_entries[lo].de_phones, user_data);
+			if (rc)
+				return rc;
+		}
+		n++;
+	}
+
+	return n;
+}
+
+/* spell out the phone ids of an entry, -1 if it's out of bounds */
+static int bin_phones(const struct dict_header *hdr,
+		      const struct dict_bin_entry *be, char *buf, size_t len)
+{
+	const char *base = (const char *) hdr;
+	const uint32 *names = (const uint32 *) (base + hdr->dh_phones);
+	const char *strings = base + hdr->dh_strings;
+	const uint8 *seq;
+	size_t off = 0, n;
+	uint32 i;
+
+	if (be->be_seq > hdr->dh_strings - hdr->dh_seqs ||
+	    be->be_nphones > hdr->dh_strings - hdr->dh_seqs - be->be_seq)
+		return -1;
+
+	seq = (const uint8 *) base + hdr->dh_seqs + be->be_seq;
+	buf[0] = '\0';
+	for (i = 0; i < be->be_nphones; i++) {
+		if (seq[i] >= hdr->dh_nphones ||
+		    names[seq[i]] >= hdr->dh_size - hdr->dh_strings)
+			return -1;
+		n = snprintf(buf + off, len - off, "%s%s", i ? " " : "",
+			     strings + names[seq[i]]);
+		if (n >= len - off)
+			return -1;
+		off += n;
+	}
+
+	return 0;
+}
+
+static int lookup_bin(struct yasp_dict *dict, const char *word,
+		      yasp_dict_pron_f cb, void *user_data)
+{
+	const struct dict_header *hdr = dict->yd_hdr;
+	const char *base = (const char *) hdr;
+	const uint32 *buckets = (const uint32 *) (base + hdr->dh_buckets);
+	const struct dict_bin_entry *entries, *be;
+	const char *strings = base + hdr->dh_strings;
+	uint32 mask = hdr->dh_nbuckets - 1;
+	uint32 h, probes, first = 0, strsize;
+	char phones[YASP_DICT_MAX_PRON];
+	int n = 0, rc;
+
+	entries = (const struct dict_bin_entry *) (base + hdr->dh_entries);
+	strsize = hdr->dh_size - hdr->dh_strings;
+
+	h = base_hash(word) & mask;
+	for (probes = 0; probes <= mask; probes++, h = (h + 1) & mask) {
+		first = buckets[h];
+		if (!first || first > hdr->dh_nwords)
+			return 0;
+		if (entries[first - 1].be_word < strsize &&
+		    !base_cmp(strings + entries[first - 1].be_word, word))
+			break;
+	}
+	if (probes > mask)
+		return 0;
+
+	for (be = &entries[first - 1]; be < entries + hdr->dh_nwords; be++) {
+		if (be->be_word >= strsize ||
+		    base_cmp(strings + be->be_word, word))
+			break;
+		if (cb) {
+			if (bin_phones(hdr, be, phones, sizeof(phones))) {
+				E_ERROR("corrupt entry for %s in %s%s\n", word,
+					dict->yd_path, DICT_SUFFIX);
+				return -EIO;
+			}
+			rc = cb(strings + be->be_word, phones, user_data);
+			if (rc)
+				return rc;
+		}
+		n++;
+	}
+
+	return n;
+}
+
+int yasp_dict_lookup(struct yasp_dict *dict, const char *word,
+		     yasp_dict_pron_f cb, void *user_data)
+{
+	if (!dict || !word)
+		return -EINVAL;
+
+	if (dict->yd_hdr)
+		return lookup_bin(dict, word, cb, user_data);
+
+	return lookup_text(dict, word, cb, user_data);
+}
+
+static void cache_free(struct pron_cache *pc)
+{
+	uint32 i;
+
+	if (!pc)
+		return;
+
+	for (i = 0; i < pc->pc_n; i++)
+		free(pc->pc_entries[i]);
+	free(pc->pc_entries);
+	if (pc->pc_hash)
+		hash_table_free(pc->pc_hash);
+	free(pc->pc_path);
+	free(pc);
+}
+
+static int cache_insert(struct pron_cache *pc, const char *word,
+			const char *phones)
+{
+	size_t wlen = strlen(word) + 1;
+	char **entries, *entry;
+
+	if (pc->pc_n == pc->pc_size) {
+		entries = realloc(pc->pc_entries,
+				  (pc->pc_size * 2 + 64) * sizeof(*entries));
+		if (!entries)
+			return -ENOMEM;
+		pc->pc_entries = entries;
+		pc->pc_size = pc->pc_size * 2 + 64;
+	}
+
+	entry = malloc(wlen + strlen(phones) + 1);
+	if (!entry)
+		return -ENOMEM;
+	memcpy(entry, word, wlen);
+	strcpy(entry + wlen, phones);
+
+	/* later lines win, like hand edits appended to the file */
+	pc->pc_entries[pc->pc_n++] = entry;
+	hash_table_replace(pc->pc_hash, entry, entry);
+
+	return 0;
+}
+
+static struct pron_cache *cache_load(const char *path)
+{
+	struct pron_cache *pc;
+	char *buf = NULL, *cur, *line, *phones;
+
+	pc = calloc(1, sizeof(*pc));
+	if (!pc)
+		goto nomem;
+
+	pc->pc_path = strdup(path);
+	pc->pc_hash = hash_table_new(256, HASH_CASE_YES);
+	if (!pc->pc_path || !pc->pc_hash)
+		goto nomem;
+
+	/* created when the first pronunciation is added */
+	if (access(path, F_OK))
+		return pc;
+
+	buf = read_text(path);
+	if (!buf)
+		goto fail;
+
+	cur = buf;
+	while ((line = strsep(&cur, "\n"))) {
+		line += strspn(line, " \t\r");
+		if (!line[0] || !strncmp(line, ";;", 2))
+			continue;
+
+		phones = line + strcspn(line, " \t");
+		if (!*phones)
+			continue;
+		*phones++ = '\0';
+		phones += strspn(phones, " \t");
+		phones[strcspn(phones, "\r#")] = '\0';
+		if (!phones[0])
+			continue;
+
+		if (cache_insert(pc, line, phones))
+			goto nomem;
+	}
+	free(buf);
+
+	return pc;
+
+nomem:
+	E_ERROR("out of memory\n");
+fail:
+	free(buf);
+	cache_free(pc);
+	return NULL;
+}
+
+int yasp_set_pron_cache(const char *path)
+{
+	struct pron_cache *pc = NULL;
+
+	if (path) {
+		pc = cache_load(path);
+		if (!pc)
+			return -1;
+	}
+
+	pthread_mutex_lock(&g_cache_lock);
+	cache_free(g_cache);
+	g_cache = pc;
+	pthread_mutex_unlock(&g_cache_lock);
+
+	return 0;
+}
+
+int yasp_pron_cache_lookup(const char *word, char *phones, size_t len)
+{
+	void *entry;
+	int rc = -ENOENT;
+
+	pthread_mutex_lock(&g_cache_lock);
+	if (g_cache && !hash_table_lookup(g_cache->pc_hash, word, &entry)) {
+		snprintf(phones, len, "%s",
+			 (char *) entry + strlen(entry) + 1);
+		rc = 0;
+	}
+	pthread_mutex_unlock(&g_cache_lock);
+
+	return rc;
+}
+
+int yasp_pron_cache_add(const char *word, const char *phones)
+{
+	FILE *fh;
+	int rc = 0;
+
+	pthread_mutex_lock(&g_cache_lock);
+	if (!g_cache)
+		goto out;
+
+	rc = cache_insert(g_cache, word, phones);
+	if (rc) {
+		E_ERROR("out of memory\n");
+		goto out;
+	}
+
+	fh = fopen(g_cache->pc_path, "a");
+	if (!fh) {
+		E_ERROR("unable to update %s. errno = %s\n",
+			g_cache->pc_path, strerror(errno));
+		rc = -errno;
+		goto out;
+	}
+	fprintf(fh, "%s %s\n", word, phones);
+	if (fclose(fh))
+		rc = -EIO;
+
+out:
+	pthread_mutex_unlock(&g_cache_lock);
+
+	return rc;
+}
+
+/*
+ * The filler words the decoder adds from the acoustic model's noise
+ * dictionary, plus the ones it always has, as " <s> </s> ... ".
+ */
+static char *read_fillers(const char *modeldir)
+{
+	char *path, *buf, *cur, *line, *fillers;
+	size_t len;
+
+	path = string_join(modeldir, "/en-us/en-us/noisedict", NULL);
+	if (!path)
+		return NULL;
+
+	/* a missing noise dictionary leaves the built in fillers */
+	buf = access(path, F_OK) ? strdup("") : read_text(path);
+	ckd_free(path);
+	if (!buf)
+		return NULL;
+
+	fillers = malloc(strlen(buf) + sizeof(" <s> </s> <sil> "));
+	if (!fillers) {
+		free(buf);
+		return NULL;
+	}
+
+	strcpy(fillers, " <s> </s> <sil> ");
+	len = strlen(fillers);
+	cur = buf;
+	while ((line = strsep(&cur, "\n"))) {
+		line += strspn(line, " \t\r");
+		line[strcspn(line, " \t\r")] = '\0';
+		if (!line[0] || !strncmp(line, ";;", 2))
+			continue;
+		len += sprintf(fillers + len, "%s ", line);
+	}
+	free(buf);
+
+	return fillers;
+}
+
+static bool is_filler(const char *fillers, const char *word)
+{
+	const char *p = fillers;
+	size_t len = strlen(word);
+
+	while ((p = strstr(p + 1, word))) {
+		if (p[-1] == ' ' && p[len] == ' ')
+			return true;
+	}
+
+	return false;
+}
+
+int yasp_check_transcript(const char *text, struct yasp_oov **oovs)
+{
+	struct yasp_oov *list = NULL, *tmp;
+	char phones[YASP_DICT_MAX_PRON];
+	struct yasp_tokens ts = { 0 };
+	struct yasp_token *tk;
+	struct yasp_dict *dict;
+	const char *modeldir;
+	char *fillers;
+	int n = 0, size = 0;
+	uint32 i;
+
+	if (!text || !oovs) {
+		E_ERROR("bad parameter\n");
+		return -EINVAL;
+	}
+
+	*oovs = NULL;
+	modeldir = yasp_get_modeldir();
+	dict = yasp_dict_get(modeldir);
+	if (!dict)
+		return -ENOENT;
+
+	fillers = read_fillers(modeldir);
+	if (!fillers || yasp_tokenize(text, strlen(text), &ts))
+		goto nomem;
+
+	for (i = 0; i < ts.ts_n; i++) {
+		tk = &ts.ts_tokens[i];
+		if (is_filler(fillers, tk->tk_word) ||
+		    yasp_dict_lookup(dict, tk->tk_word, NULL, NULL) > 0 ||
+		    !yasp_pron_cache_lookup(tk->tk_word, phones,
+					    sizeof(phones)))
+			continue;
+
+		if (n == size) {
+			tmp = realloc(list, (size * 2 + 8) * sizeof(*list));
+			if (!tmp)
+				goto nomem;
+			list = tmp;
+			size = size * 2 + 8;
+		}
+
+		list[n].ov_word = strdup(tk->tk_word);
+		if (!list[n].ov_word)
+			goto nomem;
+		list[n].ov_index = i;
+		list[n].ov_line = tk->tk_line;
+		list[n].ov_column = tk->tk_column;
+		n++;
+	}
+
+	free(fillers);
+	yasp_tokens_free(&ts);
+	*oovs = list;
+
+	return n;
+
+nomem:
+	E_ERROR("out of memory\n");
+	free(fillers);
+	yasp_tokens_free(&ts);
+	yasp_free_oovs(list, n);
+	return -ENOMEM;
+}
+
+int yasp_check_transcript_file(const char *transcript,
+			       struct yasp_oov **oovs)
+{
+	char *text;
+	int rc;
+
+	if (!transcript || !oovs) {
+		E_ERROR("bad parameter\n");
+		return -EINVAL;
+	}
+
+	text = read_text(transcript);
+	if (!text)
+		return -ENOENT;
+
+	rc = yasp_check_transcript(text, oovs);
+	free(text);
+
+	return rc;
+}
+
+void yasp_free_oovs(struct yasp_oov *oovs, int n)
+{
+	int i;
+
+	if (!oovs)
+		return;
+
+	for (i = 0; i < n; i++)
+		free(oovs[i].ov_word);
+	free(oovs);
+}
+
+static int phone_id(const char **names, uint32 *nnames, const char *phone)
+{
+	uint32 i;
+
+	for (i = 0; i < *nnames; i++) {
+		if (!strcmp(names[i], phone))
+			return i;
+	}
+
+	if (*nnames == DICT_MAX_PHONES) {
+		E_ERROR("more than %d distinct phones\n", DICT_MAX_PHONES);
+		return -1;
+	}
+
+	names[(*nnames)++] = phone;
+
+	return i;
+}
+
+/* *buf is left alone, and still the caller's to free, on failure */
+static int section_grow(void **buf, uint32 *size, uint32 need)
+{
+	void *p;
+
+	if (need <= *size)
+		return 0;
+
+	p = realloc(*buf, need * 2);
+	if (!p)
+		return -ENOMEM;
+	*buf = p;
+	*size = need * 2;
+
+	return 0;
+}
+
+int yasp_compile_dict(const char *dict, const char *out)
+{
+	struct dict_header hdr = { DICT_MAGIC };
+	struct dict_bin_entry *entries = NULL;
+	struct yasp_dict *text = NULL;
+	const char *names[DICT_MAX_PHONES];
+	uint32 *buckets = NULL, *name_offs = NULL;
+	uint8 *seqs = NULL;
+	char *strings = NULL, *path = NULL, *bin = NULL, *tmp = NULL;
+	char *cur, *phone;
+	uint32 seqs_size = 0, seqs_len = 0, str_size = 0, str_len = 0;
+	uint32 i, h, nbase = 0, nnames = 0, len;
+	FILE *fh = NULL;
+	int id, rc = -1;
+
+	if (!dict)
+		dict = path = string_join(yasp_get_modeldir(),
+					  "/en-us/cmudict-en-us.dict", NULL);
+	if (!out && dict)
+		out = bin = string_join(dict, DICT_SUFFIX, NULL);
+	if (out)
+		tmp = string_join(out, ".tmp", NULL);
+	if (!dict || !out || !tmp)
+		goto nomem;
+
+	text = dict_load_text(dict);
+	if (!text)
+		goto out;
+
+	for (i = 0; i < text->yd_n; i++) {
+		if (!i || base_cmp(text->yd_entries[i - 1].de_word,
+				   text->yd_entries[i].de_word))
+			nbase++;
+	}
+
+	hdr.dh_version = DICT_VERSION;
+	hdr.dh_nwords = text->yd_n;
+	for (hdr.dh_nbuckets = 16; hdr.dh_nbuckets < nbase * 2;)
+		hdr.dh_nbuckets *= 2;
+
+	entries = calloc(text->yd_n + 1, sizeof(*entries));
+	buckets = calloc(hdr.dh_nbuckets, sizeof(*buckets));
+	if (!entries || !buckets)
+		goto nomem;
+
+	for (i = 0; i < text->yd_n; i++) {
+		const char *word = text->yd_entries[i].de_word;
+
+		len = strlen(word) + 1;
+		if (section_grow((void **) &strings, &str_size,
+				 str_len + len))
+			goto nomem;
+		memcpy(strings + str_len, word, len);
+		entries[i].be_word = str_len;
+		str_len += len;
+
+		/* the text buffer is ours, split the phones in place */
+		entries[i].be_seq = seqs_len;
+		cur = (char *) text->yd_entries[i].de_phones;
+		while ((phone = strsep(&cur, " \t"))) {
+			if (!phone[0])
+				continue;
+			id = phone_id(names, &nnames, phone);
+			if (id < 0)
+				goto out;
+			if (section_grow((void **) &seqs, &seqs_size,
+					 seqs_len + 1))
+				goto nomem;
+			seqs[seqs_len++] = id;
+			entries[i].be_nphones++;
+		}
+
+		/* the first entry of a base word goes in the table */
+		if (i && !base_cmp(text->yd_entries[i - 1].de_word, word))
+			continue;
+		h = base_hash(word) & (hdr.dh_nbuckets - 1);
+		while (buckets[h])
+			h = (h + 1) & (hdr.dh_nbuckets - 1);
+		buckets[h] = i + 1;
+	}
+
+	name_offs = calloc(nnames + 1, sizeof(*name_offs));
+	if (!name_offs)
+		goto nomem;
+	for (i = 0; i < nnames; i++) {
+		len = strlen(names[i]) + 1;
+		if (section_grow((void **) &strings, &str_size,
+				 str_len + len))
+			goto nomem;
+		memcpy(strings + str_len, names[i], len);
+		name_offs[i] = str_len;
+		str_len += len;
+	}
+
+	hdr.dh_nphones = nnames;
+	hdr.dh_phones = sizeof(hdr);
+	hdr.dh_buckets = hdr.dh_phones + nnames * sizeof(uint32);
+	hdr.dh_entries = hdr.dh_buckets + hdr.dh_nbuckets * sizeof(uint32);
+	hdr.dh_seqs = hdr.dh_entries + text->yd_n * sizeof(*entries);
+	hdr.dh_strings = hdr.dh_seqs + seqs_len;
+	hdr.dh_size = hdr.dh_strings + str_len;
+
+	fh = fopen(tmp, "wb");
+	if (!fh) {
+		E_ERROR("unable to write %s. errno = %s\n", tmp,
+			strerror(errno));
+		rc = -errno;
+		goto out;
+	}
+
+	if (fwrite(&hdr, sizeof(hdr), 1, fh) != 1 ||
+	    fwrite(name_offs, sizeof(*name_offs), nnames, fh) != nnames ||
+	    fwrite(buckets, sizeof(*buckets), hdr.dh_nbuckets, fh) !=
+	    hdr.dh_nbuckets ||
+	    fwrite(entries, sizeof(*entries), text->yd_n, fh) != text->yd_n ||
+	    fwrite(seqs, 1, seqs_len, fh) != seqs_len ||
+	    fwrite(strings, 1, str_len, fh) != str_len) {
+		E_ERROR("Failed to write %s\n", tmp);
+		goto out;
+	}
+
+	rc = fclose(fh) ? -1 : 0;
+	fh = NULL;
+	if (!rc && rename(tmp, out)) {
+		E_ERROR("unable to replace %s. errno = %s\n", out,
+			strerror(errno));
+		rc = -errno;
+	}
+	if (!rc)
+		E_INFO("compiled %u pronunciations of %u words into %s\n",
+		       text->yd_n, nbase, out);
+	goto out;
+
+nomem:
+	E_ERROR("out of memory\n");
+	rc = -ENOMEM;
+out:
+	if (fh)
+		fclose(fh);
+	if (rc && tmp)
+		unlink(tmp);
+	ckd_free(path);
+	ckd_free(bin);
+	ckd_free(tmp);
+	dict_free(text);
+	free(entries);
+	free(buckets);
+	free(name_offs);
+	free(seqs);
+	free(strings);
+
+	return rc;
+}
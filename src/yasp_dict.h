@@ -0,0 +1,89 @@
+/*
+  Copyright (c) 2019 Amir Shehata
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in
+  all copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+  THE SOFTWARE.
+*/
+
+/*
+ * Pronunciation lookups for libyasp. Not part of the public API.
+ */
+
+#ifndef YASP_DICT_H
+#define YASP_DICT_H
+
+#include "yasp.h"
+
+/* the longest pronunciation, as a space separated string, handed out */
+#define YASP_DICT_MAX_PRON	1024
+
+struct yasp_dict;
+
+/*
+ * yasp_dict_pron_f
+ *	called once per pronunciation of a word. word carries the
+ *	alternate suffix, "read(2)", phones are space separated. A non
+ *	zero return stops the lookup and is passed back.
+ */
+typedef int (*yasp_dict_pron_f)(const char *word, const char *phones,
+				void *user_data);
+
+/*
+ * yasp_get_modeldir
+ *	the directory set with yasp_set_modeldir(), or the default one
+ */
+const char *yasp_get_modeldir(void);
+
+/*
+ * yasp_dict_get
+ *	the pronunciation dictionary of modeldir (the default model
+ *	directory if NULL). The compiled form next to the text one is
+ *	used when it's at least as new, otherwise the text is read and
+ *	indexed. Loaded once per process and kept until exit.
+ */
+struct yasp_dict *yasp_dict_get(const char *modeldir);
+
+/*
+ * yasp_dict_lookup
+ *	call cb, which may be NULL, for every pronunciation of word.
+ *	Returns the number of pronunciations, 0 when the word isn't in
+ *	the dictionary, or what cb returned.
+ */
+int yasp_dict_lookup(struct yasp_dict *dict, const char *word,
+		     yasp_dict_pron_f cb, void *user_data);
+
+/*
+ * yasp_pron_cache_lookup
+ *	copy the pronunciation of word in the cache set with
+ *	yasp_set_pron_cache() into phones. Returns -ENOENT when there's
+ *	no cache or word isn't in it.
+ * yasp_pron_cache_add
+ *	add a pronunciation to the cache, in memory and at the end of
+ *	the file.
+ */
+int yasp_pron_cache_lookup(const char *word, char *phones, size_t len);
+int yasp_pron_cache_add(const char *word, const char *phones);
+
+/*
+ * yasp_g2p
+ *	guess a pronunciation for word from its spelling. Returns -1 if
+ *	there's nothing to go on or it doesn't fit in len.
+ */
+int yasp_g2p(const char *word, char *phones, size_t len);
+
+#endif /* YASP_DICT_H */
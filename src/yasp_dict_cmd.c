@@ -0,0 +1,134 @@
+/*
+  Copyright (c) 2019 Amir Shehata
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in
+  all copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+  THE SOFTWARE.
+*/
+
+/*
+ * Dictionary tools.
+ *
+ * yasp compile-dict: compile a text pronunciation dictionary into the
+ * binary lexicon libyasp maps at start-up.
+ *
+ *	run compile-dict [-m <modeldir>] [-o <output>] [<dict>]
+ *
+ * yasp check: list every word of the transcripts that isn't in the
+ * dictionary, without loading the acoustic model.
+ *
+ *	run check [-m <modeldir>] [-c <pronunciation cache>] <transcript> ...
+ */
+
+#include <getopt.h>
+#include <stdlib.h>
+#include <pocketsphinx.h>
+#include "yasp.h"
+#include "yasp_cli.h"
+
+static void dict_usage(void)
+{
+	printf("Usage: \n"
+	       "run compile-dict [-m </path/to/modeldir>] "
+	       "[-o </path/to/output>] [</path/to/dict>]\n"
+	       "The model directory's dictionary is compiled if none is "
+	       "given, and the output\ndefaults to the dictionary path "
+	       "with .bin appended.\n");
+}
+
+int yasp_compile_dict_cmd(int argc, char *argv[])
+{
+	const char *out = NULL;
+	int opt;
+
+	while ((opt = getopt(argc, argv, "m:o:h")) != -1) {
+		switch (opt) {
+		case 'm':
+			yasp_set_modeldir(optarg);
+			break;
+		case 'o':
+			out = optarg;
+			break;
+		case 'h':
+			dict_usage();
+			return -1;
+		default:
+			E_ERROR("Unknown command line option\n");
+			return -1;
+		}
+	}
+
+	if (argc - optind > 1) {
+		dict_usage();
+		return -1;
+	}
+
+	return yasp_compile_dict(argc > optind ? argv[optind] : NULL, out);
+}
+
+static void check_usage(void)
+{
+	printf("Usage: \n"
+	       "run check [-m </path/to/modeldir>] [-c </path/to/cache>] "
+	       "</path/to/transcript> [...]\n"
+	       "Prints file:line:column: word for every word missing from "
+	       "the dictionary.\n");
+}
+
+int yasp_check_cmd(int argc, char *argv[])
+{
+	struct yasp_oov *oovs;
+	int opt, i, j, n;
+	int rc = 0;
+
+	while ((opt = getopt(argc, argv, "m:c:h")) != -1) {
+		switch (opt) {
+		case 'm':
+			yasp_set_modeldir(optarg);
+			break;
+		case 'c':
+			if (yasp_set_pron_cache(optarg))
+				return -1;
+			break;
+		case 'h':
+			check_usage();
+			return -1;
+		default:
+			E_ERROR("Unknown command line option\n");
+			return -1;
+		}
+	}
+
+	if (optind == argc) {
+		check_usage();
+		return -1;
+	}
+
+	for (i = optind; i < argc; i++) {
+		n = yasp_check_transcript_file(argv[i], &oovs);
+		if (n < 0)
+			return n;
+		for (j = 0; j < n; j++)
+			printf("%s:%d:%d: %s\n", argv[i], oovs[j].ov_line,
+			       oovs[j].ov_column, oovs[j].ov_word);
+		if (n)
+			rc = 1;
+		yasp_free_oovs(oovs, n);
+	}
+
+	return rc;
+}
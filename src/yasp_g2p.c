@@ -0,0 +1,203 @@
+/*
+  Copyright (c) 2019 Amir Shehata
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in
+  all copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+  THE SOFTWARE.
+*/
+
+/*
+ * Letter to sound rules, for words that aren't in the pronunciation
+ * dictionary. They're rough, the aim is a pronunciation close enough
+ * for the aligner to place the word, not a correct one.
+ *
+ * The word is lower-cased and anything that isn't a letter dropped.
+ * At each letter the longest rule that matches, in table order, is
+ * taken. Silent final e, doubled consonants, soft c and g, and the
+ * long vowel of a vowel-consonant-e ending are handled in code.
+ */
+
+#include <ctype.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+#include <pocketsphinx.h>
+#include "yasp.h"
+#include "yasp_dict.h"
+
+#define G2P_MAX_WORD	128
+
+#define G2P_ANY		0
+#define G2P_START	1
+#define G2P_END		2
+
+struct g2p_rule {
+	const char *gr_letters;
+	const char *gr_phones;
+	int gr_where;
+};
+
+/* longer spellings first, single letters are handled in g2p_letter() */
+static const struct g2p_rule g2p_rules[] = {
+	{ "eigh", "EY", G2P_ANY },
+	{ "augh", "AO", G2P_ANY },
+	{ "ough", "AO", G2P_ANY },
+	{ "tion", "SH AH N", G2P_ANY },
+	{ "sion", "ZH AH N", G2P_ANY },
+	{ "ture", "CH ER", G2P_ANY },
+	{ "igh", "AY", G2P_ANY },
+	{ "tch", "CH", G2P_ANY },
+	{ "sch", "S K", G2P_ANY },
+	{ "ch", "CH", G2P_ANY },
+	{ "sh", "SH", G2P_ANY },
+	{ "th", "TH", G2P_ANY },
+	{ "ph", "F", G2P_ANY },
+	{ "wh", "W", G2P_ANY },
+	{ "ck", "K", G2P_ANY },
+	{ "ng", "NG", G2P_ANY },
+	{ "qu", "K W", G2P_ANY },
+	{ "kn", "N", G2P_START },
+	{ "wr", "R", G2P_START },
+	{ "gn", "N", G2P_START },
+	{ "ey", "IY", G2P_END },
+	{ "ie", "IY", G2P_END },
+	{ "ee", "IY", G2P_ANY },
+	{ "ea", "IY", G2P_ANY },
+	{ "oo", "UW", G2P_ANY },
+	{ "ou", "AW", G2P_ANY },
+	{ "ow", "OW", G2P_ANY },
+	{ "ai", "EY", G2P_ANY },
+	{ "ay", "EY", G2P_ANY },
+	{ "ei", "EY", G2P_ANY },
+	{ "ey", "EY", G2P_ANY },
+	{ "oi", "OY", G2P_ANY },
+	{ "oy", "OY", G2P_ANY },
+	{ "au", "AO", G2P_ANY },
+	{ "aw", "AO", G2P_ANY },
+	{ "oa", "OW", G2P_ANY },
+	{ "ue", "UW", G2P_ANY },
+	{ "ew", "UW", G2P_ANY },
+	{ "ar", "AA R", G2P_ANY },
+	{ "er", "ER", G2P_ANY },
+	{ "ir", "ER", G2P_ANY },
+	{ "ur", "ER", G2P_ANY },
+	{ "or", "AO R", G2P_ANY },
+	{ NULL, NULL, 0 },
+};
+
+static bool is_vowel(char c)
+{
+	return c && strchr("aeiou", c);
+}
+
+static bool is_front(char c)
+{
+	return c && strchr("eiy", c);
+}
+
+static const char *g2p_letter(const char *w, int i, int n)
+{
+	/* a vowel, a single consonant and a final e */
+	bool magic = i + 2 == n - 1 && w[n - 1] == 'e' &&
+		     !is_vowel(w[i + 1]) && w[i + 1] != 'r';
+
+	switch (w[i]) {
+	case 'a': return magic ? "EY" : i == n - 1 ? "AH" : "AE";
+	case 'e': return magic ? "IY" : "EH";
+	case 'i': return magic ? "AY" : "IH";
+	case 'o': return magic || i == n - 1 ? "OW" : "AA";
+	case 'u': return magic ? "UW" : "AH";
+	case 'y':
+		if (!i)
+			return "Y";
+		return i == n - 1 ? "IY" : magic ? "AY" : "IH";
+	case 'b': return "B";
+	case 'c': return is_front(w[i + 1]) ? "S" : "K";
+	case 'd': return "D";
+	case 'f': return "F";
+	case 'g': return is_front(w[i + 1]) ? "JH" : "G";
+	case 'h': return "HH";
+	case 'j': return "JH";
+	case 'k': return "K";
+	case 'l': return "L";
+	case 'm': return "M";
+	case 'n': return "N";
+	case 'p': return "P";
+	case 'q': return "K";
+	case 'r': return "R";
+	case 's': return "S";
+	case 't': return "T";
+	case 'v': return "V";
+	case 'w': return "W";
+	case 'x': return i ? "K S" : "Z";
+	case 'z': return "Z";
+	}
+
+	return NULL;
+}
+
+int yasp_g2p(const char *word, char *phones, size_t len)
+{
+	const struct g2p_rule *rule;
+	char w[G2P_MAX_WORD];
+	const char *p;
+	size_t off = 0, rlen;
+	int i, n = 0;
+
+	for (; *word && n < G2P_MAX_WORD - 1; word++) {
+		if (isalpha((unsigned char) *word))
+			w[n++] = tolower((unsigned char) *word);
+	}
+	w[n] = '\0';
+
+	phones[0] = '\0';
+	for (i = 0; i < n; i += rlen) {
+		p = NULL;
+		for (rule = g2p_rules; rule->gr_letters; rule++) {
+			rlen = strlen(rule->gr_letters);
+			if (strncmp(w + i, rule->gr_letters, rlen) ||
+			    (rule->gr_where == G2P_START && i) ||
+			    (rule->gr_where == G2P_END && i + rlen != n))
+				continue;
+			p = rule->gr_phones;
+			break;
+		}
+
+		if (!p) {
+			rlen = 1;
+			/* silent final e, "-le" gets its vowel from the l */
+			if (w[i] == 'e' && i == n - 1 && n > 2 &&
+			    !is_vowel(w[i - 1]))
+				continue;
+			if (i && w[i] == w[i - 1] && !is_vowel(w[i]))
+				continue;
+			if (w[i] == 'l' && i && i == n - 2 && w[n - 1] == 'e' &&
+			    !is_vowel(w[i - 1]))
+				p = "AH L";
+			else
+				p = g2p_letter(w, i, n);
+			if (!p)
+				continue;
+		}
+
+		if (off + strlen(p) + 2 > len)
+			return -1;
+		off += sprintf(phones + off, "%s%s", off ? " " : "", p);
+	}
+
+	return off ? 0 : -1;
+}
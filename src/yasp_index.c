@@ -0,0 +1,877 @@
+/*
+  Copyright (c) 2019 Amir Shehata
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in
+  all copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+  THE SOFTWARE.
+*/
+
+/*
+ * Inverted index of the words and phonemes across many aligned clips.
+ *
+ * Every term, a word or a phoneme n-gram, has a postings array of
+ * where it occurs: the clip, its position within the clip, and its
+ * timing. Clips get increasing ids as they are added, and the postings
+ * of a clip are appended in position order, so every postings array is
+ * sorted by (clip, position). A phrase is found by walking the first
+ * term's postings and binary searching the following terms for the
+ * next positions.
+ *
+ * Re-adding or removing a clip only retires its id. The retired
+ * postings are skipped by queries and dropped when the index is saved.
+ *
+ * On disk, all integers in host byte order:
+ *	"YASPIDX1" version phone_n nclips nwords nphones
+ *	nclips x { len name }
+ *	nwords x { len key npostings postings[] }
+ *	nphones x { len key npostings postings[] }
+ */
+
+#include <ctype.h>
+#include <errno.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <pocketsphinx.h>
+#include <hash_table.h>
+#include "list.h"
+#include "yasp.h"
+
+#define INDEX_MAGIC		"YASPIDX1"
+#define INDEX_VERSION		1
+#define INDEX_MAX_KEY		4096
+
+struct index_posting {
+	uint32 pt_clip;
+	uint32 pt_pos;
+	int32 pt_start;
+	int32 pt_duration;
+	float32 pt_conf;
+};
+
+struct index_term {
+	char *tm_key;
+	struct index_posting *tm_postings;
+	uint32 tm_n;
+	uint32 tm_size;
+};
+
+struct index_terms {
+	hash_table_t *it_hash;
+	struct index_term **it_terms;
+	uint32 it_n;
+	uint32 it_size;
+};
+
+struct yasp_index {
+	char *ix_path;
+	int ix_phone_n;
+	/* NULL for a retired clip */
+	char **ix_clips;
+	uint32 ix_nclips;
+	uint32 ix_clips_size;
+	struct index_terms ix_words;
+	struct index_terms ix_phones;
+};
+
+static int terms_init(struct index_terms *it)
+{
+	memset(it, 0, sizeof(*it));
+	it->it_hash = hash_table_new(1024, HASH_CASE_YES);
+
+	return it->it_hash ? 0 : -ENOMEM;
+}
+
+static void terms_fini(struct index_terms *it)
+{
+	uint32 i;
+
+	for (i = 0; i < it->it_n; i++) {
+		free(it->it_terms[i]->tm_key);
+		free(it->it_terms[i]->tm_postings);
+		free(it->it_terms[i]);
+	}
+	free(it->it_terms);
+	if (it->it_hash)
+		hash_table_free(it->it_hash);
+}
+
+static struct index_term *terms_find(struct index_terms *it, const char *key)
+{
+	void *term;
+
+	if (hash_table_lookup(it->it_hash, key, &term))
+		return NULL;
+
+	return term;
+}
+
+static struct index_term *terms_get(struct index_terms *it, const char *key)
+{
+	struct index_term *term, **terms;
+
+	term = terms_find(it, key);
+	if (term)
+		return term;
+
+	if (it->it_n == it->it_size) {
+		terms = realloc(it->it_terms,
+				(it->it_size * 2 + 64) * sizeof(*terms));
+		if (!terms)
+			return NULL;
+		it->it_terms = terms;
+		it->it_size = it->it_size * 2 + 64;
+	}
+
+	term = calloc(1, sizeof(*term));
+	if (!term)
+		return NULL;
+	term->tm_key = strdup(key);
+	if (!term->tm_key) {
+		free(term);
+		return NULL;
+	}
+
+	/* the table keeps a pointer to the key, which the term owns */
+	hash_table_enter(it->it_hash, term->tm_key, term);
+	it->it_terms[it->it_n++] = term;
+
+	return term;
+}
+
+static int term_append(struct index_term *term,
+		       const struct index_posting *pt)
+{
+	struct index_posting *postings;
+
+	if (term->tm_n == term->tm_size) {
+		postings = realloc(term->tm_postings,
+				   (term->tm_size * 2 + 8) *
+				   sizeof(*postings));
+		if (!postings)
+			return -ENOMEM;
+		term->tm_postings = postings;
+		term->tm_size = term->tm_size * 2 + 8;
+	}
+	term->tm_postings[term->tm_n++] = *pt;
+
+	return 0;
+}
+
+static const struct index_posting *
+term_lookup(const struct index_term *term, uint32 clip, uint32 pos)
+{
+	const struct index_posting *pt;
+	uint32 lo = 0, hi = term->tm_n, mid;
+
+	while (lo < hi) {
+		mid = lo + (hi - lo) / 2;
+		pt = &term->tm_postings[mid];
+		if (pt->pt_clip < clip ||
+		    (pt->pt_clip == clip && pt->pt_pos < pos))
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+
+	if (lo < term->tm_n && term->tm_postings[lo].pt_clip == clip &&
+	    term->tm_postings[lo].pt_pos == pos)
+		return &term->tm_postings[lo];
+
+	return NULL;
+}
+
+/*
+ * Words are indexed lower case and without the "(2)" marking an
+ * alternate pronunciation. Returns false for words that aren't worth
+ * indexing: sentence markers, silences and fillers.
+ */
+static bool word_key(const char *word, char *key, size_t size)
+{
+	size_t i;
+
+	if (!word[0] || word[0] == '<' || word[0] == '[' || word[0] == '+')
+		return false;
+
+	for (i = 0; word[i] && word[i] != '(' && i < size - 1; i++)
+		key[i] = tolower((unsigned char) word[i]);
+	key[i] = '\0';
+
+	return i > 0;
+}
+
+static bool phone_skip(const char *phone)
+{
+	return !strcmp(phone, "SIL") || phone[0] == '+';
+}
+
+static int index_clip_id(struct yasp_index *idx, const char *clip)
+{
+	uint32 i;
+
+	for (i = 0; i < idx->ix_nclips; i++) {
+		if (idx->ix_clips[i] && !strcmp(idx->ix_clips[i], clip))
+			return i;
+	}
+
+	return -1;
+}
+
+static int index_new_clip(struct yasp_index *idx, const char *clip)
+{
+	char **clips;
+
+	if (idx->ix_nclips == idx->ix_clips_size) {
+		clips = realloc(idx->ix_clips,
+				(idx->ix_clips_size * 2 + 16) *
+				sizeof(*clips));
+		if (!clips)
+			return -ENOMEM;
+		idx->ix_clips = clips;
+		idx->ix_clips_size = idx->ix_clips_size * 2 + 16;
+	}
+
+	idx->ix_clips[idx->ix_nclips] = strdup(clip);
+	if (!idx->ix_clips[idx->ix_nclips])
+		return -ENOMEM;
+
+	return idx->ix_nclips++;
+}
+
+static int index_add_phones(struct yasp_index *idx, uint32 clip,
+			    struct list_head *phoneme_list)
+{
+	struct yasp_word **window, *phoneme;
+	struct index_posting pt;
+	struct index_term *term;
+	char key[INDEX_MAX_KEY];
+	int n = idx->ix_phone_n;
+	uint32 pos = 0;
+	size_t len;
+	int i, rc = 0;
+
+	window = calloc(n, sizeof(*window));
+	if (!window)
+		return -ENOMEM;
+
+	list_for_each_entry(phoneme, phoneme_list, ph_on_list) {
+		if (phone_skip(phoneme->ph_word))
+			continue;
+
+		memmove(window, window + 1, (n - 1) * sizeof(*window));
+		window[n - 1] = phoneme;
+		if (++pos < (uint32) n)
+			continue;
+
+		len = 0;
+		for (i = 0; i < n && len < sizeof(key) - 1; i++)
+			len += snprintf(key + len, sizeof(key) - len, "%s%s",
+					i ? " " : "", window[i]->ph_word);
+
+		term = terms_get(&idx->ix_phones, key);
+		if (!term) {
+			rc = -ENOMEM;
+			break;
+		}
+
+		pt.pt_clip = clip;
+		pt.pt_pos = pos - n;
+		pt.pt_start = window[0]->ph_start;
+		pt.pt_duration = window[n - 1]->ph_start +
+				 window[n - 1]->ph_duration -
+				 window[0]->ph_start;
+		pt.pt_conf = 1;
+		rc = term_append(term, &pt);
+		if (rc)
+			break;
+	}
+
+	free(window);
+
+	return rc;
+}
+
+int yasp_index_add(struct yasp_index *idx, const char *clip,
+		   struct list_head *word_list,
+		   struct list_head *phoneme_list)
+{
+	struct index_posting pt;
+	struct index_term *term;
+	struct yasp_word *word;
+	char key[INDEX_MAX_KEY];
+	uint32 pos = 0;
+	int id, rc;
+
+	if (!idx || !clip || !word_list) {
+		E_ERROR("bad parameter\n");
+		return -EINVAL;
+	}
+
+	/* the new postings replace the old ones */
+	yasp_index_remove(idx, clip);
+
+	id = index_new_clip(idx, clip);
+	if (id < 0)
+		return id;
+
+	list_for_each_entry(word, word_list, ph_on_list) {
+		if (!word_key(word->ph_word, key, sizeof(key)))
+			continue;
+
+		term = terms_get(&idx->ix_words, key);
+		if (!term)
+			goto nomem;
+
+		pt.pt_clip = id;
+		pt.pt_pos = pos++;
+		pt.pt_start = word->ph_start;
+		pt.pt_duration = word->ph_duration;
+		pt.pt_conf = word->ph_prob;
+		if (term_append(term, &pt))
+			goto nomem;
+	}
+
+	if (idx->ix_phone_n > 0 && phoneme_list) {
+		rc = index_add_phones(idx, id, phoneme_list);
+		if (rc)
+			goto fail;
+	}
+
+	return 0;
+
+nomem:
+	rc = -ENOMEM;
+fail:
+	E_ERROR("Failed to index %s\n", clip);
+	/* don't leave a half indexed clip behind */
+	yasp_index_remove(idx, clip);
+	return rc;
+}
+
+int yasp_index_add_json(struct yasp_index *idx, const char *clip,
+			const char *json)
+{
+	struct list_head word_list, phoneme_list;
+	int rc;
+
+	INIT_LIST_HEAD(&word_list);
+	INIT_LIST_HEAD(&phoneme_list);
+
+	if (!json) {
+		E_ERROR("bad parameter\n");
+		return -EINVAL;
+	}
+
+	rc = yasp_parse_json(json, &word_list, &phoneme_list);
+	if (rc) {
+		E_ERROR("Malformed result for %s\n", clip);
+		return rc;
+	}
+
+	rc = yasp_index_add(idx, clip, &word_list, &phoneme_list);
+
+	yasp_free_segment_list(&word_list);
+	yasp_free_segment_list(&phoneme_list);
+
+	return rc;
+}
+
+int yasp_index_remove(struct yasp_index *idx, const char *clip)
+{
+	int id;
+
+	if (!idx || !clip)
+		return -EINVAL;
+
+	id = index_clip_id(idx, clip);
+	if (id < 0)
+		return -ENOENT;
+
+	free(idx->ix_clips[id]);
+	idx->ix_clips[id] = NULL;
+
+	return 0;
+}
+
+static int hits_add(struct yasp_index_hit **hits, int *nhits, int *size,
+		    const char *clip, int start, int end, double conf)
+{
+	struct yasp_index_hit *h;
+
+	if (*nhits == *size) {
+		h = realloc(*hits, (*size * 2 + 16) * sizeof(*h));
+		if (!h)
+			return -ENOMEM;
+		*hits = h;
+		*size = *size * 2 + 16;
+	}
+
+	h = &(*hits)[(*nhits)++];
+	h->ih_clip = clip;
+	h->ih_start = start;
+	h->ih_duration = end - start;
+	h->ih_conf = conf;
+
+	return 0;
+}
+
+/*
+ * terms[k] must occur at step * k positions after terms[0], for every
+ * k. Words step one position at a time, phoneme n-grams overlap so
+ * step by one phoneme as well.
+ */
+static int index_match(struct yasp_index *idx, struct index_term **terms,
+		       int nterms, struct yasp_index_hit **hits)
+{
+	const struct index_posting *first, *pt;
+	int nhits = 0, size = 0;
+	double conf;
+	uint32 i;
+	int k, end;
+
+	*hits = NULL;
+
+	for (i = 0; i < terms[0]->tm_n; i++) {
+		first = &terms[0]->tm_postings[i];
+		if (!idx->ix_clips[first->pt_clip])
+			continue;
+
+		conf = first->pt_conf;
+		end = first->pt_start + first->pt_duration;
+		for (k = 1; k < nterms; k++) {
+			pt = term_lookup(terms[k], first->pt_clip,
+					 first->pt_pos + k);
+			if (!pt)
+				break;
+			if (pt->pt_conf < conf)
+				conf = pt->pt_conf;
+			end = pt->pt_start + pt->pt_duration;
+		}
+		if (k < nterms)
+			continue;
+
+		if (hits_add(hits, &nhits, &size,
+			     idx->ix_clips[first->pt_clip],
+			     first->pt_start, end, conf)) {
+			free(*hits);
+			*hits = NULL;
+			return -ENOMEM;
+		}
+	}
+
+	return nhits;
+}
+
+int yasp_index_find(struct yasp_index *idx, const char *phrase,
+		    struct yasp_index_hit **hits)
+{
+	struct index_term **terms = NULL;
+	char key[INDEX_MAX_KEY];
+	char *copy, *cur, *tok;
+	int nterms = 0, n = 0;
+
+	if (!idx || !phrase || !hits) {
+		E_ERROR("bad parameter\n");
+		return -EINVAL;
+	}
+
+	*hits = NULL;
+
+	copy = strdup(phrase);
+	terms = calloc(strlen(phrase) / 2 + 1, sizeof(*terms));
+	if (!copy || !terms) {
+		n = -ENOMEM;
+		goto out;
+	}
+
+	cur = copy;
+	while ((tok = strsep(&cur, " \t\r\n"))) {
+		if (!word_key(tok, key, sizeof(key)))
+			continue;
+		terms[nterms] = terms_find(&idx->ix_words, key);
+		/* a word that was never seen, nothing can match */
+		if (!terms[nterms])
+			goto out;
+		nterms++;
+	}
+
+	if (nterms)
+		n = index_match(idx, terms, nterms, hits);
+
+out:
+	free(copy);
+	free(terms);
+
+	return n;
+}
+
+int yasp_index_find_phonemes(struct yasp_index *idx, const char *phonemes,
+			     struct yasp_index_hit **hits)
+{
+	struct index_term **terms = NULL;
+	char **phones = NULL;
+	char key[INDEX_MAX_KEY];
+	char *copy, *cur, *tok;
+	int nphones = 0, nterms, n = 0;
+	int i, k, pn;
+	size_t len;
+
+	if (!idx || !phonemes || !hits) {
+		E_ERROR("bad parameter\n");
+		return -EINVAL;
+	}
+
+	*hits = NULL;
+	pn = idx->ix_phone_n;
+	if (pn <= 0) {
+		E_ERROR("the index has no phoneme postings\n");
+		return -ENOENT;
+	}
+
+	copy = strdup(phonemes);
+	phones = calloc(strlen(phonemes) / 2 + 1, sizeof(*phones));
+	if (!copy || !phones) {
+		n = -ENOMEM;
+		goto out;
+	}
+
+	cur = copy;
+	while ((tok = strsep(&cur, " \t\r\n"))) {
+		if (!tok[0] || phone_skip(tok))
+			continue;
+		for (i = 0; tok[i]; i++)
+			tok[i] = toupper((unsigned char) tok[i]);
+		phones[nphones++] = tok;
+	}
+
+	if (nphones < pn) {
+		E_ERROR("phoneme queries need at least %d phonemes\n", pn);
+		n = -EINVAL;
+		goto out;
+	}
+
+	/* every overlapping n-gram of the query must line up */
+	nterms = nphones - pn + 1;
+	terms = calloc(nterms, sizeof(*terms));
+	if (!terms) {
+		n = -ENOMEM;
+		goto out;
+	}
+
+	for (k = 0; k < nterms; k++) {
+		len = 0;
+		for (i = 0; i < pn && len < sizeof(key) - 1; i++)
+			len += snprintf(key + len, sizeof(key) - len, "%s%s",
+					i ? " " : "", phones[k + i]);
+		terms[k] = terms_find(&idx->ix_phones, key);
+		if (!terms[k])
+			goto out;
+	}
+
+	n = index_match(idx, terms, nterms, hits);
+
+out:
+	free(copy);
+	free(phones);
+	free(terms);
+
+	return n;
+}
+
+void yasp_index_free_hits(struct yasp_index_hit *hits)
+{
+	free(hits);
+}
+
+static int read_u32(FILE *fh, uint32 *v)
+{
+	return fread(v, sizeof(*v), 1, fh) == 1 ? 0 : -1;
+}
+
+static char *read_str(FILE *fh)
+{
+	uint32 len;
+	char *s;
+
+	if (read_u32(fh, &len) || len >= INDEX_MAX_KEY)
+		return NULL;
+
+	s = malloc(len + 1);
+	if (!s)
+		return NULL;
+	if (fread(s, 1, len, fh) != len) {
+		free(s);
+		return NULL;
+	}
+	s[len] = '\0';
+
+	return s;
+}
+
+static int read_terms(FILE *fh, struct index_terms *it, uint32 nterms,
+		      uint32 nclips)
+{
+	struct index_term *term;
+	uint32 i, j, npostings;
+	char *key;
+
+	for (i = 0; i < nterms; i++) {
+		key = read_str(fh);
+		if (!key || read_u32(fh, &npostings)) {
+			free(key);
+			return -1;
+		}
+
+		term = terms_get(it, key);
+		free(key);
+		if (!term)
+			return -ENOMEM;
+
+		term->tm_postings = malloc(npostings *
+					   sizeof(*term->tm_postings));
+		if (npostings && !term->tm_postings)
+			return -ENOMEM;
+		term->tm_size = npostings;
+
+		if (fread(term->tm_postings, sizeof(*term->tm_postings),
+			  npostings, fh) != npostings)
+			return -1;
+		term->tm_n = npostings;
+
+		for (j = 0; j < npostings; j++) {
+			if (term->tm_postings[j].pt_clip >= nclips)
+				return -1;
+		}
+	}
+
+	return 0;
+}
+
+static int index_load(struct yasp_index *idx, FILE *fh)
+{
+	char magic[sizeof(INDEX_MAGIC) - 1];
+	uint32 version, phone_n, nclips, nwords, nphones, i;
+	int rc;
+
+	if (fread(magic, sizeof(magic), 1, fh) != 1 ||
+	    memcmp(magic, INDEX_MAGIC, sizeof(magic)) ||
+	    read_u32(fh, &version) || version != INDEX_VERSION ||
+	    read_u32(fh, &phone_n) || read_u32(fh, &nclips) ||
+	    read_u32(fh, &nwords) || read_u32(fh, &nphones))
+		return -1;
+
+	idx->ix_phone_n = phone_n;
+
+	idx->ix_clips = calloc(nclips, sizeof(*idx->ix_clips));
+	if (nclips && !idx->ix_clips)
+		return -ENOMEM;
+	idx->ix_clips_size = nclips;
+
+	for (i = 0; i < nclips; i++) {
+		idx->ix_clips[i] = read_str(fh);
+		if (!idx->ix_clips[i])
+			return -1;
+		idx->ix_nclips++;
+	}
+
+	rc = read_terms(fh, &idx->ix_words, nwords, nclips);
+	if (!rc)
+		rc = read_terms(fh, &idx->ix_phones, nphones, nclips);
+
+	return rc;
+}
+
+struct yasp_index *yasp_index_open(const char *path, int phone_n)
+{
+	struct yasp_index *idx;
+	FILE *fh;
+
+	if (!path || phone_n < 0) {
+		E_ERROR("bad parameter\n");
+		return NULL;
+	}
+
+	idx = calloc(1, sizeof(*idx));
+	if (!idx) {
+		E_ERROR("out of memory\n");
+		return NULL;
+	}
+
+	idx->ix_phone_n = phone_n;
+	idx->ix_path = strdup(path);
+	if (!idx->ix_path || terms_init(&idx->ix_words) ||
+	    terms_init(&idx->ix_phones)) {
+		E_ERROR("out of memory\n");
+		goto fail;
+	}
+
+	fh = fopen(path, "rb");
+	if (!fh) {
+		if (errno == ENOENT)
+			return idx;
+		E_ERROR("unable to open index %s. errno = %s\n", path,
+			strerror(errno));
+		goto fail;
+	}
+
+	if (index_load(idx, fh)) {
+		E_ERROR("%s isn't a valid yasp index\n", path);
+		fclose(fh);
+		goto fail;
+	}
+	fclose(fh);
+
+	return idx;
+
+fail:
+	yasp_index_close(idx);
+	return NULL;
+}
+
+static int write_str(FILE *fh, const char *s)
+{
+	uint32 len = strlen(s);
+
+	if (fwrite(&len, sizeof(len), 1, fh) != 1 ||
+	    fwrite(s, 1, len, fh) != len)
+		return -1;
+
+	return 0;
+}
+
+/* write the live postings, with the clip ids renumbered by remap */
+static int write_terms(FILE *fh, struct index_terms *it, const int *remap)
+{
+	struct index_posting pt;
+	struct index_term *term;
+	uint32 i, j, n;
+
+	for (i = 0; i < it->it_n; i++) {
+		term = it->it_terms[i];
+		for (n = 0, j = 0; j < term->tm_n; j++)
+			n += remap[term->tm_postings[j].pt_clip] >= 0;
+
+		if (write_str(fh, term->tm_key) ||
+		    fwrite(&n, sizeof(n), 1, fh) != 1)
+			return -1;
+
+		for (j = 0; j < term->tm_n; j++) {
+			pt = term->tm_postings[j];
+			if (remap[pt.pt_clip] < 0)
+				continue;
+			pt.pt_clip = remap[pt.pt_clip];
+			if (fwrite(&pt, sizeof(pt), 1, fh) != 1)
+				return -1;
+		}
+	}
+
+	return 0;
+}
+
+/*
+ * Written to a temporary file first and renamed over the index, so a
+ * reader never sees a partial index. Terms left with no live postings
+ * are kept, they only cost their key.
+ */
+int yasp_index_save(struct yasp_index *idx)
+{
+	uint32 hdr[5] = { INDEX_VERSION };
+	char *tmp = NULL;
+	int *remap = NULL;
+	FILE *fh = NULL;
+	uint32 i, nlive = 0;
+	int rc = -1;
+
+	if (!idx) {
+		E_ERROR("bad parameter\n");
+		return -EINVAL;
+	}
+
+	remap = calloc(idx->ix_nclips + 1, sizeof(*remap));
+	tmp = malloc(strlen(idx->ix_path) + 5);
+	if (!remap || !tmp) {
+		E_ERROR("out of memory\n");
+		rc = -ENOMEM;
+		goto out;
+	}
+
+	for (i = 0; i < idx->ix_nclips; i++)
+		remap[i] = idx->ix_clips[i] ? (int) nlive++ : -1;
+
+	sprintf(tmp, "%s.tmp", idx->ix_path);
+	fh = fopen(tmp, "wb");
+	if (!fh) {
+		E_ERROR("unable to write index %s. errno = %s\n", tmp,
+			strerror(errno));
+		rc = -errno;
+		goto out;
+	}
+
+	hdr[1] = idx->ix_phone_n;
+	hdr[2] = nlive;
+	hdr[3] = idx->ix_words.it_n;
+	hdr[4] = idx->ix_phones.it_n;
+	if (fwrite(INDEX_MAGIC, sizeof(INDEX_MAGIC) - 1, 1, fh) != 1 ||
+	    fwrite(hdr, sizeof(hdr), 1, fh) != 1)
+		goto out;
+
+	for (i = 0; i < idx->ix_nclips; i++) {
+		if (idx->ix_clips[i] && write_str(fh, idx->ix_clips[i]))
+			goto out;
+	}
+
+	if (write_terms(fh, &idx->ix_words, remap) ||
+	    write_terms(fh, &idx->ix_phones, remap))
+		goto out;
+
+	rc = fclose(fh) ? -1 : 0;
+	fh = NULL;
+	if (!rc && rename(tmp, idx->ix_path)) {
+		E_ERROR("unable to replace index %s. errno = %s\n",
+			idx->ix_path, strerror(errno));
+		rc = -errno;
+	}
+
+out:
+	if (fh)
+		fclose(fh);
+	if (rc && tmp)
+		unlink(tmp);
+	if (rc == -1)
+		E_ERROR("Failed to write index %s\n", idx->ix_path);
+	free(tmp);
+	free(remap);
+
+	return rc;
+}
+
+void yasp_index_close(struct yasp_index *idx)
+{
+	uint32 i;
+
+	if (!idx)
+		return;
+
+	for (i = 0; i < idx->ix_nclips; i++)
+		free(idx->ix_clips[i]);
+	free(idx->ix_clips);
+	terms_fini(&idx->ix_words);
+	terms_fini(&idx->ix_phones);
+	free(idx->ix_path);
+	free(idx);
+}
@@ -0,0 +1,203 @@
+/*
+  Copyright (c) 2019 Amir Shehata
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in
+  all copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+  THE SOFTWARE.
+*/
+
+/*
+ * yasp index: maintain and query a yasp_index from the command line.
+ *
+ *	run index [-n <phone n>] <index> add <clip> <result.json> ...
+ *	run index <index> remove <clip> ...
+ *	run index <index> find <word or phrase>
+ *	run index <index> phonemes <phonemes>
+ */
+
+#include <getopt.h>
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pocketsphinx.h>
+#include "list.h"
+#include "yasp.h"
+#include "yasp_cli.h"
+
+#define INDEX_PHONE_N		3
+
+static char *read_file(const char *path)
+{
+	char *buf = NULL;
+	size_t len = 0;
+	FILE *fh;
+
+	fh = fopen(path, "r");
+	if (!fh) {
+		E_ERROR("unable to open %s. errno = %s\n", path,
+			strerror(errno));
+		return NULL;
+	}
+
+	if (getdelim(&buf, &len, '\0', fh) < 0) {
+		E_ERROR("unable to read %s\n", path);
+		free(buf);
+		buf = NULL;
+	}
+	fclose(fh);
+
+	return buf;
+}
+
+static int index_add_file(struct yasp_index *idx, const char *clip,
+			  const char *result)
+{
+	char *json;
+	int rc;
+
+	json = read_file(result);
+	if (!json)
+		return -1;
+
+	rc = yasp_index_add_json(idx, clip, json);
+	free(json);
+
+	return rc;
+}
+
+int yasp_index_results(const char *path, struct yasp_job *jobs, int njobs)
+{
+	struct yasp_index *idx;
+	int i, rc;
+
+	idx = yasp_index_open(path, INDEX_PHONE_N);
+	if (!idx)
+		return -1;
+
+	for (i = 0; i < njobs; i++) {
+		if (!jobs[i].jb_rc && jobs[i].jb_output)
+			index_add_file(idx, jobs[i].jb_audio,
+				       jobs[i].jb_output);
+	}
+
+	rc = yasp_index_save(idx);
+	yasp_index_close(idx);
+
+	return rc;
+}
+
+static void print_hits(struct yasp_index_hit *hits, int nhits)
+{
+	int i;
+
+	for (i = 0; i < nhits; i++)
+		printf("%s\t%d\t%d\t%.3f\n", hits[i].ih_clip,
+		       hits[i].ih_start, hits[i].ih_duration,
+		       hits[i].ih_conf);
+}
+
+static void index_usage(void)
+{
+	printf("Usage: \n"
+	       "run index [-n <phoneme n-gram length>] <index> "
+	       "add <clip> <result.json> [<clip> <result.json> ...]\n"
+	       "run index <index> remove <clip> [<clip> ...]\n"
+	       "run index <index> find <word or phrase>\n"
+	       "run index <index> phonemes <phonemes>\n");
+}
+
+int yasp_index_cmd(int argc, char *argv[])
+{
+	struct yasp_index_hit *hits;
+	struct yasp_index *idx;
+	int phone_n = INDEX_PHONE_N;
+	const char *cmd;
+	int opt, i, n;
+	int rc = 0;
+
+	while ((opt = getopt(argc, argv, "n:h")) != -1) {
+		switch (opt) {
+		case 'n':
+			phone_n = atoi(optarg);
+			break;
+		case 'h':
+			index_usage();
+			return -1;
+		default:
+			E_ERROR("Unknown command line option\n");
+			return -1;
+		}
+	}
+
+	if (argc - optind < 3) {
+		index_usage();
+		return -1;
+	}
+
+	idx = yasp_index_open(argv[optind], phone_n);
+	if (!idx)
+		return -1;
+
+	cmd = argv[optind + 1];
+	argv += optind + 2;
+	argc -= optind + 2;
+
+	if (!strcmp(cmd, "add")) {
+		if (argc % 2) {
+			E_ERROR("add takes <clip> <result.json> pairs\n");
+			rc = -1;
+			goto out;
+		}
+		for (i = 0; i < argc; i += 2) {
+			if (index_add_file(idx, argv[i], argv[i + 1]))
+				rc = -1;
+		}
+		if (yasp_index_save(idx))
+			rc = -1;
+	} else if (!strcmp(cmd, "remove")) {
+		for (i = 0; i < argc; i++) {
+			if (yasp_index_remove(idx, argv[i]))
+				E_ERROR("%s isn't in the index\n", argv[i]);
+		}
+		if (yasp_index_save(idx))
+			rc = -1;
+	} else if (!strcmp(cmd, "find") || !strcmp(cmd, "phonemes")) {
+		if (argc != 1) {
+			E_ERROR("quote the phrase to search for\n");
+			rc = -1;
+			goto out;
+		}
+		if (!strcmp(cmd, "find"))
+			n = yasp_index_find(idx, argv[0], &hits);
+		else
+			n = yasp_index_find_phonemes(idx, argv[0], &hits);
+		if (n < 0) {
+			rc = n;
+			goto out;
+		}
+		print_hits(hits, n);
+		yasp_index_free_hits(hits);
+	} else {
+		index_usage();
+		rc = -1;
+	}
+
+out:
+	yasp_index_close(idx);
+
+	return rc;
+}
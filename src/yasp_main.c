@@ -0,0 +1,665 @@
+/*
+  Copyright (c) 2019 Amir Shehata
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in
+  all copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+  THE SOFTWARE.
+*/
+
+/*
+ * The yasp command line tool. Everything it does goes through the
+ * public API in yasp.h, which is built as libyasp.
+ */
+
+#include <getopt.h>
+#include <errno.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <pocketsphinx.h>
+#include "list.h"
+#include "yasp.h"
+#include "yasp_cli.h"
+
+static void report_stats(bool print, const char *json_path)
+{
+	struct yasp_stats stats;
+	char *json;
+	FILE *fh;
+
+	yasp_get_stats(&stats);
+
+	if (print)
+		yasp_print_stats(stdout, &stats);
+
+	if (!json_path)
+		return;
+
+	json = yasp_stats_json(&stats);
+	if (!json)
+		return;
+
+	fh = fopen(json_path, "w");
+	if (fh) {
+		fprintf(fh, "%s\n", json);
+		fclose(fh);
+	} else {
+		E_ERROR("Failed to open stats output: %s\n", json_path);
+	}
+
+	yasp_free_json_str(json);
+}
+
+/*
+ * Manifest lines are tab separated:
+ *	audio <TAB> transcript <TAB> output [<TAB> genpath]
+ * A transcript of "-" or an empty one means generate a hypothesis.
+ * Empty lines and lines starting with '#' are skipped. Every malformed
+ * line is reported on stderr and then the whole manifest is refused,
+ * so a typo can't pass for a successful run.
+ *
+ * Each job's fields point into a single copy of its line, starting at
+ * jb_audio, so freeing jb_audio frees the lot.
+ */
+static int read_manifest(const char *manifest, struct yasp_job **jobs_out)
+{
+	struct yasp_job *jobs = NULL, *tmp;
+	char *line = NULL, *copy, *cur;
+	size_t len = 0;
+	int njobs = 0, lineno = 0, bad = 0;
+	ssize_t nread;
+	FILE *fh;
+
+	fh = fopen(manifest, "r");
+	if (!fh) {
+		E_ERROR("unable to open manifest %s. errno = %s\n",
+			manifest, strerror(errno));
+		return -1;
+	}
+
+	while ((nread = getline(&line, &len, fh)) != -1) {
+		lineno++;
+		line[strcspn(line, "\r\n")] = '\0';
+		if (!line[0] || line[0] == '#')
+			continue;
+
+		tmp = realloc(jobs, (njobs + 1) * sizeof(*jobs));
+		if (!tmp)
+			goto nomem;
+		jobs = tmp;
+
+		copy = strdup(line);
+		if (!copy)
+			goto nomem;
+
+		memset(&jobs[njobs], 0, sizeof(*jobs));
+		cur = copy;
+		jobs[njobs].jb_audio = strsep(&cur, "\t");
+		jobs[njobs].jb_transcript = strsep(&cur, "\t");
+		jobs[njobs].jb_output = strsep(&cur, "\t");
+		jobs[njobs].jb_genpath = strsep(&cur, "\t");
+
+		if (!jobs[njobs].jb_output || !jobs[njobs].jb_output[0]) {
+			fprintf(stderr, "%s:%d: expected audio, transcript "
+				"and output\n", manifest, lineno);
+			E_ERROR("%s:%d: expected audio, transcript and "
+				"output\n", manifest, lineno);
+			free(copy);
+			bad++;
+			continue;
+		}
+
+		if (!strcmp(jobs[njobs].jb_transcript, "-") ||
+		    !jobs[njobs].jb_transcript[0])
+			jobs[njobs].jb_transcript = NULL;
+
+		njobs++;
+	}
+
+	if (bad) {
+		fprintf(stderr, "%s: %d malformed lines, no jobs run\n",
+			manifest, bad);
+		goto fail;
+	}
+
+	free(line);
+	fclose(fh);
+
+	*jobs_out = jobs;
+
+	return njobs;
+
+nomem:
+	E_ERROR("out of memory\n");
+fail:
+	while (njobs-- > 0)
+		free((char *) jobs[njobs].jb_audio);
+	free(jobs);
+	free(line);
+	fclose(fh);
+
+	return -1;
+}
+
+struct manifest_progress {
+	pthread_mutex_t mp_lock;
+	int mp_done;
+	int mp_total;
+};
+
+static void manifest_job_done(struct yasp_job *job, void *user_data)
+{
+	struct manifest_progress *mp = user_data;
+
+	pthread_mutex_lock(&mp->mp_lock);
+	mp->mp_done++;
+	printf("[%d/%d] %-6s %s -> %s\n", mp->mp_done, mp->mp_total,
+	       job->jb_rc ? "FAILED" : "ok", job->jb_audio, job->jb_output);
+	fflush(stdout);
+	pthread_mutex_unlock(&mp->mp_lock);
+}
+
+/*
+ * Run every job in the manifest off one context, so the models are
+ * loaded once per worker rather than once per clip. A failed job is
+ * reported and the rest carry on.
+ */
+static int run_manifest(const char *manifest, int nworkers, bool processes,
+			const char *index, double timeout)
+{
+	struct yasp_control ctl = { .ct_timeout = timeout };
+	struct manifest_progress mp;
+	struct yasp_context *ctx;
+	struct yasp_job *jobs = NULL;
+	int njobs, failed, i;
+
+	njobs = read_manifest(manifest, &jobs);
+	if (njobs < 0)
+		return -1;
+
+	/* one control for all, each job's decode gets the full timeout */
+	if (timeout > 0) {
+		for (i = 0; i < njobs; i++)
+			jobs[i].jb_ctl = &ctl;
+	}
+
+	ctx = yasp_context_create(NULL);
+	if (!ctx) {
+		E_ERROR("Failed to create yasp context\n");
+		failed = -1;
+		goto out;
+	}
+
+	pthread_mutex_init(&mp.mp_lock, NULL);
+	mp.mp_done = 0;
+	mp.mp_total = njobs;
+
+	if (processes)
+		failed = yasp_context_batch_fork(ctx, jobs, njobs, nworkers,
+						 manifest_job_done, &mp);
+	else
+		failed = yasp_context_batch(ctx, jobs, njobs, nworkers,
+					    manifest_job_done, &mp);
+
+	pthread_mutex_destroy(&mp.mp_lock);
+	yasp_context_destroy(ctx);
+
+	if (failed < 0)
+		goto out;
+
+	printf("\n%d jobs, %d succeeded, %d failed\n", njobs,
+	       njobs - failed, failed);
+	for (i = 0; i < njobs; i++) {
+		if (jobs[i].jb_rc)
+			printf("  FAILED (%d) %s\n", jobs[i].jb_rc,
+			       jobs[i].jb_audio);
+	}
+
+	if (index && yasp_index_results(index, jobs, njobs))
+		E_ERROR("Failed to update index %s\n", index);
+
+out:
+	for (i = 0; i < njobs; i++)
+		free((char *) jobs[i].jb_audio);
+	free(jobs);
+
+	return failed ? -1 : 0;
+}
+
+/*
+ * One keyphrase per line, optionally followed by its own /threshold/.
+ * Empty lines and lines starting with '#' are skipped. The keywords
+ * point into a single copy of the file returned in *buf.
+ */
+static int read_keywords(const char *path, const char ***keywords_out,
+			 char **buf)
+{
+	const char **keywords = NULL, **tmp;
+	char *line, *cur;
+	size_t len = 0;
+	int n = 0;
+	FILE *fh;
+
+	fh = fopen(path, "r");
+	if (!fh) {
+		E_ERROR("unable to open keywords %s. errno = %s\n",
+			path, strerror(errno));
+		return -1;
+	}
+
+	*buf = NULL;
+	if (getdelim(buf, &len, '\0', fh) < 0) {
+		E_ERROR("unable to read keywords %s\n", path);
+		fclose(fh);
+		free(*buf);
+		return -1;
+	}
+	fclose(fh);
+
+	cur = *buf;
+	while ((line = strsep(&cur, "\r\n"))) {
+		if (!line[0] || line[0] == '#')
+			continue;
+
+		tmp = realloc(keywords, (n + 1) * sizeof(*keywords));
+		if (!tmp) {
+			E_ERROR("out of memory\n");
+			free(keywords);
+			free(*buf);
+			return -1;
+		}
+		keywords = tmp;
+		keywords[n++] = line;
+	}
+
+	if (!n) {
+		E_ERROR("no keywords in %s\n", path);
+		free(*buf);
+		return -1;
+	}
+
+	*keywords_out = keywords;
+
+	return n;
+}
+
+static int spot_keywords(const char *audioFile, const char *kwfile,
+			 double threshold, const char *output)
+{
+	struct list_head hit_list;
+	const char **keywords;
+	char *buf, *json;
+	FILE *fh;
+	int n, rc;
+
+	INIT_LIST_HEAD(&hit_list);
+
+	n = read_keywords(kwfile, &keywords, &buf);
+	if (n < 0)
+		return -1;
+
+	rc = yasp_spot_keywords(audioFile, keywords, n, threshold,
+				&hit_list);
+	free(keywords);
+	free(buf);
+	if (rc)
+		return rc;
+
+	json = yasp_create_kws_json(&hit_list);
+	yasp_free_segment_list(&hit_list);
+	if (!json)
+		return -1;
+
+	fh = output ? fopen(output, "w") : stdout;
+	if (fh) {
+		fprintf(fh, "%s\n", json);
+		if (output)
+			fclose(fh);
+	} else {
+		E_ERROR("Failed to open output: %s\n", output);
+		rc = -1;
+	}
+
+	yasp_free_json_str(json);
+
+	return rc;
+}
+
+static char *read_file(const char *path)
+{
+	char *buf = NULL;
+	size_t len = 0;
+	FILE *fh;
+
+	fh = fopen(path, "r");
+	if (!fh) {
+		E_ERROR("unable to open %s. errno = %s\n", path,
+			strerror(errno));
+		return NULL;
+	}
+
+	if (getdelim(&buf, &len, '\0', fh) < 0) {
+		E_ERROR("unable to read %s\n", path);
+		free(buf);
+		buf = NULL;
+	}
+	fclose(fh);
+
+	return buf;
+}
+
+/*
+ * Bring the previous result up to date with the transcript, aligning
+ * only what changed. It's written over the previous result unless
+ * there's an output.
+ */
+static int realign_clip(const char *audioFile, const char *transcript,
+			const char *previous, const char *output)
+{
+	char *prev_json, *text, *json = NULL;
+	FILE *fh;
+	int rc = -1;
+
+	if (!transcript) {
+		E_ERROR("--previous needs the edited transcript\n");
+		return -1;
+	}
+
+	prev_json = read_file(previous);
+	text = read_file(transcript);
+	if (prev_json && text)
+		json = yasp_context_realign_get_str(NULL, audioFile,
+						    prev_json, text);
+	free(prev_json);
+	free(text);
+	if (!json)
+		return -1;
+
+	if (!output)
+		output = previous;
+	fh = fopen(output, "w");
+	if (fh) {
+		fprintf(fh, "%s", json);
+		fclose(fh);
+		rc = 0;
+	} else {
+		E_ERROR("Failed to open output: %s\n", output);
+	}
+
+	yasp_free_json_str(json);
+
+	return rc;
+}
+
+int
+main(int argc, char *argv[])
+{
+	int rc;
+	int opt;
+	const char *audioFile = NULL;
+	const char *transcript = NULL;
+	const char *genpath = NULL;
+	const char *output = NULL;
+	const char *logfile = "default_log";
+	const char *stats_json = NULL;
+	const char *manifest = NULL;
+	const char *kwfile = NULL;
+	const char *index = NULL;
+	const char *previous = NULL;
+	double kws_threshold = 0;
+	double timeout = 0;
+	int nworkers = 1;
+	bool processes = false;
+	bool stats = false;
+	bool hypothesis_only = false;
+	bool allphone = false;
+	struct list_head word_list;
+	struct list_head phoneme_list;
+	struct yasp_logs logs;
+	struct yasp_decoder_params params = { 0 };
+
+	INIT_LIST_HEAD(&word_list);
+	INIT_LIST_HEAD(&phoneme_list);
+
+	if (argc > 1 && !strcmp(argv[1], "serve"))
+		return yasp_serve(argc - 1, argv + 1);
+	if (argc > 1 && !strcmp(argv[1], "index"))
+		return yasp_index_cmd(argc - 1, argv + 1);
+	if (argc > 1 && !strcmp(argv[1], "compile-dict"))
+		return yasp_compile_dict_cmd(argc - 1, argv + 1);
+	if (argc > 1 && !strcmp(argv[1], "check"))
+		return yasp_check_cmd(argc - 1, argv + 1);
+
+	const char *const short_options = "a:t:o:g:l:m:sS:HAk:T:r:DGC:p:f:M:j:P:I:w:h";
+	static const struct option long_options[] = {
+		{ .name = "audio", .has_arg = required_argument, .val = 'a' },
+		{ .name = "transcript", .has_arg = required_argument, .val = 't' },
+		{ .name = "output", .has_arg = required_argument, .val = 'o' },
+		{ .name = "genpath", .has_arg = required_argument, .val = 'g' },
+		{ .name = "logfile", .has_arg = required_argument, .val = 'l' },
+		{ .name = "modeldir", .has_arg = required_argument, .val = 'm' },
+		{ .name = "stats", .has_arg = no_argument, .val = 's' },
+		{ .name = "stats-json", .has_arg = required_argument, .val = 'S' },
+		{ .name = "hypothesis-only", .has_arg = no_argument, .val = 'H' },
+		{ .name = "allphone", .has_arg = no_argument, .val = 'A' },
+		{ .name = "keywords", .has_arg = required_argument, .val = 'k' },
+		{ .name = "kws-threshold", .has_arg = required_argument, .val = 'T' },
+		{ .name = "seed", .has_arg = required_argument, .val = 'r' },
+		{ .name = "g2p", .has_arg = no_argument, .val = 'G' },
+		{ .name = "pron-cache", .has_arg = required_argument, .val = 'C' },
+		{ .name = "profile", .has_arg = required_argument, .val = 'f' },
+		{ .name = "transcript-dict", .has_arg = no_argument, .val = 'D' },
+		{ .name = "previous", .has_arg = required_argument, .val = 'p' },
+		{ .name = "manifest", .has_arg = required_argument, .val = 'M' },
+		{ .name = "jobs", .has_arg = required_argument, .val = 'j' },
+		{ .name = "processes", .has_arg = required_argument, .val = 'P' },
+		{ .name = "index", .has_arg = required_argument, .val = 'I' },
+		{ .name = "timeout", .has_arg = required_argument, .val = 'w' },
+		{ .name = "help", .has_arg = no_argument, .val = 'h' },
+		{ .name = NULL },
+	};
+
+	while ((opt = getopt_long(argc, argv, short_options,
+				  long_options, NULL)) != -1) {
+		switch (opt) {
+		case 'a':
+			audioFile = optarg;
+			break;
+		case 't':
+			transcript = optarg;
+			break;
+		case 'o':
+			output = optarg;
+			break;
+		case 'g':
+			genpath = optarg;
+			break;
+		case 'l':
+			logfile = optarg;
+			break;
+		case 'm':
+			yasp_set_modeldir(optarg);
+			break;
+		case 's':
+			stats = true;
+			break;
+		case 'S':
+			stats_json = optarg;
+			break;
+		case 'H':
+			hypothesis_only = true;
+			break;
+		case 'A':
+			allphone = true;
+			break;
+		case 'k':
+			kwfile = optarg;
+			break;
+		case 'T':
+			kws_threshold = atof(optarg);
+			break;
+		case 'r':
+			yasp_set_seed(atoi(optarg));
+			break;
+		case 'D':
+			yasp_set_transcript_dict(1);
+			break;
+		case 'G':
+			yasp_set_g2p(1);
+			break;
+		case 'C':
+			if (yasp_set_pron_cache(optarg))
+				return -1;
+			break;
+		case 'p':
+			previous = optarg;
+			break;
+		case 'f':
+			if (yasp_parse_decoder_params(optarg, &params) ||
+			    yasp_set_decoder_params(&params))
+				return -1;
+			break;
+		case 'M':
+			manifest = optarg;
+			break;
+		case 'j':
+			nworkers = atoi(optarg);
+			break;
+		case 'P':
+			nworkers = atoi(optarg);
+			processes = true;
+			break;
+		case 'I':
+			index = optarg;
+			break;
+		case 'w':
+			timeout = atof(optarg);
+			break;
+		case 'h':
+			printf("Usage: \n"
+			       "run -a </path/to/audio/file> "
+			       "-t [</path/to/audio/transcript>] "
+                   "-g [</path/to/genfile>] "
+                   "-m [</path/to/modeldir>] "
+                   "[--stats] [--stats-json </path/to/stats.json>] "
+                   "[--hypothesis-only | --allphone] [--seed <n>] "
+                   "[--transcript-dict] [--g2p] [--pron-cache <file>] "
+                   "[--profile <profile>[,<key>=<value>...]]\n"
+			       "run -a </path/to/audio/file> "
+			       "-t </path/to/edited/transcript> "
+			       "--previous </path/to/result.json> "
+			       "[-o </path/to/output.json>]\n"
+			       "run -a </path/to/audio/file> "
+			       "--keywords </path/to/keywords> "
+			       "[--kws-threshold <t>] [-o </path/to/hits.json>]\n"
+			       "run --manifest </path/to/jobs.tsv> "
+			       "[-j <threads> | -P <processes>] [--index </path/to/index>] "
+			       "[--timeout <seconds per job>]\n"
+			       "run serve --help\n"
+			       "run index -h\n"
+			       "run compile-dict -h\n"
+			       "run check -h\n");
+			return -1;
+		default:
+			E_ERROR("Unknown command line option\n");
+			return -1;
+		}
+	}
+
+	if (!audioFile && !manifest) {
+		E_ERROR("No audio file provided. Please provide one\n");
+		return -1;
+	}
+
+	yasp_setup_logging(&logs, NULL, logfile);
+
+	if (manifest) {
+		rc = run_manifest(manifest, nworkers, processes, index,
+				  timeout);
+		goto out;
+	}
+
+	/*
+	 * decode only, skip the alignment pass. The words are written
+	 * without phonemes.
+	 */
+	if (hypothesis_only) {
+		rc = yasp_decode_hypothesis(audioFile, genpath, &word_list);
+		if (!rc && output)
+			rc = yasp_create_json_file(&word_list, &phoneme_list,
+						   output);
+		yasp_free_segment_list(&word_list);
+		goto out;
+	}
+
+	/* just the times the keywords were spoken */
+	if (kwfile) {
+		rc = spot_keywords(audioFile, kwfile, kws_threshold, output);
+		goto out;
+	}
+
+	/*
+	 * phonemes only, one pass with the phone loop and no words at
+	 * all
+	 */
+	if (allphone) {
+		rc = yasp_interpret_allphone(audioFile, &phoneme_list);
+		if (!rc && output)
+			rc = yasp_create_json_file(&word_list, &phoneme_list,
+						   output);
+		yasp_free_segment_list(&phoneme_list);
+		goto out;
+	}
+
+	/* only what changed since the previous result is aligned again */
+	if (previous) {
+		rc = realign_clip(audioFile, transcript, previous, output);
+		if (!output)
+			output = previous;
+	} else {
+		rc = yasp_interpret(audioFile, transcript, output, genpath);
+	}
+	if (rc)
+		E_ERROR("Failed to interpret audio file %s\n",
+			audioFile);
+
+	if (!rc && index) {
+		struct yasp_job job = {
+			.jb_audio = audioFile,
+			.jb_output = output,
+		};
+
+		if (!output)
+			E_ERROR("--index needs an output to index\n");
+		else if (yasp_index_results(index, &job, 1))
+			E_ERROR("Failed to update index %s\n", index);
+	}
+
+	//rc = yasp_interpret_hypothesis(audioFile, transcript, genpath,
+	//			       &word_list);
+	//yasp_free_segment_list(&word_list);
+
+out:
+	if (stats || stats_json)
+		report_stats(stats, stats_json);
+
+	yasp_finish_logging(&logs);
+
+	return rc;
+}
+
@@ -0,0 +1,797 @@
+/*
+  Copyright (c) 2019 Amir Shehata
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in
+  all copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+  THE SOFTWARE.
+*/
+
+/*
+ * yasp serve: an alignment daemon listening on a Unix domain socket.
+ *
+ * The models are loaded once at start up and the decoders stay warm
+ * for the life of the daemon, so clients only pay for the alignment.
+ *
+ * Every message, both ways, is a frame: a 4 byte length in network
+ * byte order followed by that many bytes. A request is a JSON header
+ * frame:
+ *	{
+ *	  "audio": "/path/to/clip.wav",	   audio file, or
+ *	  "pcm": true,			   a PCM frame follows the header
+ *	  "samprate": 16000,		   rate of the PCM, default 16000
+ *	  "text": "the transcript",	   transcript text, or
+ *	  "transcript": "/path/to/clip.txt", a transcript file
+ *	  "genpath": "/path/to/hypothesis", where to put a generated one
+ *	  "output": "/path/to/result.json" also write the result here
+ *	  "allphone": true		   phoneme timing only, no words
+ *	  "keywords": ["a phrase", ...]	   only spot these, see below
+ *	  "kws_threshold": 1e-20
+ *	}
+ * With "pcm" set, the header is followed by one frame of 16-bit little
+ * endian mono samples. Without a transcript a hypothesis is generated.
+ * With "keywords" the reply holds just the keyword hits, as
+ * yasp_create_kws_json() gives them.
+ *
+ * The reply is a single frame holding the alignment JSON, or on
+ * failure {"error": "...", "code": -errno}. A connection may carry any
+ * number of requests, one after the other.
+ *
+ * Each client gets a thread which reads its requests and puts them on
+ * a bounded queue served by a fixed set of workers. When the queue is
+ * full the request is refused straight away with a "busy" error rather
+ * than left to pile up, and the client is expected to back off and
+ * retry. The same goes for connections beyond the client limit.
+ */
+
+#include <getopt.h>
+#include <errno.h>
+#include <signal.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <arpa/inet.h>
+#include <sys/select.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <pocketsphinx.h>
+#include "list.h"
+#include "yasp.h"
+#include "cJSON.h"
+#include "yasp_cli.h"
+
+#define SERVE_MAX_HDR		(1U << 20)
+#define SERVE_MAX_PCM		(1U << 28)
+
+struct serve_req {
+	struct list_head rq_on_queue;
+	cJSON *rq_hdr;
+	int16 *rq_pcm;
+	size_t rq_nsamples;
+	char *rq_reply;
+	bool rq_done;
+	pthread_cond_t rq_cond;
+};
+
+struct serve_state {
+	struct yasp_context *sv_ctx;
+	pthread_mutex_t sv_lock;
+	pthread_cond_t sv_cond;
+	struct list_head sv_queue;
+	int sv_queued;
+	int sv_max_queued;
+	int sv_nclients;
+	int sv_max_clients;
+	bool sv_stopping;
+};
+
+struct serve_client {
+	struct serve_state *cl_sv;
+	int cl_fd;
+};
+
+static volatile sig_atomic_t g_serve_stop;
+
+static void serve_sig(int sig __attribute__((unused)))
+{
+	g_serve_stop = 1;
+}
+
+static int read_full(int fd, void *buf, size_t len)
+{
+	char *p = buf;
+	ssize_t n;
+
+	while (len > 0) {
+		n = read(fd, p, len);
+		if (n < 0 && errno == EINTR)
+			continue;
+		if (n <= 0)
+			return -1;
+		p += n;
+		len -= n;
+	}
+
+	return 0;
+}
+
+static int write_full(int fd, const void *buf, size_t len)
+{
+	const char *p = buf;
+	ssize_t n;
+
+	while (len > 0) {
+		n = send(fd, p, len, MSG_NOSIGNAL);
+		if (n < 0 && errno == EINTR)
+			continue;
+		if (n < 0)
+			return -1;
+		p += n;
+		len -= n;
+	}
+
+	return 0;
+}
+
+/*
+ * read one frame into a NUL terminated buffer. Returns 1 if the peer
+ * closed the connection cleanly between frames.
+ */
+static int read_frame(int fd, char **buf, uint32_t *len, uint32_t max)
+{
+	uint32_t nlen;
+	ssize_t n;
+
+	do {
+		n = read(fd, &nlen, 1);
+	} while (n < 0 && errno == EINTR);
+	if (n == 0)
+		return 1;
+	if (n < 0 || read_full(fd, (char *) &nlen + 1, sizeof(nlen) - 1))
+		return -1;
+
+	*len = ntohl(nlen);
+	if (*len > max) {
+		E_ERROR("frame of %u bytes is over the %u limit\n", *len, max);
+		return -1;
+	}
+
+	*buf = malloc(*len + 1);
+	if (!*buf)
+		return -1;
+
+	if (read_full(fd, *buf, *len)) {
+		free(*buf);
+		return -1;
+	}
+	(*buf)[*len] = '\0';
+
+	return 0;
+}
+
+static int write_frame(int fd, const char *buf, uint32_t len)
+{
+	uint32_t nlen = htonl(len);
+
+	if (write_full(fd, &nlen, sizeof(nlen)))
+		return -1;
+
+	return write_full(fd, buf, len);
+}
+
+static char *error_reply(const char *msg, int code)
+{
+	cJSON *jroot;
+	char *reply = NULL;
+
+	jroot = cJSON_CreateObject();
+	if (!jroot)
+		return NULL;
+
+	if (cJSON_AddStringToObject(jroot, "error", msg) &&
+	    cJSON_AddNumberToObject(jroot, "code", code))
+		reply = cJSON_PrintUnformatted(jroot);
+
+	cJSON_Delete(jroot);
+
+	return reply;
+}
+
+static int send_reply(int fd, char *reply)
+{
+	int rc;
+
+	if (!reply)
+		reply = error_reply("out of memory", -ENOMEM);
+	if (!reply)
+		return -1;
+
+	rc = write_frame(fd, reply, strlen(reply));
+	yasp_free_json_str(reply);
+
+	return rc;
+}
+
+static const char *hdr_str(cJSON *hdr, const char *name)
+{
+	cJSON *item = cJSON_GetObjectItemCaseSensitive(hdr, name);
+
+	return cJSON_IsString(item) ? item->valuestring : NULL;
+}
+
+static int write_output(const char *output, const char *json)
+{
+	FILE *fh;
+	int rc = 0;
+
+	fh = fopen(output, "w");
+	if (!fh) {
+		E_ERROR("Failed to open output %s. errno = %s\n", output,
+			strerror(errno));
+		return -errno;
+	}
+
+	if (fputs(json, fh) == EOF)
+		rc = -EIO;
+	if (fclose(fh))
+		rc = -EIO;
+
+	return rc;
+}
+
+/* NULL with *err set when the request itself is bad */
+static char *serve_kws(struct yasp_context *ctx, const char *audio,
+		       cJSON *hdr, const char **err)
+{
+	cJSON *jkeywords, *jthreshold, *item;
+	const char **keywords;
+	double threshold = 0;
+	char *json;
+	int n = 0;
+
+	jkeywords = cJSON_GetObjectItemCaseSensitive(hdr, "keywords");
+	jthreshold = cJSON_GetObjectItemCaseSensitive(hdr, "kws_threshold");
+	if (cJSON_IsNumber(jthreshold))
+		threshold = jthreshold->valuedouble;
+
+	keywords = calloc(cJSON_GetArraySize(jkeywords) + 1,
+			  sizeof(*keywords));
+	if (!keywords) {
+		*err = "out of memory";
+		return NULL;
+	}
+
+	cJSON_ArrayForEach(item, jkeywords) {
+		if (!cJSON_IsString(item)) {
+			*err = "keywords must be strings";
+			free(keywords);
+			return NULL;
+		}
+		keywords[n++] = item->valuestring;
+	}
+
+	if (!n) {
+		*err = "no keywords given";
+		free(keywords);
+		return NULL;
+	}
+
+	json = yasp_context_spot_keywords_get_str(ctx, audio, keywords, n,
+						  threshold);
+	free(keywords);
+
+	return json;
+}
+
+/* run one request on a worker and build its reply */
+static char *serve_align(struct yasp_context *ctx, struct serve_req *rq)
+{
+	const char *audio = hdr_str(rq->rq_hdr, "audio");
+	const char *text = hdr_str(rq->rq_hdr, "text");
+	const char *transcript = hdr_str(rq->rq_hdr, "transcript");
+	const char *genpath = hdr_str(rq->rq_hdr, "genpath");
+	const char *output = hdr_str(rq->rq_hdr, "output");
+	const char *err = NULL;
+	cJSON *samprate;
+	char *json;
+	int rate = 16000;
+	int rc;
+
+	if (rq->rq_pcm) {
+		if (transcript)
+			return error_reply("send the transcript as text "
+					   "with inline PCM", -EINVAL);
+		samprate = cJSON_GetObjectItemCaseSensitive(rq->rq_hdr,
+							    "samprate");
+		if (cJSON_IsNumber(samprate))
+			rate = samprate->valueint;
+		json = yasp_context_interpret_pcm_get_str(ctx, rq->rq_pcm,
+							  rq->rq_nsamples,
+							  rate, text,
+							  genpath);
+	} else if (!audio) {
+		return error_reply("no audio or pcm given", -EINVAL);
+	} else if (cJSON_IsArray(cJSON_GetObjectItemCaseSensitive(rq->rq_hdr,
+								  "keywords"))) {
+		json = serve_kws(ctx, audio, rq->rq_hdr, &err);
+		if (err)
+			return error_reply(err, -EINVAL);
+	} else if (cJSON_IsTrue(cJSON_GetObjectItemCaseSensitive(rq->rq_hdr,
+								 "allphone"))) {
+		json = yasp_context_interpret_allphone_get_str(ctx, audio);
+	} else if (text) {
+		json = yasp_context_interpret_text_get_str(ctx, audio, text,
+							   genpath);
+	} else {
+		json = yasp_context_interpret_get_str(ctx, audio, transcript,
+						      genpath);
+	}
+
+	if (!json)
+		return error_reply("alignment failed, see the log", -EIO);
+
+	if (output) {
+		rc = write_output(output, json);
+		if (rc) {
+			yasp_free_json_str(json);
+			return error_reply("failed to write output", rc);
+		}
+	}
+
+	return json;
+}
+
+static void *serve_worker(void *arg)
+{
+	struct serve_state *sv = arg;
+	struct serve_req *rq;
+	char *reply;
+
+	for (;;) {
+		pthread_mutex_lock(&sv->sv_lock);
+		while (list_empty(&sv->sv_queue) && !sv->sv_stopping)
+			pthread_cond_wait(&sv->sv_cond, &sv->sv_lock);
+		if (list_empty(&sv->sv_queue)) {
+			pthread_mutex_unlock(&sv->sv_lock);
+			break;
+		}
+		rq = list_entry(sv->sv_queue.next, struct serve_req,
+				rq_on_queue);
+		list_del(&rq->rq_on_queue);
+		sv->sv_queued--;
+		pthread_mutex_unlock(&sv->sv_lock);
+
+		reply = serve_align(sv->sv_ctx, rq);
+
+		pthread_mutex_lock(&sv->sv_lock);
+		rq->rq_reply = reply;
+		rq->rq_done = true;
+		pthread_cond_signal(&rq->rq_cond);
+		pthread_mutex_unlock(&sv->sv_lock);
+	}
+
+	return NULL;
+}
+
+/*
+ * queue rq and wait for a worker to answer it. Returns NULL with *code
+ * set if it wasn't queued.
+ */
+static char *serve_submit(struct serve_state *sv, struct serve_req *rq,
+			  int *code)
+{
+	char *reply;
+
+	pthread_mutex_lock(&sv->sv_lock);
+	if (sv->sv_stopping) {
+		pthread_mutex_unlock(&sv->sv_lock);
+		*code = -ESHUTDOWN;
+		return NULL;
+	}
+	if (sv->sv_queued >= sv->sv_max_queued) {
+		pthread_mutex_unlock(&sv->sv_lock);
+		*code = -EBUSY;
+		return NULL;
+	}
+
+	pthread_cond_init(&rq->rq_cond, NULL);
+	list_add_tail(&rq->rq_on_queue, &sv->sv_queue);
+	sv->sv_queued++;
+	pthread_cond_signal(&sv->sv_cond);
+
+	while (!rq->rq_done)
+		pthread_cond_wait(&rq->rq_cond, &sv->sv_lock);
+	reply = rq->rq_reply;
+	pthread_mutex_unlock(&sv->sv_lock);
+
+	pthread_cond_destroy(&rq->rq_cond);
+
+	return reply;
+}
+
+/* read a request off the connection. Returns 1 on a clean close. */
+static int read_request(int fd, struct serve_req *rq)
+{
+	char *buf, *pcm;
+	uint32_t len;
+	int rc;
+
+	rc = read_frame(fd, &buf, &len, SERVE_MAX_HDR);
+	if (rc)
+		return rc;
+
+	rq->rq_hdr = cJSON_Parse(buf);
+	free(buf);
+	if (!cJSON_IsObject(rq->rq_hdr)) {
+		E_ERROR("malformed request header\n");
+		cJSON_Delete(rq->rq_hdr);
+		rq->rq_hdr = NULL;
+		return -EINVAL;
+	}
+
+	if (!cJSON_IsTrue(cJSON_GetObjectItemCaseSensitive(rq->rq_hdr,
+							   "pcm")))
+		return 0;
+
+	rc = read_frame(fd, &pcm, &len, SERVE_MAX_PCM);
+	if (rc) {
+		cJSON_Delete(rq->rq_hdr);
+		rq->rq_hdr = NULL;
+		return -1;
+	}
+
+	rq->rq_pcm = (int16 *) pcm;
+	rq->rq_nsamples = len / sizeof(int16);
+
+	return 0;
+}
+
+static void *serve_client(void *arg)
+{
+	struct serve_client *cl = arg;
+	struct serve_state *sv = cl->cl_sv;
+	struct serve_req rq;
+	char *reply;
+	int rc, code;
+
+	for (;;) {
+		memset(&rq, 0, sizeof(rq));
+
+		rc = read_request(cl->cl_fd, &rq);
+		if (rc == -EINVAL) {
+			/* the framing is intact, let the client carry on */
+			if (send_reply(cl->cl_fd,
+				       error_reply("malformed request",
+						   -EINVAL)))
+				break;
+			continue;
+		}
+		if (rc)
+			break;
+
+		code = 0;
+		reply = serve_submit(sv, &rq, &code);
+		if (!reply && code)
+			reply = error_reply(code == -EBUSY ? "busy" :
+					    "shutting down", code);
+
+		cJSON_Delete(rq.rq_hdr);
+		free(rq.rq_pcm);
+
+		if (send_reply(cl->cl_fd, reply))
+			break;
+	}
+
+	close(cl->cl_fd);
+	free(cl);
+
+	pthread_mutex_lock(&sv->sv_lock);
+	sv->sv_nclients--;
+	pthread_mutex_unlock(&sv->sv_lock);
+
+	return NULL;
+}
+
+static int serve_accept(struct serve_state *sv, int fd)
+{
+	struct serve_client *cl;
+	pthread_attr_t attr;
+	pthread_t tid;
+	bool full;
+	int rc;
+
+	pthread_mutex_lock(&sv->sv_lock);
+	full = sv->sv_nclients >= sv->sv_max_clients;
+	if (!full)
+		sv->sv_nclients++;
+	pthread_mutex_unlock(&sv->sv_lock);
+
+	if (full) {
+		send_reply(fd, error_reply("busy", -EBUSY));
+		close(fd);
+		return -EBUSY;
+	}
+
+	cl = calloc(1, sizeof(*cl));
+	if (!cl) {
+		rc = -ENOMEM;
+		goto fail;
+	}
+	cl->cl_sv = sv;
+	cl->cl_fd = fd;
+
+	pthread_attr_init(&attr);
+	pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+	rc = -pthread_create(&tid, &attr, serve_client, cl);
+	pthread_attr_destroy(&attr);
+	if (!rc)
+		return 0;
+
+	free(cl);
+fail:
+	E_ERROR("Failed to start a client thread\n");
+	close(fd);
+	pthread_mutex_lock(&sv->sv_lock);
+	sv->sv_nclients--;
+	pthread_mutex_unlock(&sv->sv_lock);
+
+	return rc;
+}
+
+static int serve_listen(const char *path)
+{
+	struct sockaddr_un addr;
+	int fd;
+
+	if (strlen(path) >= sizeof(addr.sun_path)) {
+		E_ERROR("socket path %s is too long\n", path);
+		return -1;
+	}
+
+	fd = socket(AF_UNIX, SOCK_STREAM, 0);
+	if (fd < 0) {
+		E_ERROR("Failed to create socket. errno = %s\n",
+			strerror(errno));
+		return -1;
+	}
+
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	strcpy(addr.sun_path, path);
+
+	/* a stale socket left behind by a daemon that didn't exit cleanly */
+	unlink(path);
+
+	if (bind(fd, (struct sockaddr *) &addr, sizeof(addr)) ||
+	    listen(fd, SOMAXCONN)) {
+		E_ERROR("Failed to listen on %s. errno = %s\n", path,
+			strerror(errno));
+		close(fd);
+		return -1;
+	}
+
+	return fd;
+}
+
+static void serve_usage(void)
+{
+	printf("Usage: \n"
+	       "run serve [-s </path/to/socket>] [-j <workers>] "
+	       "[-q <queue depth>] [-c <max clients>] "
+	       "[-m </path/to/modeldir>] [-l </path/to/logfile>] "
+	       "[--seed <n>] [--g2p] [--pron-cache </path/to/cache>] "
+	       "[--profile <profile>[,<key>=<value>...]]\n");
+}
+
+int yasp_serve(int argc, char *argv[])
+{
+	const char *socket_path = "yasp.sock";
+	const char *logfile = "default_log";
+	const char *modeldir = NULL;
+	struct serve_state sv;
+	struct yasp_decoder_params params = { 0 };
+	struct yasp_logs logs;
+	struct sigaction sa;
+	sigset_t stop_sigs, accept_mask;
+	fd_set rfds;
+	pthread_t *workers;
+	int nworkers = 2;
+	int listen_fd, fd;
+	int opt, i, n;
+	int rc = -1;
+
+	memset(&sv, 0, sizeof(sv));
+	sv.sv_max_queued = 16;
+	sv.sv_max_clients = 64;
+
+	const char *const short_options = "s:j:q:c:m:l:r:GC:f:h";
+	static const struct option long_options[] = {
+		{ .name = "socket", .has_arg = required_argument, .val = 's' },
+		{ .name = "workers", .has_arg = required_argument, .val = 'j' },
+		{ .name = "queue", .has_arg = required_argument, .val = 'q' },
+		{ .name = "max-clients", .has_arg = required_argument, .val = 'c' },
+		{ .name = "modeldir", .has_arg = required_argument, .val = 'm' },
+		{ .name = "logfile", .has_arg = required_argument, .val = 'l' },
+		{ .name = "seed", .has_arg = required_argument, .val = 'r' },
+		{ .name = "g2p", .has_arg = no_argument, .val = 'G' },
+		{ .name = "pron-cache", .has_arg = required_argument, .val = 'C' },
+		{ .name = "profile", .has_arg = required_argument, .val = 'f' },
+		{ .name = "help", .has_arg = no_argument, .val = 'h' },
+		{ .name = NULL },
+	};
+
+	while ((opt = getopt_long(argc, argv, short_options,
+				  long_options, NULL)) != -1) {
+		switch (opt) {
+		case 's':
+			socket_path = optarg;
+			break;
+		case 'j':
+			nworkers = atoi(optarg);
+			break;
+		case 'q':
+			sv.sv_max_queued = atoi(optarg);
+			break;
+		case 'c':
+			sv.sv_max_clients = atoi(optarg);
+			break;
+		case 'm':
+			modeldir = optarg;
+			break;
+		case 'l':
+			logfile = optarg;
+			break;
+		case 'r':
+			yasp_set_seed(atoi(optarg));
+			break;
+		case 'G':
+			yasp_set_g2p(1);
+			break;
+		case 'C':
+			if (yasp_set_pron_cache(optarg))
+				return -1;
+			break;
+		case 'f':
+			if (yasp_parse_decoder_params(optarg, &params) ||
+			    yasp_set_decoder_params(&params))
+				return -1;
+			break;
+		case 'h':
+			serve_usage();
+			return -1;
+		default:
+			E_ERROR("Unknown command line option\n");
+			return -1;
+		}
+	}
+
+	if (nworkers < 1 || sv.sv_max_queued < 1 || sv.sv_max_clients < 1) {
+		E_ERROR("workers, queue and max clients must be positive\n");
+		return -1;
+	}
+
+	yasp_setup_logging(&logs, NULL, logfile);
+
+	workers = calloc(nworkers, sizeof(*workers));
+	if (!workers) {
+		E_ERROR("out of memory\n");
+		goto out_logs;
+	}
+
+	sv.sv_ctx = yasp_context_create(modeldir);
+	if (!sv.sv_ctx) {
+		E_ERROR("Failed to create yasp context\n");
+		goto out_workers;
+	}
+
+	/* one warm decoder per worker, nobody waits on a model load */
+	if (yasp_context_warm(sv.sv_ctx, nworkers))
+		goto out_ctx;
+
+	listen_fd = serve_listen(socket_path);
+	if (listen_fd < 0)
+		goto out_ctx;
+
+	/*
+	 * the signals are blocked here and in every thread started from
+	 * here on, and only let through while waiting for a connection.
+	 * Otherwise the kernel may hand them to a worker and the wait
+	 * carries on until the next client.
+	 */
+	sigemptyset(&stop_sigs);
+	sigaddset(&stop_sigs, SIGINT);
+	sigaddset(&stop_sigs, SIGTERM);
+	pthread_sigmask(SIG_BLOCK, &stop_sigs, &accept_mask);
+	sigdelset(&accept_mask, SIGINT);
+	sigdelset(&accept_mask, SIGTERM);
+
+	memset(&sa, 0, sizeof(sa));
+	sa.sa_handler = serve_sig;
+	sigaction(SIGINT, &sa, NULL);
+	sigaction(SIGTERM, &sa, NULL);
+
+	pthread_mutex_init(&sv.sv_lock, NULL);
+	pthread_cond_init(&sv.sv_cond, NULL);
+	INIT_LIST_HEAD(&sv.sv_queue);
+
+	for (n = 0; n < nworkers; n++) {
+		if (pthread_create(&workers[n], NULL, serve_worker, &sv)) {
+			E_ERROR("Failed to start worker %d\n", n);
+			break;
+		}
+	}
+
+	if (n == nworkers) {
+		printf("yasp serving on %s with %d workers\n", socket_path,
+		       nworkers);
+		fflush(stdout);
+		rc = 0;
+	}
+
+	while (!rc && !g_serve_stop) {
+		/* unblocks the signals only for the wait, with no gap */
+		FD_ZERO(&rfds);
+		FD_SET(listen_fd, &rfds);
+		if (pselect(listen_fd + 1, &rfds, NULL, NULL, NULL,
+			    &accept_mask) < 0) {
+			if (errno == EINTR)
+				continue;
+			E_ERROR("pselect failed. errno = %s\n",
+				strerror(errno));
+			rc = -1;
+			break;
+		}
+
+		fd = accept(listen_fd, NULL, NULL);
+		if (fd < 0) {
+			if (errno == EINTR || errno == ECONNABORTED)
+				continue;
+			E_ERROR("accept failed. errno = %s\n",
+				strerror(errno));
+			rc = -1;
+			break;
+		}
+		serve_accept(&sv, fd);
+	}
+
+	close(listen_fd);
+	unlink(socket_path);
+
+	/*
+	 * let the workers drain what's queued. Clients still connected
+	 * are refused from here on and go away with the process, so the
+	 * state isn't torn down under them.
+	 */
+	pthread_mutex_lock(&sv.sv_lock);
+	sv.sv_stopping = true;
+	pthread_cond_broadcast(&sv.sv_cond);
+	pthread_mutex_unlock(&sv.sv_lock);
+
+	for (i = 0; i < n; i++)
+		pthread_join(workers[i], NULL);
+
+out_ctx:
+	yasp_context_destroy(sv.sv_ctx);
+out_workers:
+	free(workers);
+out_logs:
+	yasp_finish_logging(&logs);
+
+	return rc;
+}
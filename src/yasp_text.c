@@ -0,0 +1,161 @@
+/*
+  Copyright (c) 2019 Amir Shehata
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in
+  all copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+  THE SOFTWARE.
+*/
+
+/*
+ * Transcript tokenizer. One pass over the text, with every byte
+ * classified through a table, writes the normalized words back to back
+ * into a single buffer and records where each one starts.
+ */
+
+#include <errno.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pocketsphinx.h>
+#include "yasp.h"
+#include "yasp_text.h"
+
+enum text_class {
+	TC_DROP = 0,
+	TC_SPACE,
+	TC_WORD,
+	TC_UPPER,
+	/* kept only between two word characters */
+	TC_INNER,
+};
+
+static const unsigned char text_class[256] = {
+	[' '] = TC_SPACE, ['\t'] = TC_SPACE, ['\n'] = TC_SPACE,
+	['\r'] = TC_SPACE, ['\v'] = TC_SPACE, ['\f'] = TC_SPACE,
+	['a' ... 'z'] = TC_WORD,
+	['0' ... '9'] = TC_WORD,
+	['A' ... 'Z'] = TC_UPPER,
+	['\''] = TC_INNER, ['-'] = TC_INNER,
+	/* UTF-8 sequences pass through untouched */
+	[0x80 ... 0xff] = TC_WORD,
+};
+
+static bool is_word(const char *p, const char *end)
+{
+	return p < end && (text_class[(unsigned char) *p] == TC_WORD ||
+			   text_class[(unsigned char) *p] == TC_UPPER);
+}
+
+static int add_token(struct yasp_tokens *ts, uint32 off, uint32 line,
+		     uint32 column)
+{
+	struct yasp_token *tokens;
+
+	if (ts->ts_n == ts->ts_size) {
+		tokens = realloc(ts->ts_tokens,
+				 (ts->ts_size * 2 + 64) * sizeof(*tokens));
+		if (!tokens)
+			return -ENOMEM;
+		ts->ts_tokens = tokens;
+		ts->ts_size = ts->ts_size * 2 + 64;
+	}
+
+	ts->ts_tokens[ts->ts_n].tk_word = ts->ts_buf + off;
+	ts->ts_tokens[ts->ts_n].tk_wid = BAD_S3WID;
+	ts->ts_tokens[ts->ts_n].tk_line = line;
+	ts->ts_tokens[ts->ts_n].tk_column = column;
+	ts->ts_n++;
+
+	return 0;
+}
+
+int yasp_tokenize(const char *text, size_t len, struct yasp_tokens *ts)
+{
+	const char *p = text, *end = text + len, *bol = text, *word;
+	uint32 line = 1;
+	char *out, *first;
+
+	memset(ts, 0, sizeof(*ts));
+
+	/* normalizing never grows a word, so the text's size will do */
+	ts->ts_buf = malloc(len + 1);
+	if (!ts->ts_buf)
+		goto nomem;
+	out = ts->ts_buf;
+
+	while (p < end) {
+		while (p < end && text_class[(unsigned char) *p] == TC_SPACE) {
+			if (*p++ == '\n') {
+				line++;
+				bol = p;
+			}
+		}
+		if (p == end)
+			break;
+
+		word = p;
+		first = out;
+		if (*p == '<' || *p == '[') {
+			/* fillers go to the dictionary as written */
+			while (p < end &&
+			       text_class[(unsigned char) *p] != TC_SPACE)
+				*out++ = *p++;
+		} else {
+			for (; p < end; p++) {
+				unsigned char c = *p;
+
+				switch (text_class[c]) {
+				case TC_WORD:
+					*out++ = c;
+					continue;
+				case TC_UPPER:
+					*out++ = c + ('a' - 'A');
+					continue;
+				case TC_INNER:
+					if (out > first && is_word(p + 1, end))
+						*out++ = c;
+					continue;
+				case TC_DROP:
+					continue;
+				}
+				break;
+			}
+		}
+
+		/* nothing but punctuation */
+		if (out == first)
+			continue;
+		*out++ = '\0';
+
+		if (add_token(ts, first - ts->ts_buf, line, word - bol + 1))
+			goto nomem;
+	}
+
+	return 0;
+
+nomem:
+	E_ERROR("out of memory\n");
+	yasp_tokens_free(ts);
+	return -ENOMEM;
+}
+
+void yasp_tokens_free(struct yasp_tokens *ts)
+{
+	free(ts->ts_buf);
+	free(ts->ts_tokens);
+	memset(ts, 0, sizeof(*ts));
+}
@@ -0,0 +1,65 @@
+/*
+  Copyright (c) 2019 Amir Shehata
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in
+  all copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+  THE SOFTWARE.
+*/
+
+/*
+ * The transcript front end of libyasp. Not part of the public API.
+ */
+
+#ifndef YASP_TEXT_H
+#define YASP_TEXT_H
+
+#include "yasp.h"
+
+/*
+ * A transcript word.
+ *	tk_word: normalized, NUL terminated
+ *	tk_wid: its id in the decoder's dictionary, BAD_S3WID until the
+ *	transcript is aligned
+ *	tk_line, tk_column: where it starts in the text, from 1
+ */
+struct yasp_token {
+	const char *tk_word;
+	int32 tk_wid;
+	uint32 tk_line;
+	uint32 tk_column;
+};
+
+struct yasp_tokens {
+	char *ts_buf;
+	struct yasp_token *ts_tokens;
+	uint32 ts_n;
+	uint32 ts_size;
+};
+
+/*
+ * yasp_tokenize
+ *	split the len bytes of text into words, in order. Words are
+ *	lower-cased and punctuation is dropped, apart from apostrophes
+ *	and hyphens within a word. Fillers written as <sil> or [NOISE]
+ *	are kept as they are. Returns 0 or -ENOMEM.
+ * yasp_tokens_free
+ *	release what yasp_tokenize() allocated
+ */
+int yasp_tokenize(const char *text, size_t len, struct yasp_tokens *ts);
+void yasp_tokens_free(struct yasp_tokens *ts);
+
+#endif /* YASP_TEXT_H */